@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+ * ChessBoard is the game board as one bitset per player (a "bitboard"),
+ * sized at compile time from NUM_PIECES_PER_LINE_HALF.
+ *
+ * Cell (x, y) -- board indices 0 .. Width-1, as in the old board[x][y] -- is
+ * bit x * Stride + y. Each row has one extra, always-empty cell at the end, so
+ * shifting a bitset by one of the four line directions can never carry a
+ * line off one edge of the board and onto the other:
+ *
+ *   along y: 1   along x: Stride   diagonals: Stride + 1, Stride - 1
+ *
+ * A player has NUM_PIECE_TO_WIN in a row in some direction d exactly when
+ *   bits & (bits >> d) & (bits >> 2d) & ...
+ * is non-zero, which has_line() checks with a handful of word operations.
+ */
+
+#include "ChessBoardData.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+struct ChessBoard {
+	static constexpr int Width = NUM_PIECES_PER_LINE_HALF * 2 + 1;
+	static constexpr int Stride = Width + 1; //one padding cell per row (see above)
+	static constexpr size_t Words = (size_t(Width) * Stride + 63) / 64;
+
+	//a set of cells:
+	struct Bits {
+		std::array< uint64_t, Words > words{};
+
+		bool test(int index) const { return (words[index / 64] >> (index % 64)) & 1; }
+		void set(int index) { words[index / 64] |= uint64_t(1) << (index % 64); }
+		void reset(int index) { words[index / 64] &= ~(uint64_t(1) << (index % 64)); }
+		bool any() const {
+			uint64_t acc = 0;
+			for (uint64_t w : words) acc |= w;
+			return acc != 0;
+		}
+
+		bool operator==(Bits const &o) const { return words == o.words; }
+		bool operator!=(Bits const &o) const { return words != o.words; }
+
+		Bits &operator&=(Bits const &o) {
+			for (size_t i = 0; i < Words; ++i) words[i] &= o.words[i];
+			return *this;
+		}
+		//bit i of the result is bit (i + N) of this set:
+		template< int N >
+		Bits shifted() const {
+			constexpr size_t q = size_t(N) / 64;
+			constexpr int r = N % 64;
+			Bits ret;
+			for (size_t i = 0; i + q < Words; ++i) {
+				ret.words[i] = words[i + q] >> r;
+				if constexpr (r != 0) {
+					if (i + q + 1 < Words) ret.words[i] |= words[i + q + 1] << (64 - r);
+				}
+			}
+			return ret;
+		}
+	};
+
+	static int index(int x, int y) {
+		assert(x >= 0 && x < Width && y >= 0 && y < Width);
+		return x * Stride + y;
+	}
+
+	//player at cell (x, y), or 0 if it is empty:
+	int at(int x, int y) const {
+		int i = index(x, y);
+		for (int p = 0; p < PLAYER_NUM; ++p) {
+			if (players[p].test(i)) return p + 1;
+		}
+		return 0;
+	}
+	bool empty(int x, int y) const { return at(x, y) == 0; }
+
+	//put player's piece at (x, y) (or, with player 0, clear the cell):
+	void set(int x, int y, int player) {
+		assert(player >= 0 && player <= PLAYER_NUM);
+		int i = index(x, y);
+		for (int p = 0; p < PLAYER_NUM; ++p) {
+			if (p + 1 == player) players[p].set(i);
+			else players[p].reset(i);
+		}
+	}
+
+	void clear() { players = {}; }
+
+	//does 'player' have NUM_PIECE_TO_WIN pieces in a line anywhere on the board?
+	bool has_line(int player) const {
+		assert(player >= 1 && player <= PLAYER_NUM);
+		Bits const &bits = players[player - 1];
+		return has_line_along< 1 >(bits) || has_line_along< Stride >(bits)
+		    || has_line_along< Stride + 1 >(bits) || has_line_along< Stride - 1 >(bits);
+	}
+
+	std::array< Bits, PLAYER_NUM > players; //players[p - 1] holds player p's pieces
+
+private:
+	//does 'bits' have NUM_PIECE_TO_WIN cells in a line, stepping by D?
+	// (after the step covering 'Length' cells, bit i of 'run' is set if those cells starting at i are all set)
+	template< int D, int Length = 1 >
+	static bool has_line_along(Bits const &run) {
+		if constexpr (Length >= NUM_PIECE_TO_WIN) {
+			return run.any();
+		} else {
+			constexpr int Step = std::min(Length, NUM_PIECE_TO_WIN - Length);
+			Bits next = run;
+			next &= run.template shifted< D * Step >();
+			return has_line_along< D, Length + Step >(next);
+		}
+	}
+};
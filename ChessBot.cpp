@@ -0,0 +1,719 @@
+#include "ChessBot.hpp"
+
+#include "LineRuns.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int Width = ChessBoard::Width;
+constexpr uint16_t NoMove = 0xffff;
+constexpr int MaxDepth = 64;
+
+//Scores for every player (each in [0,1], summing to 1) -- the max-n "value" of a position:
+typedef std::array< float, PLAYER_NUM > Values;
+
+int next_player(int player) { return player % PLAYER_NUM + 1; }
+
+Values win_for(int player) {
+	Values ret;
+	ret.fill(0.0f);
+	ret[player - 1] = 1.0f;
+	return ret;
+}
+
+Values tie() {
+	Values ret;
+	ret.fill(1.0f / PLAYER_NUM);
+	return ret;
+}
+
+//Heuristic value of a position: each player's share of the weighted count of their (not yet winning) runs.
+Values evaluate(LineRuns const &runs) {
+	Values ret;
+	float total = 0.0f;
+	for (int p = 1; p <= PLAYER_NUM; ++p) {
+		float score = 1.0f;
+		float weight = 1.0f;
+		for (int length = 1; length < runs.win_length(); ++length) {
+			score += weight * float(runs.runs(p, length));
+			weight *= 6.0f;
+		}
+		ret[p - 1] = score;
+		total += score;
+	}
+	for (float &v : ret) v /= total;
+	return ret;
+}
+
+//Zobrist keys, one per (cell, player) and one per player to move:
+struct Zobrist {
+	Zobrist() {
+		std::mt19937_64 mt(0x15466f21);
+		for (auto &k : cells) k = mt();
+		for (auto &k : to_move) k = mt();
+	}
+	uint64_t cell(uint16_t cell, int player) const { return cells[size_t(cell) * PLAYER_NUM + (player - 1)]; }
+	std::array< uint64_t, Width * Width * PLAYER_NUM > cells;
+	std::array< uint64_t, PLAYER_NUM + 1 > to_move;
+};
+Zobrist const zobrist;
+
+//A board being searched (cells are numbered x * Width + y):
+struct Position {
+	explicit Position(LineRuns const &runs_, uint64_t key_) : runs(runs_), key(key_) { }
+	LineRuns runs;
+	uint64_t key; //of the pieces only (the player to move is mixed in when probing the table)
+
+	//returns the longest line through the new piece:
+	int place(uint16_t cell, int player) {
+		key ^= zobrist.cell(cell, player);
+		return runs.place(cell / Width, cell % Width, player);
+	}
+	void undo(uint16_t cell, int player) {
+		key ^= zobrist.cell(cell, player);
+		runs.undo();
+	}
+	bool empty(uint16_t cell) const { return runs.at(cell / Width, cell % Width) == 0; }
+
+	//empty cells next to at least one piece (or the center of an empty board):
+	void candidates(std::vector< uint16_t > *out) const {
+		out->clear();
+		if (runs.moves() == 0) {
+			out->emplace_back(uint16_t((Width / 2) * Width + Width / 2));
+			return;
+		}
+		for (int x = 0; x < Width; ++x) {
+			for (int y = 0; y < Width; ++y) {
+				if (runs.at(x, y) != 0) continue;
+				bool near = false;
+				for (int nx = std::max(0, x - 1); nx <= std::min(Width - 1, x + 1) && !near; ++nx) {
+					for (int ny = std::max(0, y - 1); ny <= std::min(Width - 1, y + 1); ++ny) {
+						if (runs.at(nx, ny) != 0) { near = true; break; }
+					}
+				}
+				if (near) out->emplace_back(uint16_t(x * Width + y));
+			}
+		}
+	}
+
+	//order moves for 'player': likely-best first (table move, then the longest lines made or blocked):
+	void order(std::vector< uint16_t > *moves, int player, uint16_t first) {
+		std::vector< std::pair< int, uint16_t > > scored;
+		scored.reserve(moves->size());
+		for (uint16_t cell : *moves) {
+			int score = 0;
+			if (cell == first) {
+				score = 1 << 20;
+			} else {
+				for (int p = 1; p <= PLAYER_NUM; ++p) {
+					int longest = runs.place(cell / Width, cell % Width, p);
+					runs.undo();
+					//completing own line beats blocking one, which beats everything else:
+					if (longest >= runs.win_length()) score += (p == player ? 1 << 18 : 1 << 16);
+					else score += (p == player ? 3 : 2) * longest * longest;
+				}
+			}
+			scored.emplace_back(-score, cell);
+		}
+		std::stable_sort(scored.begin(), scored.end(), [](auto const &a, auto const &b){ return a.first < b.first; });
+		for (size_t i = 0; i < scored.size(); ++i) (*moves)[i] = scored[i].second;
+	}
+};
+
+//Empty cells of 'board' next to at least one piece (or the center of an empty board):
+void board_candidates(ChessBoard const &board, std::vector< uint16_t > *out) {
+	out->clear();
+	bool any = false;
+	for (int x = 0; x < Width; ++x) {
+		for (int y = 0; y < Width; ++y) {
+			if (board.at(x, y) != 0) { any = true; continue; }
+			bool near = false;
+			for (int nx = std::max(0, x - 1); nx <= std::min(Width - 1, x + 1) && !near; ++nx) {
+				for (int ny = std::max(0, y - 1); ny <= std::min(Width - 1, y + 1); ++ny) {
+					if (board.at(nx, ny) != 0) { near = true; break; }
+				}
+			}
+			if (near) out->emplace_back(uint16_t(x * Width + y));
+		}
+	}
+	if (!any) out->emplace_back(uint16_t((Width / 2) * Width + Width / 2));
+}
+
+//Small, fast random number generator for playouts (xorshift64*):
+struct PlayoutRng {
+	explicit PlayoutRng(uint64_t seed) : state(seed | 1) { }
+	uint64_t state;
+	uint32_t next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return uint32_t((state * 0x2545F4914F6CDD1DULL) >> 32);
+	}
+	//uniform in [0, range):
+	uint32_t below(uint32_t range) { return uint32_t((uint64_t(next()) * range) >> 32); }
+};
+
+//Play random moves from 'board' (starting with 'to_move') until someone makes a line or the board fills.
+// 'empty' lists the board's empty cells (it is shuffled in place). returns the winner, or 0 for a tie:
+int random_playout(ChessBoard board, int to_move, std::vector< uint16_t > &empty, PlayoutRng &rng) {
+	uint32_t count = uint32_t(empty.size());
+	for (uint32_t i = 0; i < count; ++i) {
+		std::swap(empty[i], empty[i + rng.below(count - i)]);
+		uint16_t cell = empty[i];
+		board.players[to_move - 1].set(ChessBoard::index(cell / Width, cell % Width));
+		if (board.has_line(to_move)) return to_move;
+		to_move = next_player(to_move);
+	}
+	return 0;
+}
+
+//Nodes visited by this thread since the last deadline check:
+thread_local uint32_t nodes_since_check = 0;
+
+} //end anonymous namespace
+
+//---------------------------------------------
+//Transposition table: remembers the best move found at each position (used for move ordering).
+// Entries are two relaxed atomics, with the key stored xor'd with the data, so a torn
+// write from two threads just fails the key check instead of returning a bogus move.
+
+struct ChessBot::Table {
+	explicit Table(uint32_t bits) : entries(size_t(1) << bits), mask((uint64_t(1) << bits) - 1) { }
+
+	struct Entry {
+		std::atomic< uint64_t > check{0}; //key ^ data
+		std::atomic< uint64_t > data{0}; //move | depth << 16
+	};
+	std::vector< Entry > entries;
+	uint64_t mask;
+
+	uint16_t probe(uint64_t key) const {
+		Entry const &e = entries[key & mask];
+		uint64_t data = e.data.load(std::memory_order_relaxed);
+		uint64_t check = e.check.load(std::memory_order_relaxed);
+		if ((check ^ data) != key) return NoMove;
+		return uint16_t(data & 0xffff);
+	}
+	void store(uint64_t key, uint16_t move, int depth) {
+		Entry &e = entries[key & mask];
+		uint64_t old = e.data.load(std::memory_order_relaxed);
+		//keep a deeper result for the same position:
+		if ((e.check.load(std::memory_order_relaxed) ^ old) == key && int(old >> 16) > depth) return;
+		uint64_t data = uint64_t(move) | (uint64_t(depth) << 16);
+		e.data.store(data, std::memory_order_relaxed);
+		e.check.store(key ^ data, std::memory_order_relaxed);
+	}
+};
+
+//---------------------------------------------
+//Worker threads with one task queue each. Workers take their own newest task first
+// and, when out of work, steal the oldest task from another worker's queue.
+
+struct ChessBot::Pool {
+	explicit Pool(size_t count) {
+		for (size_t i = 0; i < count; ++i) queues.emplace_back(std::make_unique< Queue >());
+		for (size_t i = 0; i < count; ++i) workers.emplace_back(&Pool::run, this, i);
+	}
+	~Pool() {
+		{
+			std::lock_guard< std::mutex > lock(sleep_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto &w : workers) w.join();
+	}
+
+	void submit(std::function< void() > &&task) {
+		//tasks queued by a worker go on its own queue; others are spread around:
+		size_t index = (current == this ? current_index : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size());
+		{
+			std::lock_guard< std::mutex > lock(queues[index]->mutex);
+			queues[index]->tasks.emplace_back(std::move(task));
+		}
+		queued.fetch_add(1, std::memory_order_release);
+		{
+			std::lock_guard< std::mutex > lock(sleep_mutex);
+		}
+		wake.notify_one();
+	}
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque< std::function< void() > > tasks;
+	};
+	std::vector< std::unique_ptr< Queue > > queues;
+	std::vector< std::thread > workers;
+	std::atomic< size_t > queued{0}; //tasks in all queues
+	std::atomic< size_t > next_queue{0};
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	static thread_local Pool *current;
+	static thread_local size_t current_index;
+
+	bool take(size_t self, std::function< void() > *task) {
+		for (size_t i = 0; i < queues.size(); ++i) {
+			Queue &q = *queues[(self + i) % queues.size()];
+			std::lock_guard< std::mutex > lock(q.mutex);
+			if (q.tasks.empty()) continue;
+			if (i == 0) {
+				*task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			} else {
+				*task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+			queued.fetch_sub(1, std::memory_order_acq_rel);
+			return true;
+		}
+		return false;
+	}
+
+	void run(size_t index) {
+		current = this;
+		current_index = index;
+		std::function< void() > task;
+		while (true) {
+			if (take(index, &task)) {
+				task();
+				task = nullptr;
+				continue;
+			}
+			std::unique_lock< std::mutex > lock(sleep_mutex);
+			wake.wait(lock, [this](){ return stopping || queued.load(std::memory_order_acquire) != 0; });
+			if (stopping && queued.load(std::memory_order_acquire) == 0) return;
+		}
+	}
+};
+
+thread_local ChessBot::Pool *ChessBot::Pool::current = nullptr;
+thread_local size_t ChessBot::Pool::current_index = 0;
+
+//---------------------------------------------
+//State of one move decision:
+
+struct ChessBot::Job : ChessBot::Search {
+	Job() : root(Width) { }
+
+	LineRuns root;
+	uint64_t key = 0;
+	int player = 0;
+	std::chrono::steady_clock::time_point deadline;
+
+	struct RootMove {
+		uint16_t cell;
+		float value; //for 'player', from the last iteration that searched this move
+	};
+	std::vector< RootMove > moves; //in search order (best first, after the first iteration)
+
+	std::atomic< size_t > remaining{0}; //root moves left in this iteration
+	std::atomic< bool > aborted{false}; //this iteration ran out of time
+	std::atomic< float > best{0.0f}; //best root value so far in this iteration (bound for shallow pruning)
+	std::atomic< uint64_t > node_count{0};
+
+	bool out_of_time() const {
+		return cancelled.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= deadline;
+	}
+	void raise_best(float value) {
+		float current = best.load(std::memory_order_relaxed);
+		while (value > current && !best.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+	}
+
+	//max-n search with shallow pruning:
+	// 'bound' is the parent mover's best value so far; once 'mover' can guarantee
+	// themselves 1 - bound, the parent mover can't do better here and the rest is skipped.
+	Values search(Table &table, Position &pos, int depth, int mover, float bound, uint64_t *nodes) {
+		*nodes += 1;
+		if (++nodes_since_check >= 128) {
+			nodes_since_check = 0;
+			if (out_of_time()) aborted.store(true, std::memory_order_relaxed);
+		}
+		if (aborted.load(std::memory_order_relaxed)) return tie();
+
+		std::vector< uint16_t > moves;
+		pos.candidates(&moves);
+		if (moves.empty()) return tie(); //board full
+
+		uint64_t table_key = pos.key ^ zobrist.to_move[mover];
+		uint16_t first = table.probe(table_key);
+		if (depth >= 2) {
+			pos.order(&moves, mover, first);
+		} else if (first != NoMove) {
+			auto f = std::find(moves.begin(), moves.end(), first);
+			if (f != moves.end()) std::swap(*f, moves.front());
+		}
+
+		Values best_values;
+		best_values.fill(0.0f);
+		best_values[mover - 1] = -1.0f;
+		uint16_t best_move = NoMove;
+		for (uint16_t cell : moves) {
+			Values values;
+			if (pos.place(cell, mover) >= pos.runs.win_length()) {
+				values = win_for(mover);
+			} else if (depth <= 1) {
+				values = evaluate(pos.runs);
+			} else {
+				values = search(table, pos, depth - 1, next_player(mover), std::max(0.0f, best_values[mover - 1]), nodes);
+			}
+			pos.undo(cell, mover);
+
+			if (values[mover - 1] > best_values[mover - 1]) {
+				best_values = values;
+				best_move = cell;
+			}
+			if (1.0f - best_values[mover - 1] <= bound) break;
+		}
+		if (!aborted.load(std::memory_order_relaxed)) table.store(table_key, best_move, depth);
+		return best_values;
+	}
+};
+
+//---------------------------------------------
+
+ChessBot::ChessBot(size_t threads, uint32_t table_bits) : table(std::make_unique< Table >(table_bits)), pool(std::make_unique< Pool >(std::max< size_t >(1, threads))) {
+}
+
+ChessBot::~ChessBot() {
+}
+
+size_t ChessBot::threads() const {
+	return pool->workers.size();
+}
+
+std::shared_ptr< ChessBot::Search > ChessBot::think(ChessBoard const &board, int player, double budget, Method method) {
+	assert(player >= 1 && player <= PLAYER_NUM);
+	if (method == MonteCarlo) return think_monte_carlo(board, player, budget);
+
+	auto job = std::make_shared< Job >();
+	job->player = player;
+	job->deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(budget));
+	for (int x = 0; x < Width; ++x) {
+		for (int y = 0; y < Width; ++y) {
+			int p = board.at(x, y);
+			if (p == 0) continue;
+			job->root.place(x, y, p);
+			job->key ^= zobrist.cell(uint16_t(x * Width + y), p);
+		}
+	}
+
+	Position pos(job->root, job->key);
+	std::vector< uint16_t > moves;
+	pos.candidates(&moves);
+	pos.order(&moves, player, table->probe(job->key ^ zobrist.to_move[player]));
+	for (uint16_t cell : moves) job->moves.emplace_back(Job::RootMove{cell, 0.0f});
+
+	if (moves.size() <= 1) {
+		//nothing to think about:
+		if (!moves.empty()) {
+			job->x = moves[0] / Width;
+			job->y = moves[0] % Width;
+		}
+		job->finished.store(true, std::memory_order_release);
+	} else {
+		start_iteration(job, 1);
+	}
+	return job;
+}
+
+void ChessBot::start_iteration(std::shared_ptr< Job > const &job, int depth) {
+	job->remaining.store(job->moves.size(), std::memory_order_relaxed);
+	job->aborted.store(false, std::memory_order_relaxed);
+	job->best.store(0.0f, std::memory_order_relaxed);
+	for (size_t i = 0; i < job->moves.size(); ++i) {
+		pool->submit([this, job, i, depth](){ search_root_move(job, i, depth); });
+	}
+}
+
+void ChessBot::search_root_move(std::shared_ptr< Job > const &job, size_t index, int depth) {
+	//(the first iteration always finishes, so there is always a move to make)
+	if (depth > 1 && job->out_of_time()) job->aborted.store(true, std::memory_order_relaxed);
+
+	if (!job->aborted.load(std::memory_order_relaxed)) {
+		uint16_t cell = job->moves[index].cell;
+		Position pos(job->root, job->key);
+		uint64_t nodes = 1;
+		Values values;
+		if (pos.place(cell, job->player) >= pos.runs.win_length()) {
+			values = win_for(job->player);
+		} else if (depth <= 1) {
+			values = evaluate(pos.runs);
+		} else {
+			float bound = job->best.load(std::memory_order_relaxed);
+			values = job->search(*table, pos, depth - 1, next_player(job->player), bound, &nodes);
+		}
+		job->moves[index].value = values[job->player - 1];
+		job->raise_best(values[job->player - 1]);
+		job->node_count.fetch_add(nodes, std::memory_order_relaxed);
+	}
+
+	if (job->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		finish_iteration(job, depth);
+	}
+}
+
+void ChessBot::finish_iteration(std::shared_ptr< Job > const &job, int depth) {
+	bool complete = !job->aborted.load(std::memory_order_relaxed);
+	float best_value = 0.0f;
+	if (complete) {
+		//best move first for the next iteration (ties keep the previous order):
+		std::stable_sort(job->moves.begin(), job->moves.end(), [](Job::RootMove const &a, Job::RootMove const &b){
+			return a.value > b.value;
+		});
+		best_value = job->moves[0].value;
+		job->x = job->moves[0].cell / Width;
+		job->y = job->moves[0].cell % Width;
+		job->depth = depth;
+		table->store(job->key ^ zobrist.to_move[job->player], job->moves[0].cell, depth);
+	}
+	job->nodes = job->node_count.load(std::memory_order_relaxed);
+
+	int empty = Width * Width - int(job->root.moves());
+	if (complete && best_value < 1.0f && depth < std::min(empty, MaxDepth) && !job->out_of_time()) {
+		start_iteration(job, depth + 1);
+	} else {
+		job->finished.store(true, std::memory_order_release);
+	}
+}
+
+//---------------------------------------------
+//Monte Carlo tree search:
+
+struct ChessBot::Tree : ChessBot::Search {
+	explicit Tree(uint32_t capacity_) : arena(new Node[capacity_]), capacity(capacity_) { }
+
+	static constexpr uint32_t Expanding = 0xffffffff; //Node::children while a thread is adding them
+	static constexpr uint8_t Tie = 0xff; //Node::result for a move that fills the board
+
+	struct Node {
+		std::atomic< uint32_t > visits{0}; //playouts through this node (added before they finish)
+		std::atomic< uint32_t > reward{0}; //PLAYER_NUM per playout won by 'player', 1 per tie
+		std::atomic< uint32_t > children{0}; //index of first child, 0 if not expanded yet (or Expanding)
+		uint16_t child_count = 0;
+		uint16_t cell = 0; //move that led here
+		uint8_t player = 0; //who made that move
+		uint8_t result = 0; //if that move ended the game: the winner, or Tie
+	};
+	std::unique_ptr< Node[] > arena; //arena[0] is the root
+	uint32_t capacity;
+	std::atomic< uint32_t > used{1};
+	std::atomic< bool > full{false}; //no room left to expand nodes
+
+	ChessBoard root;
+	int player = 0; //to move at the root
+	float exploration = 1.0f;
+	uint32_t batch = 1;
+	std::chrono::steady_clock::time_point deadline;
+
+	std::atomic< size_t > running{0}; //workers still growing the tree
+	std::atomic< uint64_t > playout_count{0};
+
+	bool out_of_time() const {
+		return cancelled.load(std::memory_order_relaxed) || std::chrono::steady_clock::now() >= deadline;
+	}
+
+	//add children for every candidate move at node 'index' (position 'board'); returns false if another
+	// thread got there first or the tree is full:
+	bool expand(uint32_t index, ChessBoard const &board, std::vector< uint16_t > *moves) {
+		Node &node = arena[index];
+		uint32_t expected = 0;
+		if (full.load(std::memory_order_relaxed)) return false;
+		if (!node.children.compare_exchange_strong(expected, Expanding, std::memory_order_acquire)) return false;
+
+		board_candidates(board, moves);
+		uint32_t first = used.fetch_add(uint32_t(moves->size()), std::memory_order_relaxed);
+		if (moves->empty() || first + moves->size() > capacity) {
+			if (!moves->empty()) full.store(true, std::memory_order_relaxed);
+			node.children.store(0, std::memory_order_release);
+			return false;
+		}
+
+		int mover = (index == 0 ? player : next_player(node.player));
+		for (size_t i = 0; i < moves->size(); ++i) {
+			Node &child = arena[first + i];
+			uint16_t cell = (*moves)[i];
+			child.cell = cell;
+			child.player = uint8_t(mover);
+			ChessBoard after = board;
+			after.set(cell / Width, cell % Width, mover);
+			if (after.has_line(mover)) child.result = uint8_t(mover);
+			else if (board_full(after)) child.result = Tie;
+		}
+		node.child_count = uint16_t(moves->size());
+		node.children.store(first, std::memory_order_release);
+		return true;
+	}
+
+	static bool board_full(ChessBoard const &board) {
+		for (int x = 0; x < Width; ++x) {
+			for (int y = 0; y < Width; ++y) {
+				if (board.at(x, y) == 0) return false;
+			}
+		}
+		return true;
+	}
+
+	//UCT choice among the children of 'node':
+	uint32_t select(Node const &node, uint32_t first) const {
+		float log_visits = std::log(float(std::max< uint32_t >(1, node.visits.load(std::memory_order_relaxed))));
+		uint32_t best = first;
+		float best_score = -1.0f;
+		for (uint32_t i = first; i < first + node.child_count; ++i) {
+			Node const &child = arena[i];
+			uint32_t visits = child.visits.load(std::memory_order_relaxed);
+			if (visits == 0) return i; //try everything once
+			float mean = float(child.reward.load(std::memory_order_relaxed)) / (float(visits) * PLAYER_NUM);
+			float score = mean + exploration * std::sqrt(log_visits / float(visits));
+			if (score > best_score) {
+				best_score = score;
+				best = i;
+			}
+		}
+		return best;
+	}
+};
+
+std::shared_ptr< ChessBot::Search > ChessBot::think_monte_carlo(ChessBoard const &board, int player, double budget) {
+	auto tree = std::make_shared< Tree >(std::max< uint32_t >(2, tree_nodes));
+	tree->root = board;
+	tree->player = player;
+	tree->exploration = exploration;
+	tree->batch = std::max< uint32_t >(1, playout_batch);
+	tree->deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(budget));
+	tree->arena[0].player = uint8_t((player + PLAYER_NUM - 2) % PLAYER_NUM + 1); //(the root is the previous player's move)
+
+	std::vector< uint16_t > moves;
+	board_candidates(board, &moves);
+	if (moves.size() <= 1) {
+		//nothing to think about:
+		if (!moves.empty()) {
+			tree->x = moves[0] / Width;
+			tree->y = moves[0] % Width;
+		}
+		tree->finished.store(true, std::memory_order_release);
+		return tree;
+	}
+
+	//every worker grows the tree until time runs out:
+	size_t workers = threads();
+	tree->running.store(workers, std::memory_order_relaxed);
+	static std::atomic< uint64_t > seed{0x15466};
+	for (size_t i = 0; i < workers; ++i) {
+		uint64_t s = seed.fetch_add(0x9E3779B97F4A7C15ULL, std::memory_order_relaxed);
+		pool->submit([this, tree, s](){ grow_tree(tree, s); });
+	}
+	return tree;
+}
+
+void ChessBot::grow_tree(std::shared_ptr< Tree > const &tree, uint64_t seed) {
+	PlayoutRng rng(seed);
+	std::vector< uint32_t > path;
+	std::vector< uint16_t > moves;
+	std::vector< uint16_t > empty;
+	std::array< uint32_t, PLAYER_NUM > rewards;
+	uint32_t const batch = tree->batch;
+	uint64_t playouts = 0;
+
+	while (!tree->out_of_time()) {
+		//walk down to a leaf, counting this batch's visits on the way (so other threads look elsewhere):
+		ChessBoard board = tree->root;
+		path.clear();
+		uint32_t index = 0;
+		tree->arena[0].visits.fetch_add(batch, std::memory_order_relaxed);
+		while (true) {
+			Tree::Node &node = tree->arena[index];
+			if (node.result != 0) break;
+			uint32_t first = node.children.load(std::memory_order_acquire);
+			if (first == 0) {
+				//expand leaves once they have been played out from (the root right away):
+				bool seen = (index == 0 || node.visits.load(std::memory_order_relaxed) > batch);
+				if (!seen || !tree->expand(index, board, &moves)) break;
+				first = node.children.load(std::memory_order_acquire);
+			}
+			if (first == Tree::Expanding) break;
+			index = tree->select(node, first);
+			Tree::Node &child = tree->arena[index];
+			child.visits.fetch_add(batch, std::memory_order_relaxed);
+			board.set(child.cell / Width, child.cell % Width, child.player);
+			path.emplace_back(index);
+		}
+
+		//score the leaf:
+		Tree::Node const &leaf = tree->arena[index];
+		rewards.fill(0);
+		if (leaf.result != 0) {
+			for (int p = 1; p <= PLAYER_NUM; ++p) {
+				if (leaf.result == Tree::Tie) rewards[p - 1] = batch;
+				else if (leaf.result == p) rewards[p - 1] = batch * PLAYER_NUM;
+			}
+		} else {
+			empty.clear();
+			for (int x = 0; x < Width; ++x) {
+				for (int y = 0; y < Width; ++y) {
+					if (board.at(x, y) == 0) empty.emplace_back(uint16_t(x * Width + y));
+				}
+			}
+			int to_move = next_player(leaf.player);
+			for (uint32_t b = 0; b < batch; ++b) {
+				int winner = random_playout(board, to_move, empty, rng);
+				for (int p = 1; p <= PLAYER_NUM; ++p) {
+					if (winner == 0) rewards[p - 1] += 1;
+					else if (winner == p) rewards[p - 1] += PLAYER_NUM;
+				}
+			}
+			playouts += batch;
+		}
+
+		//each node on the path is credited with how its mover did:
+		for (uint32_t i : path) {
+			Tree::Node &node = tree->arena[i];
+			node.reward.fetch_add(rewards[node.player - 1], std::memory_order_relaxed);
+		}
+	}
+
+	tree->playout_count.fetch_add(playouts, std::memory_order_relaxed);
+	if (tree->running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		finish_tree(tree);
+	}
+}
+
+void ChessBot::finish_tree(std::shared_ptr< Tree > const &tree) {
+	//play the most-visited move, and follow the most-visited line to see how deep the tree got:
+	int depth = 0;
+	uint32_t index = 0;
+	while (true) {
+		Tree::Node const &node = tree->arena[index];
+		uint32_t first = node.children.load(std::memory_order_acquire);
+		if (first == 0 || first == Tree::Expanding) break;
+		uint32_t best = first;
+		for (uint32_t i = first; i < first + node.child_count; ++i) {
+			if (tree->arena[i].visits.load(std::memory_order_relaxed) > tree->arena[best].visits.load(std::memory_order_relaxed)) best = i;
+		}
+		if (tree->arena[best].visits.load(std::memory_order_relaxed) == 0) break;
+		if (depth == 0) {
+			tree->x = tree->arena[best].cell / Width;
+			tree->y = tree->arena[best].cell % Width;
+		}
+		depth += 1;
+		index = best;
+	}
+	tree->depth = depth;
+	tree->nodes = std::min< uint64_t >(tree->used.load(std::memory_order_relaxed), tree->capacity);
+	tree->playouts = tree->playout_count.load(std::memory_order_relaxed);
+	tree->finished.store(true, std::memory_order_release);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * ChessBot chooses moves for server-side bot players, with one of two methods:
+ *
+ * MaxN: iterative-deepening max-n search (every node scores all PLAYER_NUM
+ * players; the player to move maximizes their own score), with shallow
+ * pruning, move ordering, and a Zobrist-keyed transposition table shared by
+ * all searches. think() queues the root moves of the first iteration on a
+ * pool of worker threads (idle workers steal queued work from busy ones);
+ * each finished iteration queues the next until the time budget runs out.
+ *
+ * MonteCarlo: Monte Carlo tree search (UCT, with each node scored for the
+ * player who moved into it). Every pool thread grows the same tree without
+ * locks -- nodes live in a preallocated array, are claimed for expansion
+ * with a compare-and-swap, and carry atomic visit/reward counts (visits are
+ * added on the way down, so threads spread out over different branches).
+ * Each leaf gets a batch of random playouts on a ChessBoard copy, whose
+ * bitboard win check tests a whole board in a few word operations.
+ *
+ * Either way, searches never block the caller: think() returns a Search to poll.
+ */
+
+#include "ChessBoard.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct ChessBot {
+	//search with 'threads' worker threads and a transposition table of 2^table_bits entries:
+	ChessBot(size_t threads, uint32_t table_bits = 20);
+	~ChessBot();
+	ChessBot(ChessBot const &) = delete;
+	ChessBot &operator=(ChessBot const &) = delete;
+
+	enum Method : uint8_t {
+		MaxN,
+		MonteCarlo,
+	};
+
+	//one move decision in progress:
+	struct Search {
+		bool done() const { return finished.load(std::memory_order_acquire); }
+		//stop searching early (done() becomes true shortly after):
+		void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+		//chosen move, as board indices (valid once done(); -1 if there were no moves):
+		int x = -1;
+		int y = -1;
+		int depth = 0; //deepest iteration that completed (MonteCarlo: length of the most-visited line)
+		uint64_t nodes = 0; //positions visited (MonteCarlo: tree nodes)
+		uint64_t playouts = 0; //random games played (MonteCarlo only)
+
+	protected:
+		friend struct ChessBot;
+		std::atomic< bool > finished{false};
+		std::atomic< bool > cancelled{false};
+	};
+
+	//start choosing a move for 'player' on 'board', spending about 'budget' seconds:
+	// (the bot must outlive the returned search, or cancel it and wait for done())
+	std::shared_ptr< Search > think(ChessBoard const &board, int player, double budget, Method method = MaxN);
+
+	size_t threads() const;
+
+	//MonteCarlo settings (change only while no search is running):
+	uint32_t playout_batch = 8; //random games per leaf visit
+	float exploration = 1.0f; //UCT exploration constant
+	uint32_t tree_nodes = 1 << 18; //node capacity of each search tree (the tree stops growing when full)
+
+private:
+	struct Job;
+	struct Tree;
+	struct Table;
+	struct Pool;
+
+	void start_iteration(std::shared_ptr< Job > const &job, int depth);
+	void search_root_move(std::shared_ptr< Job > const &job, size_t index, int depth);
+	void finish_iteration(std::shared_ptr< Job > const &job, int depth);
+
+	std::shared_ptr< Search > think_monte_carlo(ChessBoard const &board, int player, double budget);
+	void grow_tree(std::shared_ptr< Tree > const &tree, uint64_t seed);
+	void finish_tree(std::shared_ptr< Tree > const &tree);
+
+	std::unique_ptr< Table > table;
+	std::unique_ptr< Pool > pool; //(declared last so workers stop before the table goes away)
+};
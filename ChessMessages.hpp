@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * Messages exchanged between client and server (framed with MessageCodec):
+ *
+ * client -> server:
+ *  'a' int8 x, int8 y -- place a piece at (x, y) (offsets from the board center)
+ *  'r' uint32 seq -- client missed a move (it has moves up to 'seq'); asks for a 'b' resync
+ *  'j' SeatMessage -- after reconnecting, take back the seat a 'k' was sent for (instead of a new one)
+ *  'w' WatchMessage -- watch a game as a spectator (instead of playing)
+ *
+ * server -> client:
+ *  'b' BoardSnapshotHeader + packed board -- full board; sent on join and on request
+ *  'd' MoveDeltaMessage -- one accepted move; sent once per move (never repeated)
+ *  's' StateMessage -- fixed-size game state; sent only when it changes
+ *  'n' text -- the recipient's player name; sent once, on join
+ *  't' text -- status line for the recipient; sent only when it changes
+ *  'k' SeatMessage -- key to the recipient's seat; sent once, on join
+ *
+ * Spectators get 'b', 'd', 's' (with player_id 0), 't', and 'n' like players do, but
+ * may have updates skipped (and then a fresh 'b') if they fall behind.
+ *
+ * Multi-byte fields are native-endian (as with read_write_chunk.hpp).
+ */
+
+#include "ChessBoardData.hpp"
+#include "ChessBoard.hpp"
+
+#include <cstdint>
+#include <cstddef>
+
+enum : uint8_t {
+	MessageMove = 'a',
+	MessageResync = 'r',
+	MessageRejoin = 'j',
+	MessageWatch = 'w',
+	MessageBoard = 'b',
+	MessageMoveDelta = 'd',
+	MessageState = 's',
+	MessageName = 'n',
+	MessageStatus = 't',
+	MessageSeat = 'k',
+};
+
+struct StateMessage {
+	uint8_t current_player = 0; //player whose turn it is (0 = nobody's)
+	uint8_t game_state = 0; //0: waiting for players, 1: playing, 2: game over
+	uint8_t player_id = 0; //the recipient's own player number
+
+	bool operator==(StateMessage const &o) const {
+		return current_player == o.current_player && game_state == o.game_state && player_id == o.player_id;
+	}
+	bool operator!=(StateMessage const &o) const { return !(*this == o); }
+};
+static_assert(sizeof(StateMessage) == 3, "StateMessage is sent as raw bytes, so must be packed");
+
+struct MoveDeltaMessage {
+	uint32_t seq = 0; //moves are numbered from 1; a client that sees a jump has missed one
+	int8_t x = 0; //offsets from the board center
+	int8_t y = 0;
+	uint8_t player = 0; //player who moved
+	uint8_t reserved = 0;
+};
+static_assert(sizeof(MoveDeltaMessage) == 8, "MoveDeltaMessage is sent as raw bytes, so must be packed");
+
+struct SeatMessage {
+	uint32_t room = 0;
+	uint32_t seat = 0; //player number
+	uint64_t token = 0; //secret that proves the seat is yours
+};
+static_assert(sizeof(SeatMessage) == 16, "SeatMessage is sent as raw bytes, so must be packed");
+
+struct WatchMessage {
+	uint32_t room = 0; //0: whichever game the server is featuring
+};
+static_assert(sizeof(WatchMessage) == 4, "WatchMessage is sent as raw bytes, so must be packed");
+
+//'b' payload is this header followed by PackedBoardBytes of cells:
+struct BoardSnapshotHeader {
+	uint32_t seq = 0; //number of moves included in the snapshot
+	uint8_t width = 0; //must match BoardWidth
+	uint8_t reserved[3] = {0, 0, 0};
+};
+static_assert(sizeof(BoardSnapshotHeader) == 8, "BoardSnapshotHeader is sent as raw bytes, so must be packed");
+
+constexpr size_t BoardWidth = ChessBoard::Width;
+//cells are packed two bits each (enough for player numbers 0 .. 3), in board[x][y] order:
+constexpr size_t PackedBoardBytes = (BoardWidth * BoardWidth * 2 + 7) / 8;
+static_assert(PLAYER_NUM <= 3, "packed board format stores player numbers in two bits");
+
+inline void pack_board(ChessBoard const &board, uint8_t out[PackedBoardBytes]) {
+	for (size_t i = 0; i < PackedBoardBytes; ++i) out[i] = 0;
+	for (size_t x = 0; x < BoardWidth; ++x) {
+		for (size_t y = 0; y < BoardWidth; ++y) {
+			size_t i = x * BoardWidth + y;
+			out[i / 4] |= uint8_t((board.at(int(x), int(y)) & 3) << (2 * (i % 4)));
+		}
+	}
+}
+
+//(cells holding a player number above PLAYER_NUM are left empty)
+inline void unpack_board(uint8_t const in[PackedBoardBytes], ChessBoard *board_) {
+	auto &board = *board_;
+	board.clear();
+	for (size_t x = 0; x < BoardWidth; ++x) {
+		for (size_t y = 0; y < BoardWidth; ++y) {
+			size_t i = x * BoardWidth + y;
+			int player = (in[i / 4] >> (2 * (i % 4))) & 3;
+			if (player <= PLAYER_NUM) board.set(int(x), int(y), player);
+		}
+	}
+}
@@ -0,0 +1,463 @@
+#include "ChessRoom.hpp"
+
+#include "Log.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+ChessRoom::ChessRoom(uint32_t id_, BotSettings const &bot_settings_, ReplayLog *replay_log_, RoomStore *store_) : id(id_), bot_settings(bot_settings_), replay_log(replay_log_), store(store_) {
+	remaining_pos = ChessBoard::Width * ChessBoard::Width;
+	waiting_since = std::chrono::steady_clock::now();
+
+	replay_game.width = uint8_t(ChessBoard::Width);
+	replay_game.win_length = uint8_t(NUM_PIECE_TO_WIN);
+	replay_game.players = uint8_t(PLAYER_NUM);
+	replay_game.room = id;
+}
+
+ChessRoom::~ChessRoom() {
+	//don't spend bot time on a game nobody is watching:
+	for (auto &bot : bot_players) {
+		if (bot.search) bot.search->cancel();
+	}
+
+	//keep a record of games abandoned partway through:
+	if (replay_log && game_state == 1) replay_log->append(replay_game, replay_moves);
+
+	if (store) {
+		RoomStore::Entry entry;
+		entry.room = id;
+		entry.kind = RoomStore::EntryClose;
+		store->log(entry);
+	}
+}
+
+bool ChessRoom::seat_taken(uint32_t seat) const {
+	for (auto const &[other, player] : players) {
+		(void)other;
+		if (player.id == seat) return true;
+	}
+	for (auto const &bot : bot_players) {
+		if (bot.id == seat) return true;
+	}
+	return false;
+}
+
+bool ChessRoom::join(Connection *c) {
+	if (players.size() + bot_players.size() >= PLAYER_NUM) return false;
+
+	//take the lowest free seat:
+	uint32_t seat = 1;
+	while (seat_taken(seat)) seat += 1;
+	if (players.empty()) waiting_since = std::chrono::steady_clock::now();
+
+	//give them a key to the seat, so they can get it back if they lose their connection:
+	static thread_local std::mt19937_64 mt(std::random_device{}());
+	uint64_t token = 0;
+	while (token == 0) token = mt();
+	seat_tokens[seat - 1] = token;
+	if (store) {
+		RoomStore::Entry entry;
+		entry.room = id;
+		entry.kind = RoomStore::EntrySeat;
+		entry.seat = uint8_t(seat);
+		entry.value = token;
+		store->log(entry);
+	}
+	SeatMessage key;
+	key.room = id;
+	key.seat = seat;
+	key.token = token;
+	send_message(*c, MessageSeat, &key, sizeof(key));
+
+	seat_player(c, seat);
+
+	// Start the game when all players are ready
+	if (players.size() + bot_players.size() >= PLAYER_NUM && game_state == 0) {
+		start_game();
+	}
+	return true;
+}
+
+bool ChessRoom::rejoin(Connection *c, uint32_t seat, uint64_t token) {
+	if (seat < 1 || seat > PLAYER_NUM || token == 0 || seat_tokens[seat - 1] != token) return false;
+	for (auto const &[other, player] : players) {
+		(void)other;
+		if (player.id == seat) return false;
+	}
+	//take the seat back from a bot:
+	for (auto bot = bot_players.begin(); bot != bot_players.end(); ++bot) {
+		if (bot->id != seat) continue;
+		if (bot->search) bot->search->cancel();
+		bot_players.erase(bot);
+		LOG(Info, "Room " << id << ": player rejoins seat " << seat << " (bot leaves).");
+		break;
+	}
+	seat_player(c, seat);
+	return true;
+}
+
+void ChessRoom::seat_player(Connection *c, uint32_t seat) {
+	//create some player info for them:
+	PlayerInfo &player = players[c];
+	player.id = seat;
+	player.name = "Player" + std::to_string(seat);
+
+	//bring them up to date with the board:
+	send_board(c);
+}
+
+void ChessRoom::start_game() {
+	game_state = 1;
+	if (store) {
+		RoomStore::Entry entry;
+		entry.room = id;
+		entry.kind = RoomStore::EntryStart;
+		store->log(entry);
+	}
+}
+
+void ChessRoom::leave(Connection *c) {
+	auto f = players.find(c);
+	assert(f != players.end());
+	players.erase(f);
+}
+
+void ChessRoom::watch(Connection *c) {
+	Spectator spectator;
+	spectator.connection = c;
+	spectators.emplace_back(spectator);
+
+	//bring them up to date (broadcast() sends them anything that changes after this):
+	c->send_shared(spectator_board_block());
+	std::string name = "Spectator";
+	send_message(*c, MessageName, name.data(), name.size());
+	if (spectator_update) c->send_replaceable(spectator_update, MessageState);
+}
+
+void ChessRoom::unwatch(Connection *c) {
+	for (auto s = spectators.begin(); s != spectators.end(); ++s) {
+		if (s->connection != c) continue;
+		spectators.erase(s);
+		return;
+	}
+	assert(false && "unwatch() of a connection that isn't watching");
+}
+
+bool ChessRoom::handle_move(Connection *c, MessageView const &message) {
+	//look up in players list:
+	auto f = players.find(c);
+	assert(f != players.end());
+	PlayerInfo &player = f->second;
+
+	int8_t pos[2];
+	if (message.size != sizeof(pos)) {
+		LOG(Warn, "'a' message of unexpected size " << message.size << " received from client!");
+		return false;
+	}
+	message.read(0, &pos);
+	int8_t pos_x = pos[0];
+	int8_t pos_y = pos[1];
+	if (pos_x < -NUM_PIECES_PER_LINE_HALF || pos_x > NUM_PIECES_PER_LINE_HALF
+	 || pos_y < -NUM_PIECES_PER_LINE_HALF || pos_y > NUM_PIECES_PER_LINE_HALF) {
+		LOG(Debug, "Ignoring move outside of the board");
+		return true;
+	}
+
+	if (player.id == curr_player) {
+		place_piece(pos_x, pos_y);
+	}
+	return true;
+}
+
+bool ChessRoom::place_piece(int8_t pos_x, int8_t pos_y) {
+	if (game_state != 1) return false;
+	// Check valid
+	if (chess_board.empty(pos_x + NUM_PIECES_PER_LINE_HALF, pos_y + NUM_PIECES_PER_LINE_HALF)) {
+		chess_board.set(pos_x + NUM_PIECES_PER_LINE_HALF, pos_y + NUM_PIECES_PER_LINE_HALF, curr_player);
+		last_pos_x = pos_x;
+		last_pos_y = pos_y;
+		color_to_draw = curr_player;
+
+		//tell everyone about the move (encoded once, shared by all connections):
+		move_seq += 1;
+		MoveDeltaMessage delta;
+		delta.seq = move_seq;
+		delta.x = pos_x;
+		delta.y = pos_y;
+		delta.player = curr_player;
+		SharedBytes block = encode_message(MessageMoveDelta, &delta, sizeof(delta));
+		for (auto &[other, other_player] : players) {
+			(void)other_player;
+			other->send_shared(block);
+		}
+		for (auto const &spectator : spectators) {
+			if (!spectator.behind) spectator.connection->send_shared(block);
+		}
+		spectator_board.reset();
+
+		if (replay_moves.empty()) replay_game.started = int64_t(std::time(nullptr));
+		ReplayLog::Move move;
+		move.x = pos_x;
+		move.y = pos_y;
+		move.player = curr_player;
+		replay_moves.emplace_back(move);
+		if (store) {
+			RoomStore::Entry entry;
+			entry.room = id;
+			entry.kind = RoomStore::EntryMove;
+			entry.x = pos_x;
+			entry.y = pos_y;
+			entry.value = move_seq;
+			store->log(entry);
+		}
+
+		// Judge the move (only the player who just moved can have made a line):
+		remaining_pos = remaining_pos == 0 ? 0 : remaining_pos - 1;
+		if (chess_board.has_line(curr_player)) {
+			winner = curr_player;
+			game_over_message = "Player" + std::to_string(curr_player) + " wins!";
+		} else if (remaining_pos == 0) {
+			winner = ReplayLog::Tie;
+			game_over_message = "Game is a tie.";
+		}
+		if (winner != 0) {
+			game_state = 2;
+			curr_player = 0;
+			replay_moves.back().result = winner;
+			replay_game.result = winner;
+			if (replay_log) replay_log->append(replay_game, replay_moves);
+		} else {
+			curr_player = (curr_player + 1 - 1) % PLAYER_NUM + 1;
+		}
+		return true;
+	}
+	else
+	{
+		LOG(Debug, "This place already has a piece");
+		return false;
+	}
+}
+
+void ChessRoom::handle_resync(Connection *c) {
+	send_board(c);
+}
+
+void ChessRoom::update_bots() {
+	if (!bot_settings.bot) return;
+
+	//fill empty seats -- before the game, once humans have waited long enough; during it, right away:
+	bool fill = false;
+	if (game_state == 0 && !players.empty()) {
+		fill = std::chrono::steady_clock::now() - waiting_since >= std::chrono::duration< double >(bot_settings.wait);
+	} else if (game_state == 1) {
+		fill = true;
+	}
+	if (fill) {
+		for (uint32_t seat = 1; seat <= PLAYER_NUM; ++seat) {
+			if (seat_taken(seat)) continue;
+			BotPlayer bot;
+			bot.id = seat;
+			bot_players.emplace_back(bot);
+			LOG(Info, "Room " << id << ": bot takes seat " << seat << ".");
+		}
+		if (game_state == 0 && players.size() + bot_players.size() >= PLAYER_NUM) {
+			start_game();
+		}
+	}
+
+	if (game_state != 1) return;
+	for (auto &bot : bot_players) {
+		if (bot.id != curr_player) continue;
+		if (!bot.search) {
+			bot.search = bot_settings.bot->think(chess_board, int(bot.id), bot_settings.budget, bot_settings.method);
+		}
+		if (bot.search->done()) {
+			int x = bot.search->x, y = bot.search->y;
+			bot.search.reset();
+			if (x >= 0) place_piece(int8_t(x - NUM_PIECES_PER_LINE_HALF), int8_t(y - NUM_PIECES_PER_LINE_HALF));
+		}
+		break;
+	}
+}
+
+void ChessRoom::update() {
+	update_bots();
+
+	// Game state logic update (moves are judged as they are placed)
+	if (game_state == 0)
+		curr_player = 0;
+	else if (game_state == 1 && curr_player == 0)
+		curr_player = 1;
+	else if (game_state == 2)
+		curr_player = 0;
+}
+
+void ChessRoom::broadcast() {
+	//send updated game state to clients (only the parts that changed since their last update):
+	StateMessage state;
+	state.current_player = curr_player;
+	state.game_state = game_state;
+	for (auto &[c, player] : players) {
+		//(state and status go out as replaceable blocks, so a backed-up send queue only needs the newest of each;
+		// if the connection had to drop the newest, send them again)
+		if (c->updates_dropped) {
+			c->updates_dropped = false;
+			player.sent_status = 0xffff;
+			player.sent_any_state = false;
+		}
+		if (!player.sent_name) {
+			send_message(*c, MessageName, player.name.data(), player.name.size());
+			player.sent_name = true;
+		}
+
+		//status line -- only rebuilt when the situation it describes changes:
+		enum : uint8_t { StatusNone, StatusWaiting, StatusYourTurn, StatusDeciding, StatusGameOver };
+		uint8_t status = StatusNone;
+		if (curr_player == 0 && game_state == 0) status = StatusWaiting;
+		else if (player.id == curr_player) status = StatusYourTurn;
+		else if (game_state == 1) status = StatusDeciding;
+		else if (game_state == 2) status = StatusGameOver;
+		uint16_t status_key = uint16_t((status << 8) | curr_player);
+		if (status_key != player.sent_status) {
+			std::string text;
+			if (status == StatusWaiting) text = "Waiting for other players to join . . .";
+			else if (status == StatusYourTurn) text = "It's your turn.";
+			else if (status == StatusDeciding) text = "Player" + std::to_string(curr_player) + " is deciding . . .";
+			else if (status == StatusGameOver) text = game_over_message;
+			c->send_replaceable(encode_message(MessageStatus, text.data(), text.size()), MessageStatus);
+			player.sent_status = status_key;
+		}
+
+		state.player_id = uint8_t(player.id);
+		if (!player.sent_any_state || state != player.sent_state) {
+			c->send_replaceable(encode_message(MessageState, &state, sizeof(state)), MessageState);
+			player.sent_state = state;
+			player.sent_any_state = true;
+		}
+	}
+
+	if (!spectators.empty()) broadcast_spectators();
+}
+
+void ChessRoom::broadcast_spectators() {
+	//spectators all see the same thing, so their update is built once and shared:
+	uint32_t key = uint32_t((game_state << 16) | (curr_player << 8) | winner);
+	bool changed = (!spectator_update || key != spectator_update_key);
+	if (changed) {
+		StateMessage state;
+		state.current_player = curr_player;
+		state.game_state = game_state;
+		state.player_id = 0;
+		std::string text;
+		if (game_state == 0) text = "Waiting for players to join . . .";
+		else if (game_state == 1) text = "Player" + std::to_string(curr_player) + " is deciding . . .";
+		else text = game_over_message;
+		auto block = std::make_shared< std::vector< char > >();
+		append_message(block.get(), MessageState, &state, sizeof(state));
+		append_message(block.get(), MessageStatus, text.data(), text.size());
+		spectator_update = block;
+		spectator_update_key = key;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	auto drop_after = std::chrono::duration< double >(spectator_limits.drop_after);
+	for (auto s = spectators.begin(); s != spectators.end(); /* later */) {
+		Connection *c = s->connection;
+		size_t queued = c->queued_bytes();
+
+		//hopelessly far behind -- let them go:
+		if (queued > spectator_limits.drop || (s->behind && now - s->behind_since > drop_after)) {
+			c->close();
+			dropped_spectators.emplace_back(c);
+			spectators_dropped += 1;
+			s = spectators.erase(s);
+			continue;
+		}
+
+		if (!s->behind && queued > spectator_limits.high) {
+			//falling behind -- skip updates until what's queued drains:
+			s->behind = true;
+			s->behind_since = now;
+			spectators_skipped += 1;
+		} else if (s->behind && queued < spectator_limits.low) {
+			//caught up -- the current board stands in for all of the skipped moves:
+			s->behind = false;
+			spectators_resynced += 1;
+			c->updates_dropped = false;
+			c->send_shared(spectator_board_block());
+			c->send_replaceable(spectator_update, MessageState);
+		} else if (!s->behind && (changed || c->updates_dropped)) {
+			c->updates_dropped = false;
+			c->send_replaceable(spectator_update, MessageState);
+		}
+		++s;
+	}
+}
+
+SharedBytes const &ChessRoom::spectator_board_block() {
+	if (!spectator_board) {
+		BoardSnapshotHeader header;
+		header.seq = move_seq;
+		header.width = uint8_t(BoardWidth);
+		uint8_t payload[sizeof(BoardSnapshotHeader) + PackedBoardBytes];
+		std::memcpy(payload, &header, sizeof(header));
+		pack_board(chess_board, payload + sizeof(header));
+		spectator_board = encode_message(MessageBoard, payload, sizeof(payload));
+	}
+	return spectator_board;
+}
+
+void ChessRoom::send_board(Connection *c) const {
+	BoardSnapshotHeader header;
+	header.seq = move_seq;
+	header.width = uint8_t(BoardWidth);
+	uint8_t payload[sizeof(BoardSnapshotHeader) + PackedBoardBytes];
+	std::memcpy(payload, &header, sizeof(header));
+	pack_board(chess_board, payload + sizeof(header));
+	send_message(*c, MessageBoard, payload, sizeof(payload));
+}
+
+void ChessRoom::save(RoomStore::Record *record_) const {
+	assert(record_);
+	auto &record = *record_;
+	record.id = id;
+	record.game_state = (game_state == 0 ? 0 : 1);
+	record.seat_tokens = seat_tokens;
+	record.moves = uint16_t(replay_moves.size());
+	for (size_t i = 0; i < replay_moves.size(); ++i) {
+		record.move_list[i] = {replay_moves[i].x, replay_moves[i].y};
+	}
+}
+
+bool ChessRoom::restore(RoomStore::Record const &record, double hold) {
+	assert(players.empty() && bot_players.empty() && replay_moves.empty());
+
+	//replaying the moves shouldn't journal them again or re-record a finished game:
+	RoomStore *saved_store = store;
+	ReplayLog *saved_replay_log = replay_log;
+	store = nullptr;
+	replay_log = nullptr;
+
+	seat_tokens = record.seat_tokens;
+	bool ok = true;
+	if (record.game_state != 0) {
+		game_state = 1;
+		curr_player = 1; //(as update() would set it)
+		for (uint16_t i = 0; i < record.moves && i < RoomStore::MaxMoves; ++i) {
+			if (!place_piece(record.move_list[i][0], record.move_list[i][1])) {
+				LOG(Info, "Room " << id << ": saved move " << i << " doesn't replay; stopping there.");
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	store = saved_store;
+	replay_log = saved_replay_log;
+	hold_until = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(hold));
+	waiting_since = std::chrono::steady_clock::now();
+	return ok;
+}
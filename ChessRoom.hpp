@@ -0,0 +1,181 @@
+#pragma once
+
+/*
+ * ChessRoom holds the state of one game (board, seated players, turn) and the
+ * rules for it. The server owns many rooms; each room's players are served by
+ * the same worker thread, so rooms are not thread-safe and need no locking.
+ *
+ * If given a ChessBot, a room fills seats nobody is sitting in with bot
+ * players: after waiting a while for humans to join, and as soon as a human
+ * leaves a game in progress. Bots think on the ChessBot's threads; update()
+ * just checks whether their move is ready.
+ *
+ * If given a ReplayLog, a room records each game's accepted moves and appends
+ * them to the log when the game ends (or the room closes mid-game).
+ *
+ * If given a RoomStore, a room journals every change to it (seats, start,
+ * moves, closing) and can be saved to / restored from a RoomStore::Record.
+ * Each human is sent a key to their seat on joining; a player who reconnects
+ * (e.g., after a server restart) can rejoin() with it.
+ *
+ * Spectators can watch() a room. Every update for them is encoded once and
+ * the same shared block is queued on all of their connections. A spectator
+ * whose send queue backs up past SpectatorLimits::high has updates skipped
+ * until it drains below 'low' (then gets the whole board again), and is
+ * dropped if it passes 'drop' or stays behind for 'drop_after' seconds.
+ */
+
+#include "Connection.hpp"
+#include "MessageCodec.hpp"
+#include "ChessBoardData.hpp"
+#include "ChessBoard.hpp"
+#include "ChessMessages.hpp"
+#include "ChessBot.hpp"
+#include "ReplayLog.hpp"
+#include "RoomStore.hpp"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string>
+
+struct ChessRoom {
+	//how bots fill seats:
+	struct BotSettings {
+		ChessBot *bot = nullptr; //no bots if null
+		double wait = 10.0; //seconds to wait for humans before seating bots
+		double budget = 1.0; //seconds a bot may spend choosing each move
+		ChessBot::Method method = ChessBot::MaxN;
+	};
+
+	//when to skip updates to / drop slow spectators (send queue sizes, in bytes):
+	struct SpectatorLimits {
+		size_t high = 64 * 1024; //stop sending updates above this
+		size_t low = 16 * 1024; //(once behind) send the whole board again below this
+		size_t drop = 1024 * 1024; //close the connection above this
+		double drop_after = 10.0; //close the connection after being behind this many seconds
+	};
+
+	ChessRoom(uint32_t id, BotSettings const &bot_settings, ReplayLog *replay_log = nullptr, RoomStore *store = nullptr);
+	~ChessRoom();
+	ChessRoom(ChessRoom const &) = delete;
+	ChessRoom &operator=(ChessRoom const &) = delete;
+
+	uint32_t id; //for logging
+
+	//seat a newly-connected player (returns false if there is no free seat):
+	bool join(Connection *c);
+	//seat a reconnecting player in the seat their key is for (returns false if the key is wrong or someone is sitting there):
+	// (a bot sitting in the seat gives it up)
+	bool rejoin(Connection *c, uint32_t seat, uint64_t token);
+	//forget a player who disconnected (or was disconnected):
+	void leave(Connection *c);
+
+	//add / remove a spectator:
+	void watch(Connection *c);
+	void unwatch(Connection *c);
+
+	size_t free_seats() const { return PLAYER_NUM - players.size() - bot_players.size(); }
+	bool accepting_players() const { return game_state == 0 && free_seats() > 0 && !held(); }
+	bool empty() const { return players.empty(); } //(bots don't keep a room open)
+	//can the room go? (no players and not held; spectators keep it open until its game is over)
+	bool closable() const { return empty() && !held() && (spectators.empty() || game_state == 2); }
+	//is the room being kept open (and its seats saved) for players to rejoin?
+	bool held() const { return std::chrono::steady_clock::now() < hold_until; }
+
+	//save state / rebuild it (replaying the saved moves) after a restart -- holding the room open for 'hold' seconds:
+	void save(RoomStore::Record *record) const;
+	bool restore(RoomStore::Record const &record, double hold);
+
+	//handle messages from this room's players:
+	// (handle_move returns false if the message was malformed and the sender should be dropped)
+	bool handle_move(Connection *c, MessageView const &message);
+	void handle_resync(Connection *c);
+
+	//called once per server tick -- update game logic, then send changed state to players and spectators:
+	void update();
+	void broadcast();
+	// (broadcast() closes the connections of spectators that fell too far behind; the owner should forget them)
+	std::vector< Connection * > dropped_spectators;
+
+	//per-client state:
+	struct PlayerInfo {
+		uint32_t id = 0; //seat number, 1 .. PLAYER_NUM
+		std::string name;
+
+		//what this player's client was last sent (so only changes are sent):
+		bool sent_name = false;
+		uint16_t sent_status = 0xffff; //(status kind << 8 | current player) of last status line
+		bool sent_any_state = false;
+		StateMessage sent_state;
+	};
+	std::unordered_map< Connection *, PlayerInfo > players;
+
+	//spectators:
+	struct Spectator {
+		Connection *connection = nullptr;
+		bool behind = false; //skipping updates until the send queue drains
+		std::chrono::steady_clock::time_point behind_since;
+	};
+	std::vector< Spectator > spectators;
+	SpectatorLimits spectator_limits;
+	SharedBytes spectator_update; //'s' + 't' as last sent to spectators (replaceable, keyed MessageState)
+	uint32_t spectator_update_key = 0; //(game state, current player, winner) it describes
+	SharedBytes spectator_board; //'b' for spectators (until the next move)
+	//counts since the owner last read (and reset) them:
+	uint64_t spectators_skipped = 0; //times a spectator fell behind and had updates skipped
+	uint64_t spectators_resynced = 0; //times a spectator caught up again and was sent the board
+	uint64_t spectators_dropped = 0; //spectators closed for falling too far behind
+
+	//bots sitting in seats no human is using:
+	struct BotPlayer {
+		uint32_t id = 0; //seat number
+		std::shared_ptr< ChessBot::Search > search; //move being chosen, if any
+	};
+	std::vector< BotPlayer > bot_players;
+	BotSettings bot_settings;
+	std::chrono::steady_clock::time_point waiting_since; //when the first human sat down in an empty room (or started waiting to be matched)
+
+	//recording for replays (if replay_log is set):
+	ReplayLog *replay_log = nullptr;
+	ReplayLog::Game replay_game;
+	std::vector< ReplayLog::Move > replay_moves; //(also the move list saved by save())
+
+	//saving state for restarts (if store is set):
+	RoomStore *store = nullptr;
+	std::array< uint64_t, PLAYER_NUM > seat_tokens{}; //key to each seat (0: never given to a human)
+	std::chrono::steady_clock::time_point hold_until; //(restored rooms) wait for players to rejoin until then
+
+	// game state:
+	ChessBoard chess_board;
+	// 0: waiting for player, 1: playing, 2: game over
+	uint8_t game_state = 0;
+	uint8_t curr_player = 0;
+	uint8_t color_to_draw = 0;
+	int8_t last_pos_x = 0;
+	int8_t last_pos_y = 0;
+	size_t remaining_pos = 0;
+	std::string game_over_message = "";
+	uint8_t winner = 0; //once the game is over: winning player, or ReplayLog::Tie
+	uint32_t move_seq = 0; //number of moves accepted so far (sequence number of the latest move delta)
+
+	//is a human or a bot sitting in this seat?
+	bool seat_taken(uint32_t seat) const;
+	//game_state 0 -> 1:
+	void start_game();
+	//seat a human (new or rejoining) and bring them up to date:
+	void seat_player(Connection *c, uint32_t seat);
+	//put the current player's piece at (x, y) (offsets from the center), tell everyone, and judge the move:
+	// (returns false -- changing nothing -- if the game isn't being played or the place is taken)
+	bool place_piece(int8_t pos_x, int8_t pos_y);
+	//seat bots where needed, start them thinking, and play the moves they have chosen:
+	void update_bots();
+	//send a full copy of the board (used when a client joins or falls out of sync):
+	void send_board(Connection *c) const;
+	//the 'b' message for spectators (encoded once per move):
+	SharedBytes const &spectator_board_block();
+	//send spectators what changed, and deal with ones that are falling behind:
+	void broadcast_spectators();
+};
@@ -22,13 +22,31 @@ typedef int ssize_t;
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #define closesocket close
 
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <fcntl.h>
+#define USE_EPOLL 1 //readiness via edge-triggered epoll instead of select()
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define USE_IO_URING 1 //(optional) completion-based io_uring backend for Server
+#endif
+#endif
+
 #include "Connection.hpp"
 
 //------------------------------------------------------
@@ -36,8 +54,10 @@ typedef int ssize_t;
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstring>
+#include <thread>
 
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
@@ -45,6 +65,8 @@ typedef int ssize_t;
 //Also, some help and examples for getaddrinfo from: https://beej.us/guide/bgnet/html/multi/syscalls.html
 
 
+SendLimitStats send_limit_stats;
+
 void Connection::close() {
 	if (socket != InvalidSocket) {
 		::closesocket(socket);
@@ -52,15 +74,457 @@ void Connection::close() {
 	}
 }
 
+void Connection::consume_sent(size_t bytes) {
+	assert(bytes <= send_queued);
+	send_queued -= bytes;
+	while (bytes > 0) {
+		assert(!send_segments.empty());
+		SendSegment &seg = send_segments.front();
+		size_t step = std::min(bytes, seg.size);
+		if (seg.block) {
+			seg.offset += step;
+		} else {
+			send_buffer.consume(step);
+		}
+		seg.size -= step;
+		bytes -= step;
+		if (seg.size == 0) send_segments.pop_front();
+	}
+	if (over_high && send_queued < limits.low) {
+		over_high = false;
+		set_send_limits(limits); //(resets check_limits_at)
+	}
+}
+
+void Connection::set_send_limits(SendLimits const &limits_) {
+	limits = limits_;
+	limits.low = std::min(limits.low, limits.high);
+	if (limits.high != 0) check_limits_at = limits.high;
+	else if (limits.max != 0) check_limits_at = limits.max;
+	else check_limits_at = size_t(-1);
+}
+
+void Connection::enforce_send_limits() {
+	if (limits.high != 0 && send_queued > limits.high) {
+		if (!over_high) {
+			over_high = true;
+			send_limit_stats.high_water += 1;
+		}
+
+		if (limits.overflow == SendLimits::Coalesce || limits.overflow == SendLimits::DropOldest) {
+			//newest block for each key (which coalescing keeps):
+			std::array< size_t, 256 > newest;
+			newest.fill(size_t(-1));
+			for (size_t i = 0; i < send_segments.size(); ++i) {
+				SendSegment const &seg = send_segments[i];
+				if (seg.block && seg.replace_key) newest[seg.replace_key] = i;
+			}
+			//mark dropped segments with size 0 (which queued segments otherwise never have):
+			// (a block that has started to go out -- or is being sent right now -- has to finish, so is never dropped)
+			uint64_t dropped = 0, dropped_bytes = 0;
+			size_t position = 0; //(of segment i in the queue)
+			for (size_t i = 0; i < send_segments.size(); ++i) {
+				SendSegment &seg = send_segments[i];
+				size_t start = position;
+				position += seg.size;
+				if (start < send_inflight) continue;
+				if (!seg.block || !seg.replace_key || seg.offset != 0) continue;
+				if (limits.overflow == SendLimits::Coalesce) {
+					if (i == newest[seg.replace_key]) continue;
+				} else {
+					if (send_queued <= limits.low) break;
+					if (i == newest[seg.replace_key]) updates_dropped = true;
+				}
+				dropped += 1;
+				dropped_bytes += seg.size;
+				send_queued -= seg.size;
+				seg.size = 0;
+			}
+			if (dropped) {
+				send_segments.remove_if([](SendSegment const &seg) {
+					return seg.size == 0;
+				});
+				(limits.overflow == SendLimits::Coalesce ? send_limit_stats.coalesced : send_limit_stats.dropped) += dropped;
+				send_limit_stats.dropped_bytes += dropped_bytes;
+			}
+		}
+	}
+
+	if ((limits.overflow == SendLimits::Disconnect && limits.high != 0 && send_queued > limits.high)
+	 || (limits.max != 0 && send_queued > limits.max)) {
+		//give up on this connection -- nothing queued will be sent now, so free it right away:
+		overflowed = true;
+		send_limit_stats.disconnects += 1;
+		send_segments.clear();
+		send_buffer.consume(send_buffer.size());
+		send_queued = 0;
+		send_inflight = 0; //(an asynchronous send in flight completes into the void)
+		check_limits_at = size_t(-1);
+		queue_flush(); //(so the next poll gets around to closing it)
+		return;
+	}
+
+	//don't check again until the queue has grown some more (rather than rescanning it on every send):
+	size_t step = std::max< size_t >(1, limits.high - limits.low);
+	check_limits_at = send_queued + step;
+	if (limits.max != 0) check_limits_at = std::min(check_limits_at, limits.max);
+}
+
+//---------------------------------
+//Helpers used by the polling backends:
+
+//start counting a newly-connected connection in its owner's stats:
+static void note_opened(Connection &c, NetStats *stats) {
+	c.net_stats = stats;
+	c.counters.opened = std::chrono::steady_clock::now();
+	if (stats) stats->opened.add();
+}
+
+//count a connection as closed, and why (only the first call for a connection counts):
+static void note_closed(Connection &c, NetStats::Cause cause) {
+	if (!c.net_stats) return;
+	c.net_stats->closed[cause].add();
+	c.net_stats->lifetime.add(std::chrono::duration< double >(std::chrono::steady_clock::now() - c.counters.opened).count());
+	c.net_stats = nullptr;
+}
+
+//read data waiting on a connection into its recv_buffer:
+// 'drain' keeps reading until the socket reports EAGAIN (required with edge-triggered readiness)
+// (reads straight into the free space at the end of recv_buffer's slabs -- no intermediate copy)
+static void recv_connection(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	bool drain) {
+
+	while (true) { //read until more data left to read
+		SlabBuffer::Space space[2];
+		size_t space_count = c.recv_buffer.space(space);
+		#ifdef _WIN32
+		//(no scatter-read here) just read into the first span:
+		size_t room = space[0].size;
+		ssize_t ret = recv(c.socket, space[0].data, int(space[0].size), MSG_DONTWAIT);
+		#else
+		size_t room = 0;
+		struct iovec iov[2];
+		for (size_t i = 0; i < space_count; ++i) {
+			iov[i].iov_base = space[i].data;
+			iov[i].iov_len = space[i].size;
+			room += space[i].size;
+		}
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = space_count;
+		ssize_t ret = recvmsg(c.socket, &msg, MSG_DONTWAIT);
+		#endif
+		if (c.net_stats) c.net_stats->syscalls.add();
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~ but no data
+			break;
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0 || ret > (ssize_t)room) {
+			//~problem~ so remove connection
+			if (ret == 0) {
+				LOG(Info, "[" << where << "] port closed, disconnecting.");
+			} else if (ret < 0) {
+				LOG(Warn, "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting.");
+			} else {
+				LOG(Warn, "[" << where << "] recv() returned strange number of bytes, disconnecting.");
+			}
+			note_closed(c, ret == 0 ? NetStats::PeerClosed : NetStats::RecvError);
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret > 0
+			c.recv_buffer.commit(size_t(ret));
+			c.counters.bytes_in += size_t(ret);
+			if (c.net_stats) {
+				c.net_stats->bytes_in.add(size_t(ret));
+				c.net_stats->recv_queue_max.raise(c.recv_buffer.size());
+			}
+			if (on_event) on_event(&c, Connection::OnRecv);
+			if (c.socket == InvalidSocket) break; //closed by the event handler
+			if (!drain && size_t(ret) < room) break; //ran out of data before buffer: no more data left to read
+		}
+	}
+	c.recv_buffer.trim(); //(give back slabs the last read didn't need)
+}
+
+constexpr size_t MaxSendSpans = 64; //pieces of queued data gathered into one send
+
+//gather (up to MaxSendSpans) pieces of a connection's queued data, in order, to send at once:
+// (returns the number of spans; 'segments' gets the number of send_segments they cover)
+static size_t gather_send_spans(Connection const &c, RingBuffer::Span *spans, size_t *total, size_t *segments = nullptr) {
+	size_t span_count = 0;
+	size_t buffer_offset = 0; //position of the current segment's data in send_buffer
+	*total = 0;
+	if (segments) *segments = 0;
+	for (auto const &seg : c.send_segments) {
+		if (span_count + 2 > MaxSendSpans) break;
+		if (seg.block) {
+			spans[span_count].data = seg.block->data() + seg.offset;
+			spans[span_count].size = seg.size;
+			span_count += 1;
+		} else {
+			span_count += c.send_buffer.spans(buffer_offset, seg.size, spans + span_count);
+			buffer_offset += seg.size;
+		}
+		*total += seg.size;
+		if (segments) *segments += 1;
+	}
+	return span_count;
+}
+
+//write as much of a connection's queued data as the socket will accept:
+// (gathers up to MaxSendSpans pieces of send_buffer and shared blocks into one sendmsg() call)
+static void send_connection(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	#ifdef USE_EPOLL
+	constexpr int SendFlags = MSG_DONTWAIT | MSG_NOSIGNAL; //report closed peers via EPIPE instead of SIGPIPE
+	#else
+	constexpr int SendFlags = MSG_DONTWAIT;
+	#endif
+
+	if (c.net_stats) c.net_stats->send_queue_max.raise(c.queued_bytes());
+	while (!c.send_segments.empty()) {
+		//gather spans to send:
+		RingBuffer::Span spans[MaxSendSpans];
+		size_t total = 0;
+		size_t span_count = gather_send_spans(c, spans, &total);
+
+		#ifdef _WIN32
+		//(no gather-write here) just send the first span:
+		total = spans[0].size;
+		ssize_t ret = send(c.socket, spans[0].data, int(spans[0].size), SendFlags);
+		#else
+		struct iovec iov[MaxSendSpans];
+		for (size_t i = 0; i < span_count; ++i) {
+			iov[i].iov_base = const_cast< char * >(spans[i].data);
+			iov[i].iov_len = spans[i].size;
+		}
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = span_count;
+		ssize_t ret = sendmsg(c.socket, &msg, SendFlags);
+		#endif
+		if (c.net_stats) c.net_stats->syscalls.add();
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~, but don't keep trying until socket is writable again
+			c.writable = false;
+			break;
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret <= 0 || ret > (ssize_t)total) {
+			if (ret < 0) {
+				LOG(Warn, "[" << where << "] send() returned error " << errno << ", disconnecting.");
+			} else { assert(ret == 0 || ret > (ssize_t)total);
+				LOG(Warn, "[" << where << "] send() returned strange number of bytes [" << ret << " of " << total << "], disconnecting.");
+			}
+			note_closed(c, NetStats::SendError);
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret seems reasonable
+			c.consume_sent(size_t(ret));
+			c.counters.bytes_out += size_t(ret);
+			if (c.net_stats) c.net_stats->bytes_out.add(size_t(ret));
+		}
+	}
+}
+
+//close a connection whose send queue went past its limits:
+static void close_overflowed(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	LOG(Warn, "[" << where << "] send queue for " << c.socket << " went past its limit, disconnecting.");
+	note_closed(c, NetStats::Overflow);
+	c.close();
+	if (on_event) on_event(&c, Connection::OnClose);
+}
+
+#ifdef USE_EPOLL
+//register a socket with an epoll instance; 'target' is nullptr for listening sockets:
+static bool epoll_register(int epoll_fd, Socket socket, Connection *target) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	if (target) ev.events |= EPOLLOUT | EPOLLRDHUP;
+	ev.data.ptr = target;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &ev) == 0;
+}
+#endif
+
+//put a socket in non-blocking mode (returns false on failure):
+static bool set_nonblocking(Socket socket) {
+	#ifdef _WIN32
+	unsigned long one = 1;
+	return 0 == ioctlsocket(socket, FIONBIO, &one);
+	#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	return flags >= 0 && ((flags & O_NONBLOCK) || fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0);
+	#endif
+}
+
+//start tracking a newly-connected socket (returns nullptr and closes the socket on failure):
+// (epoll_fd < 0: not using epoll)
+//(the socket is made non-blocking whatever it was before -- e.g., handed off by an io_uring Server)
+static Connection *add_connection(
+	char const *where,
+	std::list< Connection > &connections,
+	int epoll_fd,
+	std::vector< Connection * > &flush_queue,
+	NetStats &stats,
+	Socket socket) {
+
+	connections.emplace_back();
+	Connection &c = connections.back();
+	c.socket = socket;
+	if (!set_nonblocking(socket)) {
+		LOG(Warn, "[" << where << "] failed to make socket " << socket << " non-blocking (" << strerror(errno) << "), dropping.");
+		c.close();
+		connections.pop_back();
+		return nullptr;
+	}
+	#ifdef USE_EPOLL
+	if (epoll_fd >= 0) {
+		if (!epoll_register(epoll_fd, socket, &c)) {
+			LOG(Warn, "[" << where << "] failed to register socket " << socket << " with epoll (" << strerror(errno) << "), dropping.");
+			c.close();
+			connections.pop_back();
+			return nullptr;
+		}
+		c.flush_queue = &flush_queue;
+	}
+	#endif
+	note_opened(c, &stats);
+	LOG(Info, "[" << where << "] client connected on " << c.socket << ".");
+	return &c;
+}
+
+#ifdef USE_EPOLL
+//---------------------------------
+//epoll backend:
+// - every socket is registered once (edge-triggered) when it is created/accepted
+// - connections with pending sends are tracked in 'flush_queue' so idle connections cost nothing per poll
+
+//try to send pending data on all connections in flush_queue (dropping those that are done):
+static void flush_connections(
+	char const *where,
+	std::vector< Connection * > &flush_queue,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	//NOTE: send_connection may call on_event, which may queue more connections, so index (don't iterate):
+	for (size_t i = 0; i < flush_queue.size(); /* later */) {
+		Connection &c = *flush_queue[i];
+		if (c.socket != InvalidSocket && c.overflowed) {
+			close_overflowed(where, c, on_event);
+		} else if (c.socket != InvalidSocket && c.writable) {
+			send_connection(where, c, on_event);
+		}
+		if (c.socket == InvalidSocket || c.queued_bytes() == 0) {
+			c.queued_for_flush = false;
+			flush_queue[i] = flush_queue.back();
+			flush_queue.pop_back();
+		} else {
+			++i;
+		}
+	}
+}
+
+//(returns time spent waiting, in seconds)
+static double poll_epoll(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	int epoll_fd,
+	std::vector< Connection * > &flush_queue,
+	NetStats &stats,
+	Socket listen_socket = InvalidSocket) {
+
+	//send anything queued since the last poll before (possibly) sleeping:
+	flush_connections(where, flush_queue, on_event);
+
+	constexpr int MaxEvents = 256; //(events beyond this stay ready for the next poll)
+	struct epoll_event events[MaxEvents];
+
+	int count;
+	double waited;
+	{ //wait (until timeout) for sockets' data to become available:
+		int timeout_ms = std::max(0, int(std::ceil(timeout * 1000.0)));
+		auto before = std::chrono::steady_clock::now();
+		count = epoll_wait(epoll_fd, events, MaxEvents, timeout_ms);
+		waited = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		stats.syscalls.add();
+		if (count < 0) {
+			if (errno != EINTR) {
+				LOG(Error, "[" << where << "] epoll_wait() returned error " << errno << "(" << strerror(errno) << ").");
+			}
+			return waited;
+		}
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (events[i].data.ptr == nullptr) {
+			//listen socket is readable: accept everything pending (edge-triggered, so must drain):
+			assert(listen_socket != InvalidSocket);
+			while (true) {
+				Socket got = accept4(listen_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				stats.syscalls.add();
+				if (got == InvalidSocket) {
+					if (errno == EINTR || errno == ECONNABORTED) continue;
+					if (errno != EAGAIN && errno != EWOULDBLOCK) {
+						LOG(Error, "[" << where << "] accept() returned error " << errno << "(" << strerror(errno) << ").");
+					}
+					break;
+				}
+				Connection *c = add_connection(where, connections, epoll_fd, flush_queue, stats, got);
+				if (c && on_event) on_event(c, Connection::OnOpen);
+			}
+		} else {
+			Connection &c = *reinterpret_cast< Connection * >(events[i].data.ptr);
+			if (c.socket == InvalidSocket) continue; //closed earlier in this poll
+			if (events[i].events & EPOLLOUT) {
+				c.writable = true;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				recv_connection(where, c, on_event, true);
+			}
+		}
+	}
+
+	//send data queued by event handlers (and data waiting on newly-writable sockets):
+	flush_connections(where, flush_queue, on_event);
+	return waited;
+}
+
+#endif //USE_EPOLL
+
 //---------------------------------
-//Polling helper used by both server and client:
-void poll_connections(
+//select() backend:
+// - every poll lists every socket (so costs time per connection, busy or not)
+// (returns time spent waiting, in seconds)
+static double poll_select(
 	char const *where,
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
 	double timeout,
+	std::vector< Connection * > &flush_queue,
+	NetStats &stats,
 	Socket listen_socket = InvalidSocket) {
 
+	//close connections that queued too much since the last poll:
+	for (auto &c : connections) {
+		if (c.socket != InvalidSocket && c.overflowed) close_overflowed(where, c, on_event);
+	}
+
 	fd_set read_fds, write_fds;
 	FD_ZERO(&read_fds);
 	FD_ZERO(&write_fds);
@@ -74,34 +538,40 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	// (by reference -- copying a Connection would copy its buffers)
+	for (auto const &c : connections) {
 		if (c.socket != InvalidSocket) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
-			if (!c.send_buffer.empty()) {
+			if (c.queued_bytes() != 0) {
 				FD_SET(c.socket, &write_fds);
 			}
 		}
 	}
 
+	double waited;
 	{ //wait (until timeout) for sockets' data to become available:
 		struct timeval tv;
 		tv.tv_sec = std::lround(std::floor(timeout));
 		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
+		auto before = std::chrono::steady_clock::now();
 		//NOTE: on windows nfds is ignored -- https://msdn.microsoft.com/en-us/library/windows/desktop/ms740141(v=vs.85).aspx
 		int ret = select(max + 1, &read_fds, &write_fds, NULL, &tv);
+		waited = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		stats.syscalls.add();
 
 		if (ret < 0) {
-			std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
+			LOG(Warn, "[" << where << "] Select returned an error; will attempt to read/write anyway.");
 		} else if (ret == 0) {
 			//nothing to read or write.
-			return;
+			return waited;
 		}
 	}
 
 	//add new connections as needed:
 	if (listen_socket != InvalidSocket && FD_ISSET(listen_socket, &read_fds)) {
 		Socket got = accept(listen_socket, NULL, NULL);
+		stats.syscalls.add();
 		if (got == InvalidSocket) {
 			//oh well.
 		} else {
@@ -111,80 +581,669 @@ void poll_connections(
 			#else
 			{
 			#endif
-				connections.emplace_back();
-				connections.back().socket = got;
-				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
-				if (on_event) on_event(&connections.back(), Connection::OnOpen);
+				Connection *c = add_connection(where, connections, -1, flush_queue, stats, got);
+				if (c && on_event) on_event(c, Connection::OnOpen);
 			}
 		}
 	}
 
-	const uint32_t BufferSize = 20000;
-	static thread_local char *buffer = new char[BufferSize];
-
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
 		if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
 
-		while (true) { //read until more data left to read
-			ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				//~no problem~ but no data
-				break;
-			} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
-				//~problem~ so remove connection
-				if (ret == 0) {
-					std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-				} else if (ret < 0) {
-					std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
-				} else {
-					std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
-				}
-				c.close();
-				if (on_event) on_event(&c, Connection::OnClose);
-				break;
-			} else { //ret > 0
-				c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-				if (on_event) on_event(&c, Connection::OnRecv);
-				if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
-			}
-		}
+		recv_connection(where, c, on_event, false);
 	}
 
 	//process responses:
 	for (auto &c : connections) {
 		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+		if (c.socket == InvalidSocket || c.queued_bytes() == 0 || !FD_ISSET(c.socket, &write_fds)) continue;
+
+		send_connection(where, c, on_event);
+	}
+
+	return waited;
+}
+
+#ifdef USE_IO_URING
+//---------------------------------
+//io_uring backend (Server only; talks to the kernel with raw syscalls -- no liburing):
+// - the listen socket has one multishot accept armed; each connection has one multishot receive,
+//   which takes buffers from a pool of provided buffers shared by all of the server's connections
+//   (buffers are given back to the kernel in batches, as part of each poll's submission)
+// - each poll's sends (one SENDMSG per connection with data queued) are handed to the kernel along
+//   with everything else queued that poll in one io_uring_enter() -- not a syscall per socket
+// - completions name a slot (and the slot's generation) rather than a Connection, so a completion
+//   that arrives after its connection was closed or detached is recognized and dropped
+//NOTE: io_uring holds its own reference to a socket while an operation on it is pending, so a
+// closed connection only really closes once its receive has been cancelled (at the next poll).
+
+struct IoUring {
+	//throws (with the reason) if io_uring isn't usable here:
+	IoUring(unsigned entries, unsigned buffer_count, unsigned buffer_size);
+	~IoUring();
+	IoUring(IoUring const &) = delete;
+	IoUring &operator=(IoUring const &) = delete;
+
+	int fd = -1;
+
+	//rings (mapped from the kernel):
+	void *ring = nullptr; //(sq and cq rings share one mapping; IORING_FEAT_SINGLE_MMAP)
+	size_t ring_size = 0;
+	unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_flags = nullptr, *sq_array = nullptr;
+	unsigned sq_mask = 0, sq_entries = 0;
+	io_uring_sqe *sqes = nullptr;
+	size_t sqes_size = 0;
+	unsigned *cq_head = nullptr, *cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	io_uring_cqe *cqes = nullptr;
+	unsigned sq_local_tail = 0; //(sqes filled up to here; published to *sq_tail when submitting)
+
+	//provided buffers for receives:
+	static constexpr uint16_t BufferGroup = 0;
+	char *buffers = nullptr;
+	unsigned buffer_count = 0, buffer_size = 0;
+	std::vector< uint16_t > returned; //buffers done with, to give back to the kernel on the next submission
+
+	//per-connection operation tracking:
+	struct Slot {
+		Connection *connection = nullptr; //(nullptr once closed or detached)
+		uint32_t generation = 0; //(bumped when the slot is reused)
+		uint32_t inflight = 0; //operations submitted but not yet completed
+		bool recv_armed = false;
+		bool sending = false;
+		//the send in flight (kept here, unchanging, until it completes):
+		std::vector< char > staging; //copy of the send_buffer bytes being sent
+		std::vector< SharedBytes > pinned; //shared blocks being sent
+		struct iovec iov[MaxSendSpans];
+		struct msghdr msg;
+	};
+	std::vector< std::unique_ptr< Slot > > slots;
+	std::vector< uint32_t > free_slots;
+	std::vector< uint32_t > to_arm; //slots that need a receive armed
+	bool accept_armed = false;
+
+	enum Op : uint8_t { OpAccept = 1, OpRecv, OpSend, OpCancel, OpProvide };
+	static uint64_t user_data(Op op, uint32_t slot, uint32_t generation) {
+		return (uint64_t(op) << 56) | (uint64_t(slot & 0xffffff) << 32) | generation;
+	}
+
+	io_uring_sqe *get_sqe();
+	//submit queued sqes; if 'wait', wait up to 'timeout' seconds for a completion:
+	void enter(bool wait, double timeout);
+	void recycle(uint16_t bid) { returned.emplace_back(bid); }
+	void provide_returned(); //(queues the sqes that give 'returned' back)
+
+	uint32_t add(Connection &c);
+	void arm_recv(uint32_t index);
+	void cancel_recv(uint32_t index);
+	void release(Connection &c, bool now); //(connection closed or detached)
+	void maybe_free(uint32_t index);
+	void start_send(Connection &c);
+	void prepare(char const *where, std::vector< Connection * > &flush_queue, std::function< void(Connection *, Connection::Event event) > const &on_event, Socket listen_socket);
+	void complete(char const *where, std::list< Connection > &connections, std::vector< Connection * > &flush_queue, NetStats &stats, std::function< void(Connection *, Connection::Event event) > const &on_event);
+
+	//stats:
+	uint64_t enters = 0; //io_uring_enter() calls
+	uint64_t completions = 0;
+
+private:
+	void cleanup(); //(unmap and close everything; the constructor's failure path and the destructor)
+	bool probe_multishot_recv();
+};
+
+static int io_uring_setup_(unsigned entries, io_uring_params *params) {
+	return int(syscall(__NR_io_uring_setup, entries, params));
+}
+static int io_uring_enter_(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void const *arg, size_t arg_size) {
+	return int(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+IoUring::IoUring(unsigned entries, unsigned buffer_count_, unsigned buffer_size_) : buffer_count(buffer_count_), buffer_size(buffer_size_) {
+	assert(buffer_count && buffer_count <= 32768);
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+	params.cq_entries = entries * 4; //(multishot operations can post several completions per submission)
+	fd = io_uring_setup_(entries, &params);
+	if (fd < 0 && errno == EINVAL) {
+		memset(&params, 0, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = entries * 4;
+		fd = io_uring_setup_(entries, &params);
+	}
+	if (fd < 0) throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+
+	//(the destructor doesn't run when a constructor throws, so release what was set up here first)
+	auto fail = [&](std::string const &what) {
+		int err = errno;
+		cleanup();
+		throw std::runtime_error(what + (err ? ": " + std::string(strerror(err)) : std::string()));
+	};
+	unsigned const needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+	if ((params.features & needed) != needed) {
+		errno = 0;
+		fail("kernel lacks needed io_uring features");
+	}
+
+	//map the rings:
+	ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED) {
+		ring = nullptr;
+		fail("failed to map io_uring rings");
+	}
+	char *base = reinterpret_cast< char * >(ring);
+	sq_head = reinterpret_cast< unsigned * >(base + params.sq_off.head);
+	sq_tail = reinterpret_cast< unsigned * >(base + params.sq_off.tail);
+	sq_flags = reinterpret_cast< unsigned * >(base + params.sq_off.flags);
+	sq_array = reinterpret_cast< unsigned * >(base + params.sq_off.array);
+	sq_mask = *reinterpret_cast< unsigned * >(base + params.sq_off.ring_mask);
+	sq_entries = *reinterpret_cast< unsigned * >(base + params.sq_off.ring_entries);
+	cq_head = reinterpret_cast< unsigned * >(base + params.cq_off.head);
+	cq_tail = reinterpret_cast< unsigned * >(base + params.cq_off.tail);
+	cq_mask = *reinterpret_cast< unsigned * >(base + params.cq_off.ring_mask);
+	cqes = reinterpret_cast< io_uring_cqe * >(base + params.cq_off.cqes);
+	sq_local_tail = *sq_tail;
+
+	sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void *sqe_memory = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqe_memory == MAP_FAILED) fail("failed to map io_uring submission entries");
+	sqes = reinterpret_cast< io_uring_sqe * >(sqe_memory);
+
+	//provided buffers (the kernel picks one for each receive as data arrives):
+	//NOTE: IORING_REGISTER_PBUF_RING would save the sqes spent giving buffers back, but didn't
+	// deliver buffers on every kernel tried; IORING_OP_PROVIDE_BUFFERS works everywhere.
+	void *buffer_memory = mmap(nullptr, size_t(buffer_count) * buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer_memory == MAP_FAILED) fail("failed to allocate receive buffers");
+	buffers = reinterpret_cast< char * >(buffer_memory);
+
+	//provide them all (and check that worked before relying on it):
+	for (unsigned i = 0; i < buffer_count; ++i) recycle(uint16_t(i));
+	provide_returned();
+	enter(true, 1.0);
+	while (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+		io_uring_cqe const &cqe = cqes[*cq_head & cq_mask];
+		int res = cqe.res;
+		__atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+		if (res < 0) {
+			errno = -res;
+			fail("failed to provide receive buffers");
+		}
+	}
+
+	//multishot receives arrived in linux 6.0 (but vendor kernels may have them backported), so try one:
+	if (!probe_multishot_recv()) fail("kernel doesn't support multishot receives");
+}
+
+//arm a multishot receive on one end of a socket pair, send a byte from the other, and check
+// that the completion delivers it and says the receive stays armed (IORING_CQE_F_MORE):
+// (older kernels fail the receive with EINVAL instead; errno is set on failure)
+bool IoUring::probe_multishot_recv() {
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) return false;
+
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = pair[0];
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BufferGroup;
+	sqe->user_data = user_data(OpRecv, 0, 0);
+	char byte = 'p';
+	bool sent = (::send(pair[1], &byte, 1, MSG_NOSIGNAL) == 1);
+
+	//reap completions until the receive finishes (closing the sending end after the first one ends it):
+	int res = -ETIME; //(the first completion's result)
+	bool seen = false, armed = false, done = false;
+	for (int waits = 0; waits < 3 && !done; ++waits) {
+		enter(true, 1.0);
+		while (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			io_uring_cqe const &cqe = cqes[*cq_head & cq_mask];
+			if (Op(cqe.user_data >> 56) == OpRecv) {
+				if (cqe.flags & IORING_CQE_F_BUFFER) recycle(uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+				bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+				if (!seen) {
+					seen = true;
+					res = cqe.res;
+					armed = more;
+					::close(pair[1]);
+					pair[1] = -1;
+				}
+				if (!more) done = true;
 			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+			__atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+		}
+	}
+	if (pair[1] >= 0) ::close(pair[1]);
+	::close(pair[0]); //(a receive somehow still pending is cancelled when the ring closes)
+
+	if (sent && res == 1 && armed) return true;
+	errno = (res < 0 ? -res : 0);
+	return false;
+}
+
+void IoUring::cleanup() {
+	if (fd >= 0) ::close(fd); //(cancels anything still pending)
+	if (buffers) munmap(buffers, size_t(buffer_count) * buffer_size);
+	if (sqes) munmap(sqes, sqes_size);
+	if (ring) munmap(ring, ring_size);
+	buffers = nullptr;
+	sqes = nullptr;
+	ring = nullptr;
+	fd = -1;
+}
+
+IoUring::~IoUring() {
+	cleanup();
+}
+
+void IoUring::provide_returned() {
+	if (returned.empty()) return;
+	//one sqe per run of consecutive buffers:
+	std::sort(returned.begin(), returned.end());
+	for (size_t begin = 0; begin < returned.size(); /* later */) {
+		size_t end = begin + 1;
+		while (end < returned.size() && returned[end] == returned[end - 1] + 1) ++end;
+		io_uring_sqe *sqe = get_sqe();
+		sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+		sqe->fd = int(end - begin); //(number of buffers)
+		sqe->addr = uint64_t(reinterpret_cast< uintptr_t >(buffers + size_t(returned[begin]) * buffer_size));
+		sqe->len = buffer_size;
+		sqe->off = returned[begin]; //(id of the first)
+		sqe->buf_group = BufferGroup;
+		sqe->user_data = user_data(OpProvide, 0, 0);
+		begin = end;
+	}
+	returned.clear();
+}
+
+io_uring_sqe *IoUring::get_sqe() {
+	if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+		enter(false, 0.0); //(full: submit what's there to make room)
+		if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+			throw std::runtime_error("io_uring submission queue stayed full");
+		}
+	}
+	unsigned index = sq_local_tail & sq_mask;
+	io_uring_sqe *sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array[index] = index;
+	sq_local_tail += 1;
+	return sqe;
+}
+
+void IoUring::enter(bool wait, double timeout) {
+	__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+	//(everything the kernel hasn't consumed yet -- including any left over by an earlier EBUSY)
+	unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+	//(completions that overflowed the cq ring are only moved back into it by a GETEVENTS enter)
+	bool overflowed = (__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) != 0;
+	if (to_submit == 0 && !wait && !overflowed) return;
+
+	unsigned flags = 0;
+	struct __kernel_timespec ts;
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	if (wait || overflowed) {
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		double t = wait ? std::max(0.0, timeout) : 0.0;
+		ts.tv_sec = (long long)std::floor(t);
+		ts.tv_nsec = (long long)((t - std::floor(t)) * 1e9);
+		arg.ts = uint64_t(reinterpret_cast< uintptr_t >(&ts));
+	}
+	while (true) {
+		enters += 1;
+		int ret = io_uring_enter_(fd, to_submit, (wait ? 1 : 0), flags, (flags ? &arg : nullptr), (flags ? sizeof(arg) : 0));
+		if (ret >= 0) {
+			to_submit -= std::min(to_submit, unsigned(ret));
+			if (to_submit == 0) break;
+			wait = false; //(submitted some; retry the rest without waiting again)
+			continue;
+		}
+		if (errno == EINTR) continue;
+		if (errno == ETIME) break; //(waited the whole timeout)
+		if (errno == EBUSY || errno == EAGAIN) break; //(completions need reaping first; the caller does that next)
+		throw std::system_error(errno, std::system_category(), "io_uring_enter failed");
+	}
+}
+
+uint32_t IoUring::add(Connection &c) {
+	uint32_t index;
+	if (!free_slots.empty()) {
+		index = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		index = uint32_t(slots.size());
+		slots.emplace_back(std::make_unique< Slot >());
+	}
+	Slot &slot = *slots[index];
+	slot.connection = &c;
+	c.backend_slot = index;
+	//(sockets stay in blocking mode, so io_uring waits for readiness itself instead of failing with EAGAIN)
+	int flags = fcntl(c.socket, F_GETFL, 0);
+	if (flags >= 0 && (flags & O_NONBLOCK)) fcntl(c.socket, F_SETFL, flags & ~O_NONBLOCK);
+	//(armed when the poll submits -- so a connection detached right away never has a receive to cancel)
+	to_arm.emplace_back(index);
+	return index;
+}
+
+void IoUring::arm_recv(uint32_t index) {
+	Slot &slot = *slots[index];
+	if (!slot.connection || slot.recv_armed) return;
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = slot.connection->socket;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BufferGroup;
+	sqe->user_data = user_data(OpRecv, index, slot.generation);
+	slot.recv_armed = true;
+	slot.inflight += 1;
+}
+
+void IoUring::cancel_recv(uint32_t index) {
+	Slot &slot = *slots[index];
+	if (!slot.recv_armed) return;
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data(OpRecv, index, slot.generation);
+	sqe->user_data = user_data(OpCancel, index, slot.generation);
+	slot.inflight += 1;
+}
+
+void IoUring::release(Connection &c, bool now) {
+	uint32_t index = c.backend_slot;
+	if (index >= slots.size()) return;
+	c.backend_slot = uint32_t(-1);
+	c.send_inflight = 0;
+	Slot &slot = *slots[index];
+	slot.connection = nullptr;
+	if (slot.recv_armed) {
+		cancel_recv(index);
+		//(when detaching, the socket is about to be used elsewhere, so stop receiving on it right away)
+		if (now) enter(false, 0.0);
+	}
+	maybe_free(index);
+}
+
+void IoUring::maybe_free(uint32_t index) {
+	Slot &slot = *slots[index];
+	if (slot.connection || slot.inflight != 0) return;
+	slot.generation += 1;
+	slot.recv_armed = false;
+	slot.sending = false;
+	slot.staging.clear();
+	slot.pinned.clear();
+	free_slots.emplace_back(index);
+}
+
+void IoUring::start_send(Connection &c) {
+	Slot &slot = *slots[c.backend_slot];
+	assert(!slot.sending);
+
+	RingBuffer::Span spans[MaxSendSpans];
+	size_t total = 0;
+	size_t segments = 0;
+	size_t span_count = gather_send_spans(c, spans, &total, &segments);
+	if (total == 0) return;
+	if (c.net_stats) c.net_stats->send_queue_max.raise(c.queued_bytes());
+
+	//the queue may change (grow, be coalesced, ...) before the kernel gets to this send, so it
+	// sends from copies that stay put: send_buffer bytes are copied, shared blocks are pinned:
+	size_t copied = 0;
+	for (size_t i = 0; i < segments; ++i) {
+		if (!c.send_segments[i].block) copied += c.send_segments[i].size;
+	}
+	slot.staging.resize(copied);
+	slot.pinned.clear();
+	size_t at = 0;
+	size_t iov_count = 0;
+	size_t span = 0;
+	for (size_t i = 0; i < segments; ++i) {
+		Connection::SendSegment const &seg = c.send_segments[i];
+		if (seg.block) {
+			slot.pinned.emplace_back(seg.block);
+			slot.iov[iov_count].iov_base = const_cast< char * >(spans[span].data);
+			slot.iov[iov_count].iov_len = spans[span].size;
+			iov_count += 1;
+			span += 1;
+		} else {
+			//(a send_buffer segment is one or two spans; they go out as one copied piece)
+			char *start = slot.staging.data() + at;
+			for (size_t left = seg.size; left > 0; span += 1) {
+				memcpy(slot.staging.data() + at, spans[span].data, spans[span].size);
+				at += spans[span].size;
+				left -= spans[span].size;
+			}
+			slot.iov[iov_count].iov_base = start;
+			slot.iov[iov_count].iov_len = seg.size;
+			iov_count += 1;
+		}
+	}
+	assert(span == span_count && at == copied);
+
+	memset(&slot.msg, 0, sizeof(slot.msg));
+	slot.msg.msg_iov = slot.iov;
+	slot.msg.msg_iovlen = iov_count;
+
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = c.socket;
+	sqe->addr = uint64_t(reinterpret_cast< uintptr_t >(&slot.msg));
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = user_data(OpSend, c.backend_slot, slot.generation);
+	slot.sending = true;
+	slot.inflight += 1;
+	c.send_inflight = total;
+}
+
+//queue up this poll's submissions: the accept, receives for new connections, and sends:
+void IoUring::prepare(
+	char const *where,
+	std::vector< Connection * > &flush_queue,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	Socket listen_socket) {
+
+	//(buffers first, so receives that ran out can use them)
+	provide_returned();
+
+	if (listen_socket != InvalidSocket && !accept_armed) {
+		io_uring_sqe *sqe = get_sqe();
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = listen_socket;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_CLOEXEC;
+		sqe->user_data = user_data(OpAccept, 0, 0);
+		accept_armed = true;
+	}
+
+	for (uint32_t index : to_arm) arm_recv(index);
+	to_arm.clear();
+
+	//NOTE: on_event may queue more connections, so index (don't iterate):
+	for (size_t i = 0; i < flush_queue.size(); /* later */) {
+		Connection &c = *flush_queue[i];
+		if (c.socket != InvalidSocket && c.overflowed) {
+			close_overflowed(where, c, on_event);
+		} else if (c.socket != InvalidSocket && c.backend_slot < slots.size() && !slots[c.backend_slot]->sending && c.queued_bytes() != 0) {
+			start_send(c);
+		}
+		//(a connection with a send in flight is queued again when the send completes, if need be)
+		if (c.socket == InvalidSocket || c.queued_bytes() == 0 || c.send_inflight != 0) {
+			c.queued_for_flush = false;
+			flush_queue[i] = flush_queue.back();
+			flush_queue.pop_back();
+		} else {
+			++i;
+		}
+	}
+}
+
+//handle everything in the completion queue:
+void IoUring::complete(
+	char const *where,
+	std::list< Connection > &connections,
+	std::vector< Connection * > &flush_queue,
+	NetStats &stats,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	unsigned head = *cq_head;
+	while (true) {
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail) break;
+		io_uring_cqe cqe = cqes[head & cq_mask];
+		head += 1;
+		//(hand the entry back right away, since handlers below may submit -- and so reap -- more)
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		completions += 1;
+
+		Op op = Op(cqe.user_data >> 56);
+		uint32_t index = uint32_t(cqe.user_data >> 32) & 0xffffff;
+		uint32_t generation = uint32_t(cqe.user_data);
+		bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+		if (op == OpAccept) {
+			if (!more) accept_armed = false; //(re-armed by the next prepare)
+			if (cqe.res >= 0) {
+				Connection *c = add_connection(where, connections, -1, flush_queue, stats, Socket(cqe.res));
+				if (c) {
+					c->flush_queue = &flush_queue;
+					add(*c);
+					if (on_event) on_event(c, Connection::OnOpen);
+				}
+			} else if (cqe.res != -ECANCELED) {
+				LOG(Error, "[" << where << "] accept returned error " << -cqe.res << "(" << strerror(-cqe.res) << ").");
+			}
+			continue;
+		}
+		if (op == OpProvide) {
+			if (cqe.res < 0) LOG(Error, "[" << where << "] providing receive buffers failed with error " << -cqe.res << "(" << strerror(-cqe.res) << ").");
+			continue;
+		}
+
+		if (index >= slots.size()) continue;
+		Slot &slot = *slots[index];
+		if (slot.generation != generation) continue; //(can't happen: slots aren't reused while operations are in flight)
+		Connection *c = slot.connection;
+
+		if (op == OpRecv) {
+			uint16_t bid = 0;
+			bool buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+			if (buffer) bid = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			if (!more) {
+				slot.recv_armed = false;
+				slot.inflight -= 1;
+			}
+			if (c && c->socket != InvalidSocket) {
+				if (cqe.res > 0 && buffer) {
+					c->recv_buffer.push(buffers + size_t(bid) * buffer_size, size_t(cqe.res));
+					c->counters.bytes_in += size_t(cqe.res);
+					if (c->net_stats) {
+						c->net_stats->bytes_in.add(size_t(cqe.res));
+						c->net_stats->recv_queue_max.raise(c->recv_buffer.size());
+					}
+					recycle(bid);
+					buffer = false;
+					if (on_event) on_event(c, Connection::OnRecv);
+					if (!more && c->socket != InvalidSocket && c->backend_slot == index) to_arm.emplace_back(index);
+				} else if (cqe.res == -ENOBUFS) {
+					//(ran out of provided buffers -- they're recycled as completions are handled, so try again next poll)
+					to_arm.emplace_back(index);
+				} else if (cqe.res == -ECANCELED) {
+					//(cancelled by release(); nothing to do)
+				} else {
+					if (cqe.res == 0) {
+						LOG(Info, "[" << where << "] port closed, disconnecting.");
+					} else {
+						LOG(Warn, "[" << where << "] recv returned error " << -cqe.res << "(" << strerror(-cqe.res) << "), disconnecting.");
+					}
+					note_closed(*c, cqe.res == 0 ? NetStats::PeerClosed : NetStats::RecvError);
+					c->close();
+					if (on_event) on_event(c, Connection::OnClose);
+				}
+			}
+			if (buffer) recycle(bid); //(data for a connection that is gone)
+		} else if (op == OpSend) {
+			slot.sending = false;
+			slot.inflight -= 1;
+			slot.pinned.clear();
+			if (c && c->socket != InvalidSocket) {
+				if (cqe.res >= 0) {
+					if (!c->overflowed) c->consume_sent(size_t(cqe.res));
+					c->counters.bytes_out += size_t(cqe.res);
+					if (c->net_stats) c->net_stats->bytes_out.add(size_t(cqe.res));
+					c->send_inflight = 0;
+					if (c->queued_bytes() != 0 || c->overflowed) c->queue_flush();
+				} else {
+					LOG(Warn, "[" << where << "] send returned error " << -cqe.res << "(" << strerror(-cqe.res) << "), disconnecting.");
+					c->send_inflight = 0;
+					note_closed(*c, NetStats::SendError);
+					c->close();
+					if (on_event) on_event(c, Connection::OnClose);
+				}
+			}
+		} else if (op == OpCancel) {
+			slot.inflight -= 1;
 		}
+		if (!slot.connection) maybe_free(index);
 	}
+}
 
-		
+// (returns time spent waiting, in seconds)
+static double poll_uring(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	IoUring &uring,
+	std::vector< Connection * > &flush_queue,
+	NetStats &stats,
+	Socket listen_socket) {
+	uint64_t enters = uring.enters;
+
+	//queue up everything sent since the last poll, then submit it and wait, in one syscall:
+	uring.prepare(where, flush_queue, on_event, listen_socket);
+	auto before = std::chrono::steady_clock::now();
+	uring.enter(timeout > 0.0, timeout);
+	double waited = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+	uring.complete(where, connections, flush_queue, stats, on_event);
+
+	//submit what event handlers sent (one more syscall, only if there is anything):
+	uring.prepare(where, flush_queue, on_event, listen_socket);
+	uring.enter(false, 0.0);
+
+	stats.syscalls.add(uring.enters - enters);
+	return waited;
 }
 
+#else
+
+struct IoUring { }; //(not available on this platform)
+
+#endif //USE_IO_URING
+
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(PollBackend requested) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	start_backend(requested);
+}
+
+Server::Server(std::string const &port, PollBackend requested) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -266,28 +1325,188 @@ Server::Server(std::string const &port) {
 	}
 
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		int ret = ::listen(listen_socket, SOMAXCONN);
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	try {
+		start_backend(requested);
+	} catch (...) {
+		closesocket(listen_socket);
+		listen_socket = InvalidSocket;
+		throw;
+	}
+}
+
+#ifdef USE_EPOLL
+PollBackend Server::default_backend = PollBackend::Epoll;
+#else
+PollBackend Server::default_backend = PollBackend::Select;
+#endif
+
+char const *Server::backend_name(PollBackend backend) {
+	if (backend == PollBackend::Select) return "select";
+	if (backend == PollBackend::Epoll) return "epoll";
+	if (backend == PollBackend::IoUring) return "io_uring";
+	return "unknown";
+}
+
+void Server::start_backend(PollBackend requested) {
+	if (requested == PollBackend::IoUring) {
+		#ifdef USE_IO_URING
+		try {
+			uring = std::make_unique< IoUring >(4096, 1024, 4096);
+			backend = PollBackend::IoUring;
+			return;
+		} catch (std::exception &e) {
+			LOG(Warn, "[Server::Server] can't use io_uring (" << e.what() << "), falling back.");
+		}
+		#else
+		LOG(Warn, "[Server::Server] io_uring isn't available on this platform, falling back.");
+		#endif
+		requested = PollBackend::Epoll;
+	}
+
+	if (requested == PollBackend::Epoll) {
+		#ifdef USE_EPOLL
+		//create epoll instance and register the (non-blocking) listen socket with it:
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+		if (listen_socket != InvalidSocket) {
+			int flags = fcntl(listen_socket, F_GETFL, 0);
+			if (flags < 0 || fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK) < 0
+			 || !epoll_register(epoll_fd, listen_socket, nullptr)) {
+				int err = errno;
+				::close(epoll_fd);
+				epoll_fd = -1;
+				throw std::system_error(err, std::system_category(), "failed to register listen socket with epoll");
+			}
+		}
+		backend = PollBackend::Epoll;
+		return;
+		#else
+		LOG(Warn, "[Server::Server] epoll isn't available on this platform, falling back to select.");
+		#endif
+	}
+
+	backend = PollBackend::Select;
+}
+
+Server::~Server() {
+	for (auto &c : connections) {
+		c.close();
+	}
+	for (auto &pending : handoff) {
+		closesocket(pending.first);
+	}
+	if (listen_socket != InvalidSocket) {
+		closesocket(listen_socket);
+		listen_socket = InvalidSocket;
+	}
+	#ifdef USE_EPOLL
+	if (epoll_fd >= 0) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
+	uring.reset();
+}
+
+void Server::hand_off(Socket socket, std::shared_ptr< void > data) {
+	std::lock_guard< std::mutex > lock(handoff_mutex);
+	handoff.emplace_back(socket, std::move(data));
+	handoff_pending.store(true, std::memory_order_release);
+}
+
+Socket Server::detach(Connection *connection) {
+	assert(connection);
+	Socket socket = connection->socket;
+	if (socket == InvalidSocket) return InvalidSocket;
+	#ifdef USE_EPOLL
+	if (epoll_fd >= 0) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+	#endif
+	#ifdef USE_IO_URING
+	if (uring) {
+		uring->release(*connection, true);
+		//(io_uring sockets are kept blocking; whoever gets this one next may poll it for readiness)
+		set_nonblocking(socket);
+	}
+	#endif
+	//(connection is reaped, and removed from flush_queue, at the end of the next poll)
+	note_closed(*connection, NetStats::Detached);
+	connection->socket = InvalidSocket;
+	return socket;
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	auto started = std::chrono::steady_clock::now();
+	stats.flush_queue.set(flush_queue.size());
+	stats.flush_queue_max.raise(flush_queue.size());
+	if (handoff_pending.load(std::memory_order_acquire)) {
+		//adopt sockets handed off by other threads:
+		std::vector< std::pair< Socket, std::shared_ptr< void > > > adopted;
+		{
+			std::lock_guard< std::mutex > lock(handoff_mutex);
+			adopted.swap(handoff);
+			handoff_pending.store(false, std::memory_order_relaxed);
+		}
+		for (auto &[socket, data] : adopted) {
+			Connection *c = add_connection("Server::poll", connections, epoll_fd, flush_queue, stats, socket);
+			if (c) c->handoff_data = std::move(data);
+			#ifdef USE_IO_URING
+			if (c && uring) {
+				c->flush_queue = &flush_queue;
+				uring->add(*c);
+			}
+			#endif
+			if (c && on_event) on_event(c, Connection::OnOpen);
+		}
+	}
+
+	double waited = 0.0;
+	if (backend == PollBackend::IoUring) {
+		#ifdef USE_IO_URING
+		waited = poll_uring("Server::poll", connections, on_event, timeout, *uring, flush_queue, stats, listen_socket);
+		#endif
+	} else if (backend == PollBackend::Epoll) {
+		#ifdef USE_EPOLL
+		waited = poll_epoll("Server::poll", connections, on_event, timeout, epoll_fd, flush_queue, stats, listen_socket);
+		#endif
+	} else {
+		waited = poll_select("Server::poll", connections, on_event, timeout, flush_queue, stats, listen_socket);
+	}
 
 	//reap closed clients:
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
 		auto old = connection;
 		++connection;
 		if (old->socket == InvalidSocket) {
+			note_closed(*old, NetStats::Local); //(if nothing above said why it closed, something called close())
+			if (old->queued_for_flush) {
+				//(closed after being queued by an event handler or by code outside of poll)
+				auto f = std::find(flush_queue.begin(), flush_queue.end(), &*old);
+				assert(f != flush_queue.end());
+				*f = flush_queue.back();
+				flush_queue.pop_back();
+			}
+			#ifdef USE_IO_URING
+			if (uring) uring->release(*old, false); //(cancels its receive on the next poll)
+			#endif
 			connections.erase(old);
 		}
 	}
+
+	stats.polls.add();
+	stats.wait_time.add(waited);
+	stats.work_time.add(std::chrono::duration< double >(std::chrono::steady_clock::now() - started).count() - waited);
 }
 
-Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
+Client::Client(std::string const &host_, std::string const &port_) : connections(1), connection(connections.front()), host(host_), port(port_) {
 	#ifdef _WIN32
 	{ //init winsock:
 		WSADATA info;
@@ -343,6 +1562,7 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			std::cout << "success!" << std::endl;
 
 			connection.socket = s;
+			note_opened(connection, &stats);
 			break;
 		}
 
@@ -352,10 +1572,316 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
+
+	#ifdef USE_EPOLL
+	{ //register connection with a new epoll instance:
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0 || !epoll_register(epoll_fd, connection.socket, &connection)) {
+			int err = errno;
+			if (epoll_fd >= 0) ::close(epoll_fd);
+			connection.close();
+			throw std::system_error(err, std::system_category(), "failed to register connection with epoll");
+		}
+		connection.flush_queue = &flush_queue;
+	}
+	#endif
+}
+
+struct Client::Resolution {
+	std::mutex mutex;
+	bool done = false;
+	std::string error;
+	std::vector< Address > addresses;
+};
+
+//text form of an address, e.g. "127.0.0.1:1337":
+static std::string address_string(Client::Address const &address) {
+	char ip[INET6_ADDRSTRLEN];
+	if (address.family == AF_INET) {
+		struct sockaddr_in s;
+		memcpy(&s, address.storage.data(), sizeof(s));
+		inet_ntop(AF_INET, &s.sin_addr, ip, sizeof(ip));
+		return std::string(ip) + ":" + std::to_string(ntohs(s.sin_port));
+	} else if (address.family == AF_INET6) {
+		struct sockaddr_in6 s;
+		memcpy(&s, address.storage.data(), sizeof(s));
+		inet_ntop(AF_INET6, &s.sin6_addr, ip, sizeof(ip));
+		return "[" + std::string(ip) + "]:" + std::to_string(ntohs(s.sin6_port));
+	} else {
+		return "[unknown ai_family]";
+	}
+}
+
+Client::Client(std::string const &host_, std::string const &port_, Retry const &retry_) : connections(1), connection(connections.front()), host(host_), port(port_), retry(retry_) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	#ifdef USE_EPOLL
+	//(the connection is registered once it connects)
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+	connection.flush_queue = &flush_queue;
+	#endif
+
+	start_attempt();
+}
+
+void Client::start_attempt() {
+	attempt += 1;
+	state = Resolving;
+	addresses.clear();
+	next_address = 0;
+
+	//getaddrinfo blocks (DNS lookups can take seconds), so it runs on a helper thread;
+	// the thread only touches the Resolution, which outlives the Client if need be:
+	auto result = std::make_shared< Resolution >();
+	resolution = result;
+	std::thread([result](std::string host, std::string port){
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		std::vector< Address > found;
+		std::string error;
+		struct addrinfo *res = nullptr;
+		int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+		if (ret != 0) {
+			error = "getaddrinfo error: " + std::string(gai_strerror(ret));
+		} else {
+			for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+				if (info->ai_addrlen > sizeof(Address::storage)) continue;
+				found.emplace_back();
+				Address &address = found.back();
+				memcpy(address.storage.data(), info->ai_addr, info->ai_addrlen);
+				address.size = uint32_t(info->ai_addrlen);
+				address.family = info->ai_family;
+				address.type = info->ai_socktype;
+				address.protocol = info->ai_protocol;
+			}
+			freeaddrinfo(res);
+		}
+
+		std::lock_guard< std::mutex > lock(result->mutex);
+		result->addresses = std::move(found);
+		result->error = std::move(error);
+		result->done = true;
+	}, host, port).detach();
+}
+
+//start a non-blocking connect() to the next address (returns false when there are none left):
+bool Client::connect_next_address() {
+	while (next_address < addresses.size()) {
+		Address const &address = addresses[next_address++];
+		LOG(Info, "[Client] trying " << address_string(address) << "...");
+		Socket s = socket(address.family, address.type, address.protocol);
+		if (s == InvalidSocket) {
+			error = "failed to create socket: " + std::string(strerror(errno));
+			continue;
+		}
+		#ifdef _WIN32
+		unsigned long one = 1;
+		bool nonblocking = (0 == ioctlsocket(s, FIONBIO, &one));
+		#else
+		int flags = fcntl(s, F_GETFL, 0);
+		bool nonblocking = (flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0);
+		#endif
+		if (!nonblocking) {
+			error = "failed to make socket non-blocking";
+			::closesocket(s);
+			continue;
+		}
+		int ret = connect(s, reinterpret_cast< struct sockaddr const * >(address.storage.data()), int(address.size));
+		#ifdef _WIN32
+		bool in_progress = (ret != 0 && WSAGetLastError() == WSAEWOULDBLOCK);
+		#else
+		bool in_progress = (ret != 0 && errno == EINPROGRESS);
+		#endif
+		if (ret != 0 && !in_progress) {
+			error = "failed to connect to " + address_string(address) + ": " + strerror(errno);
+			::closesocket(s);
+			continue;
+		}
+		pending = s;
+		pending_deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(retry.connect_timeout));
+		return true;
+	}
+	return false;
+}
+
+void Client::fail_attempt(std::function< void(Connection *, Connection::Event event) > const &on_event) {
+	if (retry.max_attempts != 0 && attempt >= retry.max_attempts) {
+		LOG(Warn, "[Client] giving up on " << host << ":" << port << " after " << attempt << " attempts (" << error << ").");
+		state = GaveUp;
+		if (on_event) on_event(&connection, Connection::OnClose);
+		return;
+	}
+	//exponential backoff:
+	double delay = std::min(retry.max_delay, retry.initial_delay * std::pow(2.0, double(attempt - 1)));
+	next_attempt = std::chrono::steady_clock::now() + std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(delay));
+	state = Waiting;
+	LOG(Warn, "[Client] attempt " << attempt << " to reach " << host << ":" << port << " failed (" << error << "); retrying in " << delay << "s.");
+	if (on_event) on_event(&connection, Connection::OnConnectFailed);
+}
+
+//advance the connection state machine, waiting at most 'timeout' seconds for something to happen:
+void Client::connect_step(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point deadline = Clock::now() + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(std::max(0.0, timeout)));
+	//sleep until 'until' (or the deadline, if sooner):
+	auto sleep_until = [&](Clock::time_point until) {
+		std::this_thread::sleep_until(std::min(until, deadline));
+	};
+
+	while (true) {
+		Clock::time_point now = Clock::now();
+		if (state == Resolving) {
+			std::unique_lock< std::mutex > lock(resolution->mutex);
+			if (!resolution->done) {
+				lock.unlock();
+				if (now >= deadline) return;
+				//(the resolver doesn't signal, so check back every few milliseconds)
+				sleep_until(now + std::chrono::milliseconds(5));
+				continue;
+			}
+			addresses = std::move(resolution->addresses);
+			error = resolution->error;
+			lock.unlock();
+			resolution.reset();
+			if (addresses.empty()) {
+				if (error.empty()) error = "no addresses for " + host;
+				fail_attempt(on_event);
+			} else {
+				state = Connecting;
+			}
+		} else if (state == Connecting) {
+			if (pending == InvalidSocket && !connect_next_address()) {
+				fail_attempt(on_event);
+				continue;
+			}
+			//wait for connect() to finish -- the socket becomes writable on success, or reports an error:
+			Clock::time_point until = std::min(deadline, pending_deadline);
+			double wait = std::max(0.0, std::chrono::duration< double >(until - now).count());
+			#ifdef _WIN32
+			//(windows fd_sets are lists of sockets, not bitmaps, so any socket fits)
+			fd_set write_fds, except_fds;
+			FD_ZERO(&write_fds);
+			FD_ZERO(&except_fds);
+			FD_SET(pending, &write_fds);
+			FD_SET(pending, &except_fds); //(windows reports failed connects here)
+			struct timeval tv;
+			tv.tv_sec = long(wait);
+			tv.tv_usec = long((wait - std::floor(wait)) * 1e6);
+			int ret = select(int(pending) + 1, nullptr, &write_fds, &except_fds, &tv);
+			if (ret < 0) {
+				if (errno == EINTR) continue;
+				throw std::system_error(errno, std::system_category(), "failed to select() on connecting socket");
+			}
+			#else
+			//(poll, not select: the socket may be numbered past FD_SETSIZE; failed connects show as POLLERR / POLLHUP)
+			struct pollfd connecting;
+			connecting.fd = pending;
+			connecting.events = POLLOUT;
+			connecting.revents = 0;
+			int ret = ::poll(&connecting, 1, int(std::ceil(wait * 1e3)));
+			if (ret < 0) {
+				if (errno == EINTR) continue;
+				throw std::system_error(errno, std::system_category(), "failed to poll() connecting socket");
+			}
+			#endif
+			Address const &address = addresses[next_address - 1];
+			if (ret > 0) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				if (getsockopt(pending, SOL_SOCKET, SO_ERROR, reinterpret_cast< char * >(&err), &len) != 0) err = errno;
+				if (err != 0) {
+					error = "failed to connect to " + address_string(address) + ": " + strerror(err);
+					LOG(Info, "[Client] " << error);
+					::closesocket(pending);
+					pending = InvalidSocket;
+					continue;
+				}
+				//connected:
+				Socket s = pending;
+				pending = InvalidSocket;
+				#ifdef USE_EPOLL
+				if (!epoll_register(epoll_fd, s, &connection)) {
+					error = "failed to register socket with epoll: " + std::string(strerror(errno));
+					::closesocket(s);
+					continue;
+				}
+				#endif
+				connection.socket = s;
+				note_opened(connection, &stats);
+				state = Connected;
+				error.clear();
+				LOG(Info, "[Client] connected to " << address_string(address) << " (attempt " << attempt << ").");
+				//anything sent while connecting goes out on the next poll:
+				if (connection.queued_bytes()) connection.queue_flush();
+				if (on_event) on_event(&connection, Connection::OnOpen);
+				return;
+			}
+			if (Clock::now() >= pending_deadline) {
+				error = "timed out connecting to " + address_string(address);
+				LOG(Info, "[Client] " << error);
+				::closesocket(pending);
+				pending = InvalidSocket;
+				continue;
+			}
+			if (Clock::now() >= deadline) return;
+		} else if (state == Waiting) {
+			if (now >= next_attempt) {
+				start_attempt();
+				continue;
+			}
+			if (now >= deadline) return;
+			sleep_until(next_attempt);
+		} else {
+			//Connected or GaveUp:
+			return;
+		}
+	}
+}
+
+Client::~Client() {
+	connection.close();
+	if (pending != InvalidSocket) {
+		::closesocket(pending);
+		pending = InvalidSocket;
+	}
+	#ifdef USE_EPOLL
+	if (epoll_fd >= 0) {
+		::close(epoll_fd);
+		epoll_fd = -1;
+	}
+	#endif
 }
 
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	if (state != Connected) {
+		connect_step(on_event, timeout);
+		return;
+	}
+	auto started = std::chrono::steady_clock::now();
+	stats.flush_queue.set(flush_queue.size());
+	stats.flush_queue_max.raise(flush_queue.size());
+	#ifdef USE_EPOLL
+	double waited = poll_epoll("Client::poll", connections, on_event, timeout, epoll_fd, flush_queue, stats, InvalidSocket);
+	#else
+	double waited = poll_select("Client::poll", connections, on_event, timeout, flush_queue, stats, InvalidSocket);
+	#endif
+	if (connection.socket == InvalidSocket) note_closed(connection, NetStats::Local);
+
+	stats.polls.add();
+	stats.wait_time.add(waited);
+	stats.work_time.add(std::chrono::duration< double >(std::chrono::steady_clock::now() - started).count() - waited);
 }
 
@@ -14,8 +14,8 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
-				connection->recv_buffer.clear();
+				std::vector< char > data(connection->recv_buffer.size());
+				connection->recv_buffer.read(data.data(), data.size());
 				//send to other connections:
 
 			}
@@ -60,11 +60,54 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+#include "RingBuffer.hpp"
+#include "SlabBuffer.hpp"
+#include "NetStats.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <vector>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <string>
 #include <functional>
 
+//Immutable, reference-counted block of bytes. Queue one block on any number of
+// connections with Connection::send_shared to send it without per-connection copies:
+typedef std::shared_ptr< std::vector< char > const > SharedBytes;
+
+inline SharedBytes make_shared_bytes(void const *data, size_t size) {
+	char const *begin = reinterpret_cast< char const * >(data);
+	return std::make_shared< std::vector< char > const >(begin, begin + size);
+}
+
+//Limits on how much data may wait in a connection's send queue (e.g., for a client that stopped reading):
+struct SendLimits {
+	enum Overflow : uint8_t {
+		Disconnect, //close the connection
+		DropOldest, //drop the oldest replaceable blocks (see send_replaceable) until the queue is down to 'low'
+		Coalesce, //drop replaceable blocks that a newer block with the same key has made obsolete
+	};
+	size_t high = 0; //past this many bytes queued, apply 'overflow' (0: no limit)
+	size_t low = 0; //backpressured() until the queue drains below this (DropOldest drops down to it)
+	size_t max = 0; //past this many bytes queued -- after applying 'overflow' -- disconnect (0: no limit)
+	Overflow overflow = Disconnect;
+};
+
+//How often send limits were enforced, all connections together (since startup):
+struct SendLimitStats {
+	std::atomic< uint64_t > high_water{0}; //times a connection's queue went past 'high'
+	std::atomic< uint64_t > coalesced{0}; //blocks dropped because a newer one replaced them
+	std::atomic< uint64_t > dropped{0}; //blocks dropped (oldest first) to get down to 'low'
+	std::atomic< uint64_t > dropped_bytes{0}; //(by either of the above)
+	std::atomic< uint64_t > disconnects{0}; //connections closed for queueing too much
+};
+extern SendLimitStats send_limit_stats;
+
 //Thin wrapper around a (polling-based) TCP socket connection:
 struct Connection {
 	//Helper that will append any type to the send buffer:
@@ -74,8 +117,51 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		if (size == 0 || overflowed) return;
+		send_buffer.push(data, size);
+		if (send_segments.empty() || send_segments.back().block) {
+			send_segments.emplace_back();
+		}
+		send_segments.back().size += size;
+		send_queued += size;
+		queue_flush();
+		if (send_queued > check_limits_at) enforce_send_limits();
+	}
+	//Queue a shared block to be sent (in order with send/send_raw data) without copying it:
+	void send_shared(SharedBytes const &block) {
+		send_replaceable(block, 0);
 	}
+	//Queue a shared block that any later block with the same (nonzero) 'replace_key' makes obsolete:
+	// (e.g., a snapshot of state that is re-sent whenever it changes; if the queue backs up, such
+	//  blocks may be dropped unsent, as send_limits.overflow says)
+	void send_replaceable(SharedBytes const &block, uint8_t replace_key) {
+		if (!block || block->empty() || overflowed) return;
+		send_segments.emplace_back();
+		send_segments.back().block = block;
+		send_segments.back().size = block->size();
+		send_segments.back().replace_key = replace_key;
+		send_queued += block->size();
+		if (net_stats) net_stats->blocks_out.add();
+		if (Log::tracing()) Log::frame(uint32_t(socket), Log::Out, block->data(), block->size());
+		queue_flush();
+		if (send_queued > check_limits_at) enforce_send_limits();
+	}
+
+	//Number of bytes queued but not yet accepted by the socket:
+	size_t queued_bytes() const { return send_queued; }
+
+	//How much may be queued (set before sending; see SendLimits):
+	void set_send_limits(SendLimits const &limits);
+	SendLimits const &send_limits() const { return limits; }
+	//Has the queue gone past send_limits().high (and not yet drained below 'low')?
+	// (callers can skip optional sends while this is true)
+	bool backpressured() const { return over_high; }
+	//Set when DropOldest dropped the newest block for some key (so the recipient is missing
+	// current state, and the sender should send it again); the sender clears it:
+	bool updates_dropped = false;
+	//Set when the queue went past the limits: everything queued was discarded, further
+	// sends are ignored, and the next poll() closes the connection (with an OnClose event):
+	bool overflowed = false;
 
 	//Call 'close' to mark a connection for discard:
 	void close();
@@ -83,23 +169,135 @@ struct Connection {
 	//so you can if(connection) ... to check for validity:
 	explicit operator bool() { return socket != InvalidSocket; }
 
-	//To send data over a connection, append it to send_buffer:
-	std::vector< char > send_buffer;
+	//Traffic on this connection so far (the owning Server/Client's NetStats has totals):
+	struct Counters {
+		uint64_t bytes_in = 0, bytes_out = 0;
+		uint64_t messages_in = 0, messages_out = 0; //(see NetStats)
+		std::chrono::steady_clock::time_point opened; //when it connected
+	} counters;
+
+	//Data appended by send/send_raw is staged in send_buffer:
+	// (don't modify it directly -- it is sent in order with shared blocks as described by send_segments)
+	RingBuffer send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< char > recv_buffer;
+	// (consume() data from the front once it has been handled; the socket reads straight into its slabs)
+	SlabBuffer recv_buffer;
 
 	//internals:
 	Socket socket = InvalidSocket;
+	NetStats *net_stats = nullptr; //owner's stats (cleared once the connection has been counted as closed)
+	std::shared_ptr< void > handoff_data; //(adopted connections) what was passed to Server::hand_off with the socket
+
+	//outbound data, in send order; flushed with a single sendmsg() per attempt:
+	struct SendSegment {
+		SharedBytes block; //nullptr => the next 'size' bytes of send_buffer
+		size_t offset = 0; //(block only) first unsent byte
+		size_t size = 0; //unsent bytes in this segment
+		uint8_t replace_key = 0; //(block only) nonzero: a later block with this key makes this one obsolete
+	};
+	//FIFO of segments in one vector, so a steady stream of sends reuses its storage instead of
+	// allocating (std::deque allocates and frees a block every few dozen segments):
+	struct SendSegments {
+		bool empty() const { return head == items.size(); }
+		size_t size() const { return items.size() - head; }
+		SendSegment &front() { return items[head]; }
+		SendSegment &back() { return items.back(); }
+		SendSegment &operator[](size_t i) { return items[head + i]; }
+		SendSegment const &operator[](size_t i) const { return items[head + i]; }
+		std::vector< SendSegment >::iterator begin() { return items.begin() + head; }
+		std::vector< SendSegment >::iterator end() { return items.end(); }
+		std::vector< SendSegment >::const_iterator begin() const { return items.begin() + head; }
+		std::vector< SendSegment >::const_iterator end() const { return items.end(); }
+
+		void emplace_back() {
+			//(slide the live segments down once the popped ones are at least half the vector)
+			if (head != 0 && head * 2 >= items.size()) {
+				items.erase(items.begin(), items.begin() + head);
+				head = 0;
+			}
+			items.emplace_back();
+		}
+		void pop_front() {
+			items[head].block.reset();
+			head += 1;
+			if (head == items.size()) clear();
+		}
+		template< typename Predicate >
+		void remove_if(Predicate const &predicate) {
+			items.erase(std::remove_if(begin(), end(), predicate), items.end());
+			if (empty()) clear();
+		}
+		void clear() { //(keeps capacity)
+			items.clear();
+			head = 0;
+		}
+	private:
+		std::vector< SendSegment > items;
+		size_t head = 0; //index of the first segment still queued
+	};
+	SendSegments send_segments;
+	size_t send_queued = 0; //total of send_segments[*].size
+	//drop the first 'bytes' of queued data (after they were sent):
+	void consume_sent(size_t bytes);
+
+	//(asynchronous backends) bytes at the front of the queue handed to a send that hasn't completed:
+	// (enforce_send_limits never drops these)
+	size_t send_inflight = 0;
+	uint32_t backend_slot = uint32_t(-1); //(io_uring) slot tracking this connection's operations
+
+	//send limits (checked when the queue grows past check_limits_at, so not on every send):
+	SendLimits limits;
+	size_t check_limits_at = size_t(-1);
+	bool over_high = false;
+	void enforce_send_limits();
+
+	//(edge-triggered backends) readiness bookkeeping:
+	bool writable = true; //socket has not reported EAGAIN since last writable edge
+	std::vector< Connection * > *flush_queue = nullptr; //owner's list of connections with pending sends
+	bool queued_for_flush = false; //already in flush_queue
+	//let the owning Server/Client know this connection has data to flush:
+	void queue_flush() {
+		if (flush_queue && !queued_for_flush) {
+			flush_queue->push_back(this);
+			queued_for_flush = true;
+		}
+	}
 
 	enum Event {
 		OnOpen,
 		OnRecv,
-		OnClose
+		OnClose,
+		OnConnectFailed, //(asynchronous Client only) an attempt to connect failed; it will try again
 	};
 };
 
+//How a Server waits for its sockets:
+enum class PollBackend : uint8_t {
+	//select(): portable, but each poll costs time per socket (and FD_SETSIZE limits how many)
+	Select,
+	//(linux) edge-triggered epoll: each socket is registered exactly once, so idle sockets cost
+	// nothing per poll; sends are still one syscall per socket
+	Epoll,
+	//(linux 6.0+) io_uring: completions instead of readiness -- one multishot accept, one multishot
+	// receive per socket (into buffers from a shared pool of provided buffers), and each poll's sends,
+	// for all sockets, handed to the kernel in a single submission
+	IoUring,
+};
+//NOTE: Client always uses epoll on linux (select elsewhere).
+
+struct IoUring; //(io_uring backend state; see Connection.cpp)
+
 struct Server {
-	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	//which backend new Servers use (epoll on linux, select elsewhere); set it before creating servers:
+	// (a backend that isn't available falls back to epoll, then select)
+	static PollBackend default_backend;
+	static char const *backend_name(PollBackend backend);
+
+	Server(std::string const &port, PollBackend backend = default_backend); //pass the port number to listen on, as a string (servname, really)
+	Server(PollBackend backend = default_backend); //server with no listen socket (gets connections via hand_off)
+	~Server();
+	Server(Server const &) = delete;
+	Server &operator=(Server const &) = delete;
 
 	//poll() updates the list of active connections and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -108,14 +306,55 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//Moving connections between servers (e.g., from an accepting thread to worker threads):
+	//detach() stops tracking a connection's socket without closing it and returns the socket:
+	// (the Connection itself is reaped at the end of the next poll; no OnClose is generated)
+	//NOTE: data the connection had queued is dropped. With io_uring, so is anything that arrived
+	// after the last poll (the kernel may already have read it), so detach only when the peer
+	// is waiting to hear back.
+	Socket detach(Connection *connection);
+	//hand_off() queues a connected socket to be adopted by this server's next poll():
+	// (may be called from any thread; the new connection generates an OnOpen event)
+	// 'data' travels with the socket and is left in the new connection's handoff_data
+	// (if the socket can't be adopted, it is closed and 'data' released, with no event)
+	void hand_off(Socket socket, std::shared_ptr< void > data = nullptr);
+
 	std::list< Connection > connections;
 	Socket listen_socket = InvalidSocket;
+	PollBackend backend = PollBackend::Select; //(what this server ended up using)
+	NetStats stats; //(stats.snapshot() may be called from any thread)
+
+	//internals:
+	void start_backend(PollBackend requested);
+	int epoll_fd = -1; //(epoll backend) epoll instance all sockets are registered with
+	std::unique_ptr< IoUring > uring; //(io_uring backend)
+	std::vector< Connection * > flush_queue; //connections that have pending sends
+	std::mutex handoff_mutex;
+	std::vector< std::pair< Socket, std::shared_ptr< void > > > handoff; //sockets (and their data) waiting to be adopted (guarded by handoff_mutex)
+	std::atomic< bool > handoff_pending{false}; //handoff is (probably) not empty
 };
 
 
 struct Client {
+	//connect to host:port, blocking until connected (throws if that fails):
 	Client(std::string const &host, std::string const &port);
 
+	//Connect to host:port without blocking: the constructor returns right away, and poll() drives
+	// the connection -- resolving 'host' (on a helper thread), then connecting to each of its
+	// addresses in turn. If none of them answers, the attempt fails and a new one starts after a
+	// delay that doubles each time. poll() generates OnConnectFailed after each failed attempt,
+	// OnOpen once connected, and OnClose if it gives up. (Data sent before then waits in the queue.)
+	struct Retry {
+		double initial_delay = 0.5; //seconds to wait before the second attempt
+		double max_delay = 8.0; //longest wait between attempts
+		uint32_t max_attempts = 0; //give up after this many attempts (0: never)
+		double connect_timeout = 5.0; //seconds to wait for each address to answer
+	};
+	Client(std::string const &host, std::string const &port, Retry const &retry);
+	~Client();
+	Client(Client const &) = delete;
+	Client &operator=(Client const &) = delete;
+
 	//poll() checks the status of the active connection and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
 	void poll(
@@ -125,4 +364,41 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+	NetStats stats; //(stats.snapshot() may be called from any thread)
+
+	//connection progress (always Connected after the blocking constructor):
+	enum State : uint8_t {
+		Resolving, //looking up 'host'
+		Connecting, //waiting for one of its addresses to answer
+		Waiting, //attempt failed; next one starts at 'next_attempt'
+		Connected,
+		GaveUp, //max_attempts failed
+	};
+	State state = Connected;
+	uint32_t attempt = 0; //attempts started so far
+	std::string error; //why the last attempt (or address) failed
+	std::chrono::steady_clock::time_point next_attempt; //(Waiting) when the next attempt starts
+	std::string host, port;
+
+	//internals:
+	int epoll_fd = -1; //(linux only) epoll instance the connection is registered with
+	std::vector< Connection * > flush_queue; //connections that have pending sends
+
+	//(asynchronous connection)
+	Retry retry;
+	struct Address {
+		std::array< char, 128 > storage; //(a sockaddr_storage)
+		uint32_t size = 0;
+		int family = 0, type = 0, protocol = 0;
+	};
+	struct Resolution; //shared with the resolver thread
+	std::shared_ptr< Resolution > resolution;
+	std::vector< Address > addresses;
+	size_t next_address = 0;
+	Socket pending = InvalidSocket; //socket waiting for its connect() to finish
+	std::chrono::steady_clock::time_point pending_deadline;
+	void start_attempt();
+	bool connect_next_address();
+	void connect_step(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout);
+	void fail_attempt(std::function< void(Connection *, Connection::Event event) > const &on_event);
 };
@@ -0,0 +1,82 @@
+#include "LineRuns.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+LineRuns::LineRuns(int width, int win_length) : W(width), K(win_length), stride(width + 2) {
+	if (W <= 0 || W > 0xfffe) throw std::runtime_error("LineRuns board width must be in 1 .. 65534.");
+	if (K <= 0) throw std::runtime_error("LineRuns win length must be positive.");
+	step = {1, stride, stride + 1, stride - 1};
+	owner.assign(size_t(stride) * stride, 0);
+	run.assign(owner.size() * 4, 0);
+	counts.assign(size_t(PLAYER_NUM) * (K + 1), 0);
+}
+
+void LineRuns::count_run(int player, int length, int32_t delta) {
+	if (length == 0) return;
+	counts[size_t(player - 1) * (K + 1) + std::min(length, K)] += delta;
+}
+
+int LineRuns::place(int x, int y, int player) {
+	assert(x >= 0 && x < W && y >= 0 && y < W);
+	assert(player >= 1 && player <= PLAYER_NUM);
+	size_t cell = index(x, y);
+	assert(owner[cell] == 0);
+	owner[cell] = uint8_t(player);
+
+	Move move;
+	move.cell = cell;
+	int longest = 0;
+	for (int d = 0; d < 4; ++d) {
+		size_t s = size_t(step[d]);
+		//border cells are never owned, so neither neighbor lookup can leave the array:
+		uint16_t before = (owner[cell - s] == player ? run[(cell - s) * 4 + d] : 0);
+		uint16_t after = (owner[cell + s] == player ? run[(cell + s) * 4 + d] : 0);
+		uint16_t length = uint16_t(before + after + 1);
+
+		count_run(player, before, -1);
+		count_run(player, after, -1);
+		count_run(player, length, +1);
+
+		//only the ends of the merged run need its new length:
+		run[(cell - before * s) * 4 + d] = length;
+		run[(cell + after * s) * 4 + d] = length;
+
+		move.before[d] = before;
+		move.after[d] = after;
+		longest = std::max< int >(longest, length);
+	}
+	history.emplace_back(move);
+	return longest;
+}
+
+void LineRuns::undo() {
+	assert(!history.empty());
+	Move const &move = history.back();
+	size_t cell = move.cell;
+	int player = owner[cell];
+
+	for (int d = 0; d < 4; ++d) {
+		size_t s = size_t(step[d]);
+		uint16_t before = move.before[d];
+		uint16_t after = move.after[d];
+
+		count_run(player, before + after + 1, -1);
+		count_run(player, before, +1);
+		count_run(player, after, +1);
+
+		//restore the ends of the two runs the piece had joined:
+		if (before) {
+			run[(cell - before * s) * 4 + d] = before;
+			run[(cell - s) * 4 + d] = before;
+		}
+		if (after) {
+			run[(cell + s) * 4 + d] = after;
+			run[(cell + after * s) * 4 + d] = after;
+		}
+		run[cell * 4 + d] = 0;
+	}
+	owner[cell] = 0;
+	history.pop_back();
+}
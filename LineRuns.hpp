@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * LineRuns tracks, for a board of any size, the runs of same-player pieces
+ * along each of the four line directions, updating them incrementally as
+ * pieces are placed (and taken back) instead of rescanning the board.
+ *
+ * Each run's length is stored at both of its end cells (per direction); a new
+ * piece joins at most one run on each side, so placing it only rewrites the
+ * two outer ends of the merged run -- O(1) per move regardless of board size.
+ * Per-player counts of runs by length are kept alongside, so whole-board
+ * questions ("has anyone won?", "how many open threes?") are O(1) too.
+ *
+ * undo() takes back the most recent place(), which makes this suitable for
+ * move search (place, evaluate, undo).
+ */
+
+#include "ChessBoardData.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct LineRuns {
+	//'width' x 'width' board; a line of 'win_length' pieces wins:
+	LineRuns(int width, int win_length = NUM_PIECE_TO_WIN);
+
+	int width() const { return W; }
+	int win_length() const { return K; }
+
+	//player at (x, y) -- board indices 0 .. width-1 -- or 0 if it is empty:
+	int at(int x, int y) const { return owner[index(x, y)]; }
+
+	//put player's piece (1 .. PLAYER_NUM) on empty cell (x, y).
+	// returns the length of the longest line through the new piece:
+	int place(int x, int y, int player);
+	//take back the most recent place():
+	void undo();
+	//number of pieces placed (and not taken back):
+	size_t moves() const { return history.size(); }
+
+	//does 'player' have a line of at least win_length pieces?
+	bool has_line(int player) const { return runs(player, K) != 0; }
+	//number of runs (counting each direction separately) of exactly 'length' pieces
+	// -- or, with length == win_length, of at least that many:
+	uint32_t runs(int player, int length) const { return counts[size_t(player - 1) * (K + 1) + length]; }
+
+private:
+	int W; //board width
+	int K; //win length
+	int stride; //W plus a one-cell empty border (cells are stored with a border all around, so runs stop there)
+	std::array< int, 4 > step; //index offsets for the four directions
+
+	size_t index(int x, int y) const { return size_t(x + 1) * stride + (y + 1); }
+	void count_run(int player, int length, int32_t delta);
+
+	std::vector< uint8_t > owner; //player at each (bordered) cell
+	std::vector< uint16_t > run; //[cell * 4 + dir] -- length of the run ending at this cell (only valid at run ends)
+	std::vector< uint32_t > counts; //[(player - 1) * (K + 1) + min(length, K)]
+
+	//what each place() joined, so undo() can split the runs back apart:
+	struct Move {
+		size_t cell;
+		std::array< uint16_t, 4 > before; //length of the run the piece extended on the negative side
+		std::array< uint16_t, 4 > after; //...and on the positive side
+	};
+	std::vector< Move > history;
+};
@@ -0,0 +1,314 @@
+#include "Log.hpp"
+
+#include "hex_dump.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+std::atomic< uint8_t > Log::threshold{Log::Info};
+std::atomic< bool > Log::trace_on{false};
+
+namespace {
+	struct Record {
+		enum Kind : uint8_t { Text, Bytes, Frame } kind = Text;
+		Log::Level level = Log::Info;
+		Log::Direction direction = Log::In;
+		uint32_t stream = 0; //(frames)
+		int64_t time = 0; //unix time, in microseconds
+		std::string label; //(bytes)
+		std::string data; //text, or raw bytes
+	};
+
+	int64_t now_us() {
+		return int64_t(std::chrono::duration_cast< std::chrono::microseconds >(std::chrono::system_clock::now().time_since_epoch()).count());
+	}
+
+	//bounded multi-producer queue: each cell's sequence number says whether it is free for the
+	// producer claiming position 'pos' (== pos) or holds a record for the consumer (== pos + 1):
+	struct Queue {
+		static constexpr size_t Capacity = 8192; //(power of two)
+		struct Cell {
+			std::atomic< size_t > sequence;
+			Record record;
+		};
+		std::unique_ptr< Cell[] > cells;
+		alignas(64) std::atomic< size_t > enqueue_pos{0};
+		alignas(64) size_t dequeue_pos = 0; //(writer thread only)
+
+		Queue() : cells(new Cell[Capacity]) {
+			for (size_t i = 0; i < Capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		//returns false (leaving 'record' alone) if full:
+		bool push(Record &&record) {
+			size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+			while (true) {
+				Cell &cell = cells[pos & (Capacity - 1)];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+				if (diff == 0) {
+					if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						cell.record = std::move(record);
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+					//(lost the race for this cell; 'pos' now holds the current position)
+				} else if (diff < 0) {
+					return false; //full
+				} else {
+					pos = enqueue_pos.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool pop(Record *record) {
+			Cell &cell = cells[dequeue_pos & (Capacity - 1)];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (sequence != dequeue_pos + 1) return false; //empty (or the producer hasn't finished)
+			*record = std::move(cell.record);
+			cell.record.label.clear();
+			cell.record.data.clear();
+			cell.sequence.store(dequeue_pos + Capacity, std::memory_order_release);
+			dequeue_pos += 1;
+			return true;
+		}
+	};
+
+	struct Writer {
+		Queue queue;
+		std::atomic< uint64_t > written{0}; //records handled (so flush() can wait for them)
+		std::atomic< uint64_t > dropped{0};
+		std::atomic< bool > stop{false};
+
+		std::mutex trace_mutex; //(guards 'trace'; only taken by trace_to / stop_trace and the writer thread)
+		std::unique_ptr< std::ofstream > trace;
+
+		std::thread thread;
+
+		Writer() : thread(&Writer::run, this) { }
+		~Writer();
+
+		void run();
+		void write(Record const &record);
+	};
+
+	std::atomic< bool > writer_gone{false}; //(records logged during program exit are written directly)
+
+	Writer &writer() {
+		static Writer writer;
+		return writer;
+	}
+
+	Writer::~Writer() {
+		stop.store(true, std::memory_order_release);
+		thread.join();
+		writer_gone = true;
+	}
+
+	void Writer::run() {
+		while (true) {
+			bool stopping = stop.load(std::memory_order_acquire); //(read first, so everything queued before stop is still written)
+			size_t handled = 0;
+			Record record;
+			{
+				std::lock_guard< std::mutex > lock(trace_mutex);
+				while (queue.pop(&record)) {
+					write(record);
+					handled += 1;
+				}
+				if (handled && trace) trace->flush();
+			}
+			if (handled) {
+				std::fflush(stdout);
+				written.fetch_add(handled, std::memory_order_release);
+			}
+			if (stopping) break;
+			if (!handled) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+	}
+
+	void write_prefix(std::ostream &out, Log::Level level, int64_t time) {
+		std::time_t seconds = std::time_t(time / 1000000);
+		std::tm local;
+		#ifdef _WIN32
+		localtime_s(&local, &seconds);
+		#else
+		localtime_r(&seconds, &local);
+		#endif
+		out << std::put_time(&local, "%H:%M:%S") << '.' << std::setw(3) << std::setfill('0') << (time / 1000) % 1000 << std::setfill(' ')
+		    << " [" << Log::level_name(level) << "] ";
+	}
+
+	//(called with trace_mutex held)
+	void Writer::write(Record const &record) {
+		if (record.kind == Record::Frame) {
+			if (!trace) return; //(tracing stopped after this was queued)
+			Log::FrameHeader header;
+			header.time = record.time;
+			header.stream = record.stream;
+			header.direction = record.direction;
+			header.size = uint32_t(record.data.size());
+			trace->write(reinterpret_cast< char const * >(&header), sizeof(header));
+			trace->write(record.data.data(), record.data.size());
+			return;
+		}
+		//(formatted aside and written with stdio, so the writer never touches std::cout's
+		// formatting state -- which other threads' prints may be changing)
+		std::ostringstream out;
+		write_prefix(out, record.level, record.time);
+		if (record.kind == Record::Text) {
+			out << record.data << '\n';
+		} else {
+			out << record.label << " (" << record.data.size() << " bytes):\n" << hex_dump(record.data.data(), record.data.size());
+		}
+		std::string formatted = out.str();
+		std::fwrite(formatted.data(), 1, formatted.size(), (record.level >= Log::Warn ? stderr : stdout));
+	}
+
+	void enqueue(Record &&record) {
+		if (writer_gone) {
+			//(program is exiting; no writer thread to hand this to)
+			if (record.kind == Record::Text) {
+				std::cerr << "[" << Log::level_name(record.level) << "] " << record.data << std::endl;
+			} else if (record.kind == Record::Bytes) {
+				std::cerr << "[" << Log::level_name(record.level) << "] " << record.label << ":\n" << hex_dump(record.data.data(), record.data.size()) << std::flush;
+			}
+			return;
+		}
+		Writer &w = writer();
+		if (!w.queue.push(std::move(record))) w.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	//apply LOG_LEVEL / LOG_TRACE from the environment at startup:
+	struct FromEnvironment {
+		FromEnvironment() {
+			if (char const *level = std::getenv("LOG_LEVEL")) {
+				Log::Level parsed;
+				if (Log::parse_level(level, &parsed)) Log::set_level(parsed);
+				else std::cerr << "Ignoring LOG_LEVEL='" << level << "' (expecting debug, info, warn, error, or off)." << std::endl;
+			}
+			if (char const *path = std::getenv("LOG_TRACE")) {
+				try {
+					Log::trace_to(path);
+				} catch (std::exception const &e) {
+					std::cerr << "Not tracing (LOG_TRACE): " << e.what() << std::endl;
+				}
+			}
+		}
+	} from_environment;
+}
+
+char const *Log::level_name(Level level) {
+	if (level == Debug) return "debug";
+	if (level == Info) return "info";
+	if (level == Warn) return "warn";
+	if (level == Error) return "error";
+	return "off";
+}
+
+bool Log::parse_level(std::string const &name, Level *level) {
+	for (uint8_t l = Debug; l <= Off; ++l) {
+		if (name == level_name(Level(l))) {
+			*level = Level(l);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Log::set_level(Level level) {
+	threshold.store(uint8_t(level), std::memory_order_relaxed);
+}
+
+void Log::text(Level level, std::string &&line) {
+	Record record;
+	record.kind = Record::Text;
+	record.level = level;
+	record.time = now_us();
+	record.data = std::move(line);
+	enqueue(std::move(record));
+}
+
+void Log::bytes(Level level, char const *label, void const *data, size_t size) {
+	Record record;
+	record.kind = Record::Bytes;
+	record.level = level;
+	record.time = now_us();
+	record.label = label;
+	record.data.assign(reinterpret_cast< char const * >(data), size);
+	enqueue(std::move(record));
+}
+
+void Log::trace_to(std::string const &path) {
+	auto file = std::make_unique< std::ofstream >(path, std::ios::binary | std::ios::trunc);
+	if (!*file) throw std::runtime_error("failed to open trace file '" + path + "': " + std::string(strerror(errno)));
+	FileHeader header;
+	file->write(reinterpret_cast< char const * >(&header), sizeof(header));
+
+	Writer &w = writer();
+	std::lock_guard< std::mutex > lock(w.trace_mutex);
+	w.trace = std::move(file);
+	trace_on.store(true, std::memory_order_relaxed);
+}
+
+void Log::stop_trace() {
+	trace_on.store(false, std::memory_order_relaxed);
+	flush(); //(frames already queued go to the file being closed)
+	Writer &w = writer();
+	std::lock_guard< std::mutex > lock(w.trace_mutex);
+	w.trace.reset();
+}
+
+void Log::frame(uint32_t stream, Direction direction, void const *data, size_t size) {
+	Record record;
+	record.kind = Record::Frame;
+	record.direction = direction;
+	record.stream = stream;
+	record.time = now_us();
+	record.data.assign(reinterpret_cast< char const * >(data), size);
+	enqueue(std::move(record));
+}
+
+bool Log::read_trace(std::istream &from, std::function< void(FrameHeader const &, std::vector< char > const &) > const &frame) {
+	FileHeader expected, header;
+	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))
+	 || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+		throw std::runtime_error("not a trace file");
+	}
+	if (header.version != expected.version) {
+		throw std::runtime_error("unsupported trace version " + std::to_string(header.version));
+	}
+	std::vector< char > data;
+	while (true) {
+		FrameHeader at;
+		from.read(reinterpret_cast< char * >(&at), sizeof(at));
+		if (from.gcount() == 0) return true; //(clean end)
+		if (size_t(from.gcount()) != sizeof(at)) return false;
+		data.resize(at.size);
+		if (!from.read(data.data(), data.size())) return false;
+		frame(at, data);
+	}
+}
+
+void Log::flush() {
+	if (writer_gone) return;
+	Writer &w = writer();
+	uint64_t target = w.queue.enqueue_pos.load(std::memory_order_acquire);
+	while (w.written.load(std::memory_order_acquire) < target) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+uint64_t Log::dropped() {
+	return writer_gone ? 0 : writer().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * Log is a leveled logger whose output is written by a background thread:
+ *
+ *  LOG(Info, "room " << id << " opened");           //a line of text
+ *  LOG_BYTES(Debug, "got bytes", data, size);        //a hex dump (see hex_dump.hpp)
+ *
+ * Below the current level (Log::set_level, or the LOG_LEVEL environment
+ * variable; Info by default) a LOG statement is one relaxed load and a branch
+ * -- its arguments are never evaluated. Levels below LOG_MIN_LEVEL (define it
+ * when compiling) are compiled out entirely.
+ *
+ * Enabled statements put a record on a bounded lock-free queue and return;
+ * the writer thread formats records (hex dumps included) and writes them.
+ * If the queue is full the record is dropped (and counted) rather than making
+ * the caller wait. Text is formatted by the caller; bytes are just copied.
+ *
+ * Binary trace: Log::trace_to(path) (or the LOG_TRACE environment variable)
+ * also writes every message frame received -- and every message or shared
+ * block queued for sending -- to a file, raw, for decoding later with
+ * read_trace() (the trace-dump tool prints one with hex_dump).
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Log {
+	enum Level : uint8_t {
+		Debug,
+		Info,
+		Warn,
+		Error,
+		Off,
+	};
+	static char const *level_name(Level level);
+	//parse "debug", "info", "warn", "error", or "off" (returns false otherwise):
+	static bool parse_level(std::string const &name, Level *level);
+
+	static void set_level(Level level);
+	static bool enabled(Level level) { return uint8_t(level) >= threshold.load(std::memory_order_relaxed); }
+
+	//queue a line of text:
+	static void text(Level level, std::string &&line);
+	//queue a hex dump of 'size' bytes, headed by 'label' (bytes are copied now, formatted later):
+	static void bytes(Level level, char const *label, void const *data, size_t size);
+
+	//---- binary trace ----
+	enum Direction : uint8_t { In = 0, Out = 1 };
+
+	//trace file layout: FileHeader, then (FrameHeader, 'size' bytes of frame) per frame:
+	struct FileHeader {
+		char magic[4] = {'n', 't', 'r', 'c'};
+		uint32_t version = 1;
+	};
+	static_assert(sizeof(FileHeader) == 8, "FileHeader is packed.");
+	struct FrameHeader {
+		int64_t time = 0; //unix time, in microseconds
+		uint32_t stream = 0; //which connection (its socket)
+		uint8_t direction = In;
+		uint8_t padding[3] = {0, 0, 0};
+		uint32_t size = 0; //bytes of frame that follow
+		uint32_t padding2 = 0;
+	};
+	static_assert(sizeof(FrameHeader) == 24, "FrameHeader is packed.");
+
+	//start writing frames to 'path' (replacing any trace file already open; throws on failure):
+	static void trace_to(std::string const &path);
+	//stop tracing (frames already queued are still written):
+	static void stop_trace();
+	static bool tracing() { return trace_on.load(std::memory_order_relaxed); }
+	//queue one frame (the caller checks tracing() first, so untraced frames cost nothing):
+	static void frame(uint32_t stream, Direction direction, void const *data, size_t size);
+
+	//read every frame of a trace, calling 'frame' for each (throws on a file that isn't a trace):
+	// (a last frame cut short -- e.g., by a crash -- is reported by returning false)
+	static bool read_trace(std::istream &from, std::function< void(FrameHeader const &, std::vector< char > const &) > const &frame);
+
+	//wait for everything queued so far to be written:
+	static void flush();
+
+	//records dropped because the queue was full:
+	static uint64_t dropped();
+
+	//(internals)
+	static std::atomic< uint8_t > threshold;
+	static std::atomic< bool > trace_on;
+};
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL Log::Debug
+#endif
+
+#define LOG(LEVEL, ARGS) \
+	do { \
+		if (Log::LEVEL >= LOG_MIN_LEVEL && Log::enabled(Log::LEVEL)) { \
+			std::ostringstream log_line_; \
+			log_line_ << ARGS; \
+			Log::text(Log::LEVEL, log_line_.str()); \
+		} \
+	} while (0)
+
+#define LOG_BYTES(LEVEL, LABEL, DATA, SIZE) \
+	do { \
+		if (Log::LEVEL >= LOG_MIN_LEVEL && Log::enabled(Log::LEVEL)) Log::bytes(Log::LEVEL, (LABEL), (DATA), (SIZE)); \
+	} while (0)
@@ -0,0 +1,73 @@
+#include "Matchmaker.hpp"
+
+#include <cassert>
+
+Matchmaker::Matchmaker(size_t match_size_, double max_wait_) : match_size(match_size_), partial_matches(max_wait_ >= 0.0) {
+	assert(match_size >= 1);
+	max_wait = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(partial_matches ? max_wait_ : 0.0));
+}
+
+void Matchmaker::enqueue(Connection *c, Clock::time_point now) {
+	assert(c);
+	uint64_t ticket = next_ticket++;
+	//(enqueuing a connection that is already waiting sends it to the back -- counted as leaving and joining again)
+	auto inserted = index.emplace(c, ticket);
+	if (!inserted.second) {
+		inserted.first->second = ticket;
+		left += 1;
+	}
+	Entry entry;
+	entry.connection = c;
+	entry.ticket = ticket;
+	entry.since = now;
+	queue.emplace_back(entry);
+	joined += 1;
+}
+
+bool Matchmaker::remove(Connection *c) {
+	if (index.erase(c) == 0) return false;
+	left += 1;
+	//(the queue entry is dropped when form() gets to it)
+	return true;
+}
+
+bool Matchmaker::live(Entry const &entry) const {
+	auto f = index.find(entry.connection);
+	return f != index.end() && f->second == entry.ticket;
+}
+
+void Matchmaker::form(Clock::time_point now, MatchFn const &match) {
+	auto hand_over = [&]() {
+		players.clear();
+		for (auto const &entry : group) {
+			index.erase(entry.connection);
+			players.emplace_back(entry.connection);
+			time_to_match.add(std::chrono::duration< double >(now - entry.since).count());
+		}
+		Clock::time_point since = group.front().since;
+		matched += group.size();
+		(group.size() == match_size ? full : partial) += 1;
+		group.clear();
+		match(players, since);
+	};
+
+	group.clear();
+	while (!queue.empty()) {
+		Entry entry = queue.front();
+		queue.pop_front();
+		if (!live(entry)) continue;
+		group.emplace_back(entry);
+		if (group.size() == match_size) hand_over();
+	}
+
+	//not enough for a full match -- the oldest may have waited long enough for a smaller one:
+	if (!group.empty()) {
+		if (partial_matches && now - group.front().since >= max_wait) {
+			hand_over();
+		} else {
+			//(back to the front of the queue, in order)
+			for (auto e = group.rbegin(); e != group.rend(); ++e) queue.emplace_front(*e);
+			group.clear();
+		}
+	}
+}
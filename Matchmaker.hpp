@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * Matchmaker keeps the queue of connections waiting to play and forms them
+ * into matches -- match_size players at a time, in the order they arrived.
+ * Whoever has waited max_wait seconds without a full match is matched
+ * anyway, in a smaller group (the room seats bots in the empty seats).
+ *
+ * Each match's players are handed over in queue order, so seats are given
+ * out in that order too: players[0] gets seat 1, players[1] seat 2, ...
+ *
+ * Leaving the queue is O(1): the index forgets the connection, and its
+ * queue entry is skipped the next time matches are formed.
+ *
+ * A Matchmaker belongs to one shard and is only used from its thread; the
+ * stats are atomics so they can be read (e.g., printed) from any thread.
+ */
+
+#include "Connection.hpp"
+#include "TickScheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+struct Matchmaker {
+	typedef std::chrono::steady_clock Clock;
+
+	//max_wait < 0: never form smaller matches
+	Matchmaker(size_t match_size, double max_wait);
+
+	//add a connection to the back of the queue:
+	void enqueue(Connection *c, Clock::time_point now = Clock::now());
+	//take a connection out of the queue (returns false if it wasn't waiting):
+	bool remove(Connection *c);
+	bool waiting(Connection *c) const { return index.count(c) != 0; }
+	size_t size() const { return index.size(); }
+
+	//form as many matches as the queue allows, calling 'match' for each with its players
+	// (in queue order) and when the first of them started waiting:
+	typedef std::function< void(std::vector< Connection * > const &players, Clock::time_point waiting_since) > MatchFn;
+	void form(Clock::time_point now, MatchFn const &match);
+
+	size_t match_size;
+	Clock::duration max_wait;
+	bool partial_matches; //(false if max_wait < 0)
+
+	//stats:
+	std::atomic< uint64_t > joined{0}; //connections queued
+	std::atomic< uint64_t > left{0}; //connections that left the queue before being matched
+	std::atomic< uint64_t > matched{0}; //connections handed to 'match'
+	// (so joined - left - matched are waiting)
+	std::atomic< uint64_t > full{0}; //matches of match_size players
+	std::atomic< uint64_t > partial{0}; //smaller matches (after max_wait)
+	TickScheduler::AtomicHistogram time_to_match; //from enqueue() to being handed to 'match'
+
+private:
+	struct Entry {
+		Connection *connection = nullptr;
+		uint64_t ticket = 0; //(stale if index doesn't map connection to this)
+		Clock::time_point since;
+	};
+	std::deque< Entry > queue;
+	std::unordered_map< Connection *, uint64_t > index; //ticket of each waiting connection
+	uint64_t next_ticket = 1;
+
+	std::vector< Entry > group; //(scratch space for form())
+	std::vector< Connection * > players; //(scratch space for form())
+
+	bool live(Entry const &entry) const;
+};
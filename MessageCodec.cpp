@@ -0,0 +1,86 @@
+#include "MessageCodec.hpp"
+
+#include <cassert>
+
+static void write_header(uint8_t type, size_t size, uint8_t header[MessageHeaderSize]) {
+	assert(size <= MaxMessagePayload);
+	header[0] = type;
+	header[1] = uint8_t(size >> 16);
+	header[2] = uint8_t((size >> 8) % 256);
+	header[3] = uint8_t(size % 256);
+}
+
+void send_message_header(Connection &connection, uint8_t type, size_t size) {
+	uint8_t header[MessageHeaderSize];
+	write_header(type, size, header);
+	connection.send_raw(header, MessageHeaderSize);
+	connection.counters.messages_out += 1;
+	if (connection.net_stats) connection.net_stats->messages_out.add();
+}
+
+void send_message(Connection &connection, uint8_t type, void const *data, size_t size) {
+	send_message_header(connection, type, size);
+	connection.send_raw(data, size);
+	if (Log::tracing()) {
+		SharedBytes frame = encode_message(type, data, size);
+		Log::frame(uint32_t(connection.socket), Log::Out, frame->data(), frame->size());
+	}
+}
+
+SharedBytes encode_message(uint8_t type, void const *data, size_t size) {
+	auto block = std::make_shared< std::vector< char > >(MessageHeaderSize + size);
+	write_header(type, size, reinterpret_cast< uint8_t * >(block->data()));
+	if (size) std::memcpy(block->data() + MessageHeaderSize, data, size);
+	return block;
+}
+
+void append_message(std::vector< char > *block, uint8_t type, void const *data, size_t size) {
+	assert(block);
+	size_t at = block->size();
+	block->resize(at + MessageHeaderSize + size);
+	write_header(type, size, reinterpret_cast< uint8_t * >(block->data() + at));
+	if (size) std::memcpy(block->data() + at + MessageHeaderSize, data, size);
+}
+
+bool peek_message(SlabBuffer &buffer, MessageView *out) {
+	assert(out);
+	if (buffer.size() < MessageHeaderSize) return false;
+
+	out->type = uint8_t(buffer[0]);
+	out->size = (size_t(uint8_t(buffer[1])) << 16) | (size_t(uint8_t(buffer[2])) << 8) | size_t(uint8_t(buffer[3]));
+	if (buffer.size() < MessageHeaderSize + out->size) {
+		out->data = nullptr;
+		return false;
+	}
+	out->data = buffer.contiguous(MessageHeaderSize + out->size) + MessageHeaderSize;
+	return true;
+}
+
+MessageDispatcher::Status MessageDispatcher::dispatch(Connection *connection) {
+	assert(connection);
+	SlabBuffer &buffer = connection->recv_buffer;
+	while (true) {
+		MessageView message;
+		bool complete = peek_message(buffer, &message);
+		if (buffer.size() < MessageHeaderSize) break; //header not here yet
+
+		if (!handlers[message.type]) {
+			bad_type = message.type;
+			return UnknownType;
+		}
+		if (message.size > max_payload) {
+			bad_type = message.type;
+			return TooLarge;
+		}
+		if (!complete) break; //rest of message not here yet
+
+		connection->counters.messages_in += 1;
+		if (connection->net_stats) connection->net_stats->messages_in.add();
+		if (Log::tracing()) Log::frame(uint32_t(connection->socket), Log::In, message.data - MessageHeaderSize, MessageHeaderSize + message.size);
+		handlers[message.type](connection, message);
+		if (!*connection) break; //handler closed the connection
+
+		buffer.consume(MessageHeaderSize + message.size);
+	}
+	return Ok;
+}
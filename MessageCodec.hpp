@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * Length-prefixed message framing for Connection byte streams.
+ *
+ * Every message on the wire is:
+ * |ty|sz|sz|sz| <-- one byte message type, 24-bit (big endian) payload size
+ * |payload...| <-- 'size' bytes of payload
+ *
+ * Senders use send_message (or send_message_header followed by the payload,
+ * possibly split across send_raw / send_shared calls); receivers register a
+ * handler per message type with a MessageDispatcher and call dispatch() when
+ * a connection receives data.
+ */
+
+#include "Connection.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+constexpr size_t MessageHeaderSize = 4;
+constexpr size_t MaxMessagePayload = 0xffffff; //largest size representable in the 24-bit size field
+
+//A complete message, viewed in place in a receive buffer:
+// (only valid until that buffer is next consumed or appended to)
+struct MessageView {
+	uint8_t type = 0;
+	char const *data = nullptr; //payload
+	size_t size = 0; //payload size
+
+	//copy a fixed-size value out of the payload at 'offset'; returns false if it would read past the end:
+	template< typename T >
+	bool read(size_t offset, T *out) const {
+		if (offset + sizeof(T) > size) return false;
+		std::memcpy(out, data + offset, sizeof(T));
+		return true;
+	}
+};
+
+//write just a message header (payload must be sent next, with exactly 'size' bytes):
+void send_message_header(Connection &connection, uint8_t type, size_t size);
+//write a complete message:
+void send_message(Connection &connection, uint8_t type, void const *data, size_t size);
+//encode a complete message into a block that can be queued on many connections with send_shared:
+SharedBytes encode_message(uint8_t type, void const *data, size_t size);
+//append a complete message to a block being built (so several messages can be shared as one block):
+void append_message(std::vector< char > *block, uint8_t type, void const *data, size_t size);
+
+//If the front of 'buffer' holds a complete message, point 'out' at it and return true.
+// (consume MessageHeaderSize + out->size bytes from the buffer when done with it)
+//If only part of a message has arrived, returns false; once the header is there,
+// out->type and out->size are still filled in so callers can reject bad messages early.
+bool peek_message(SlabBuffer &buffer, MessageView *out);
+
+//Table of per-type message handlers:
+struct MessageDispatcher {
+	typedef std::function< void(Connection *, MessageView const &) > Handler;
+
+	//register (or replace, or -- with nullptr -- remove) the handler for a message type:
+	void on(uint8_t type, Handler const &handler) { handlers[type] = handler; }
+
+	enum Status {
+		Ok, //all complete messages handled (a partial message may remain buffered)
+		UnknownType, //message type with no handler; 'bad_type' says which
+		TooLarge, //message payload larger than max_payload
+	};
+	//handle every complete message in connection->recv_buffer, consuming each after its handler runs.
+	// stops early (leaving the offending message buffered) on error or if a handler closes the connection:
+	Status dispatch(Connection *connection);
+
+	std::array< Handler, 256 > handlers;
+	size_t max_payload = MaxMessagePayload;
+	uint8_t bad_type = 0; //type of message that caused the last non-Ok status
+};
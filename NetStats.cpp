@@ -0,0 +1,102 @@
+#include "NetStats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+char const *NetStats::cause_name(Cause cause) {
+	if (cause == PeerClosed) return "peer_closed";
+	if (cause == RecvError) return "recv_error";
+	if (cause == SendError) return "send_error";
+	if (cause == Overflow) return "overflow";
+	if (cause == Local) return "local";
+	if (cause == Detached) return "detached";
+	return "unknown";
+}
+
+NetStats::Snapshot NetStats::snapshot() const {
+	Snapshot ret;
+	ret.bytes_in = bytes_in.load();
+	ret.bytes_out = bytes_out.load();
+	ret.messages_in = messages_in.load();
+	ret.messages_out = messages_out.load();
+	ret.blocks_out = blocks_out.load();
+	ret.polls = polls.load();
+	ret.syscalls = syscalls.load();
+	ret.wait_time = wait_time.load();
+	ret.work_time = work_time.load();
+	ret.flush_queue = flush_queue.load();
+	ret.flush_queue_max = flush_queue_max.load();
+	ret.send_queue_max = send_queue_max.load();
+	ret.recv_queue_max = recv_queue_max.load();
+	ret.opened = opened.load();
+	for (size_t i = 0; i < CauseCount; ++i) ret.closed[i] = closed[i].load();
+	ret.lifetime = lifetime.load();
+	return ret;
+}
+
+uint64_t NetStats::Snapshot::open() const {
+	uint64_t total = 0;
+	for (uint64_t c : closed) total += c;
+	//(counters are read one at a time, so a connection may be counted closed before it's counted opened)
+	return opened > total ? opened - total : 0;
+}
+
+NetStats::Snapshot &NetStats::Snapshot::operator+=(Snapshot const &other) {
+	bytes_in += other.bytes_in;
+	bytes_out += other.bytes_out;
+	messages_in += other.messages_in;
+	messages_out += other.messages_out;
+	blocks_out += other.blocks_out;
+	polls += other.polls;
+	syscalls += other.syscalls;
+	wait_time += other.wait_time;
+	work_time += other.work_time;
+	flush_queue += other.flush_queue;
+	flush_queue_max = std::max(flush_queue_max, other.flush_queue_max);
+	send_queue_max = std::max(send_queue_max, other.send_queue_max);
+	recv_queue_max = std::max(recv_queue_max, other.recv_queue_max);
+	opened += other.opened;
+	for (size_t i = 0; i < CauseCount; ++i) closed[i] += other.closed[i];
+	lifetime += other.lifetime;
+	return *this;
+}
+
+void NetStats::Snapshot::print(std::ostream &out) const {
+	auto ms = [](double seconds) { return seconds * 1e3; };
+	auto line = [&](char const *name, TickScheduler::Histogram const &h) {
+		out << "  " << std::setw(10) << std::left << name << std::right
+		    << " p50 <=" << ms(h.percentile(0.5)) << "ms, p99 <=" << ms(h.percentile(0.99)) << "ms, max " << ms(h.max) << "ms\n";
+	};
+	out << "  traffic: " << bytes_in << " bytes in, " << bytes_out << " bytes out; " << messages_in << " messages in, "
+	    << messages_out << " messages + " << blocks_out << " shared blocks out\n";
+	out << "  polls: " << polls << ", " << syscalls << " syscalls (" << (polls ? double(syscalls) / double(polls) : 0.0) << " per poll)\n";
+	line("wait", wait_time);
+	line("work", work_time);
+	out << "  queues: " << flush_queue << " connections waiting to send (max " << flush_queue_max << "); largest send queue "
+	    << send_queue_max << " bytes, largest receive queue " << recv_queue_max << " bytes\n";
+	out << "  connections: " << open() << " open, " << opened << " opened; closed:";
+	for (size_t i = 0; i < CauseCount; ++i) out << " " << cause_name(Cause(i)) << " " << closed[i];
+	out << "\n";
+	out << "  " << std::setw(10) << std::left << "lifetime" << std::right
+	    << " p50 <=" << lifetime.percentile(0.5) << "s, p99 <=" << lifetime.percentile(0.99) << "s, max " << lifetime.max << "s\n";
+}
+
+void NetStats::Snapshot::print_json(std::ostream &out) const {
+	auto histogram = [&](char const *name, TickScheduler::Histogram const &h) {
+		out << "\"" << name << "\":{\"samples\":" << h.samples << ",\"p50\":" << h.percentile(0.5) << ",\"p99\":" << h.percentile(0.99) << ",\"max\":" << h.max << "}";
+	};
+	out << "{\"bytes_in\":" << bytes_in << ",\"bytes_out\":" << bytes_out
+	    << ",\"messages_in\":" << messages_in << ",\"messages_out\":" << messages_out << ",\"blocks_out\":" << blocks_out
+	    << ",\"polls\":" << polls << ",\"syscalls\":" << syscalls << ",";
+	histogram("wait_time", wait_time);
+	out << ",";
+	histogram("work_time", work_time);
+	out << ",\"flush_queue\":" << flush_queue << ",\"flush_queue_max\":" << flush_queue_max
+	    << ",\"send_queue_max\":" << send_queue_max << ",\"recv_queue_max\":" << recv_queue_max
+	    << ",\"open\":" << open() << ",\"opened\":" << opened << ",\"closed\":{";
+	for (size_t i = 0; i < CauseCount; ++i) out << (i ? "," : "") << "\"" << cause_name(Cause(i)) << "\":" << closed[i];
+	out << "},";
+	histogram("lifetime", lifetime);
+	out << "}";
+}
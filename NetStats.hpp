@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * NetStats counts what a Server's (or Client's) sockets are doing: traffic,
+ * system calls, how poll() splits its time between waiting and working,
+ * queue depths, and how long connections lasted and why they closed.
+ *
+ * Only the thread that polls writes the counters (so they are plain relaxed
+ * stores -- no locked adds on the hot path), and any thread may read them
+ * with snapshot(), e.g., to print them every few seconds while the server runs.
+ * Snapshots from several servers (e.g., one per shard) can be added together.
+ */
+
+#include "TickScheduler.hpp" //for histograms
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+struct NetStats {
+	//why connections closed:
+	enum Cause : uint8_t {
+		PeerClosed, //the other end closed the connection
+		RecvError, //receiving failed (e.g., connection reset)
+		SendError, //sending failed
+		Overflow, //send queue went past its limits
+		Local, //closed by this program (Connection::close())
+		Detached, //handed off to another server (Server::detach())
+		CauseCount
+	};
+	static char const *cause_name(Cause cause);
+
+	//counter written by one thread, read by any:
+	struct Counter {
+		std::atomic< uint64_t > value{0};
+		void add(uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+		void raise(uint64_t n) { if (n > value.load(std::memory_order_relaxed)) value.store(n, std::memory_order_relaxed); } //(for maximums)
+		void set(uint64_t n) { value.store(n, std::memory_order_relaxed); } //(for gauges)
+		uint64_t load() const { return value.load(std::memory_order_relaxed); }
+	};
+
+	//traffic:
+	Counter bytes_in, bytes_out; //(as read from / written to sockets)
+	Counter messages_in; //messages handled by MessageDispatcher
+	Counter messages_out; //messages written with send_message / send_message_header
+	Counter blocks_out; //shared blocks queued (each may hold any number of messages)
+
+	//polling:
+	Counter polls;
+	Counter syscalls; //socket system calls made while polling (waits, accepts, receives, sends, ...)
+	TickScheduler::AtomicHistogram wait_time; //per poll: time spent waiting for sockets
+	TickScheduler::AtomicHistogram work_time; //per poll: time spent on everything else (event handlers included)
+
+	//queues:
+	Counter flush_queue; //connections with data waiting to be sent, as the last poll started
+	Counter flush_queue_max;
+	Counter send_queue_max; //most bytes seen queued on one connection
+	Counter recv_queue_max; //most bytes seen waiting in one connection's recv_buffer
+
+	//connections:
+	Counter opened;
+	std::array< Counter, CauseCount > closed;
+	TickScheduler::AtomicHistogram lifetime; //of closed connections
+
+	//A copy of the counters at one moment:
+	struct Snapshot {
+		uint64_t bytes_in = 0, bytes_out = 0;
+		uint64_t messages_in = 0, messages_out = 0, blocks_out = 0;
+		uint64_t polls = 0, syscalls = 0;
+		TickScheduler::Histogram wait_time, work_time;
+		uint64_t flush_queue = 0, flush_queue_max = 0;
+		uint64_t send_queue_max = 0, recv_queue_max = 0;
+		uint64_t opened = 0;
+		std::array< uint64_t, CauseCount > closed{};
+		TickScheduler::Histogram lifetime;
+
+		uint64_t open() const; //(opened minus closed)
+
+		Snapshot &operator+=(Snapshot const &other);
+		//human-readable summary:
+		void print(std::ostream &out) const;
+		//the same, as one JSON object:
+		void print_json(std::ostream &out) const;
+	};
+	Snapshot snapshot() const;
+};
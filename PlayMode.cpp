@@ -3,23 +3,109 @@
 #include "DrawLines.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
-#include "hex_dump.hpp"
+#include "Log.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <random>
 
-PlayMode::PlayMode(Client& client_) : client(client_) {
-	chess_board = std::vector<std::vector<int>>(NUM_PIECES_PER_LINE_HALF * 2 + 1, std::vector<int>(NUM_PIECES_PER_LINE_HALF * 2 + 1, 0));
+PlayMode::PlayMode(std::string const &host_, std::string const &port_, std::unique_ptr< Client > &&client_) : host(host_), port(port_), client(std::move(client_)) {
 	chess_piece_colors.push_back(HEX_TO_U8VEC4(0x00000000));
 	chess_piece_colors.push_back(HEX_TO_U8VEC4(0xd9cfc1ff));
 	chess_piece_colors.push_back(HEX_TO_U8VEC4(0x020122ff));
 	chess_piece_colors.push_back(HEX_TO_U8VEC4(0xA20021ff));
+
+	//'s' -- game state changed:
+	dispatcher.on(MessageState, [this](Connection *, MessageView const &message) {
+		if (!message.read(0, &state)) {
+			throw std::runtime_error("Server sent a truncated state message.");
+		}
+	});
+	//'d' -- a move was made:
+	dispatcher.on(MessageMoveDelta, [this](Connection *c, MessageView const &message) {
+		MoveDeltaMessage delta;
+		if (!message.read(0, &delta)) {
+			throw std::runtime_error("Server sent a truncated move message.");
+		}
+		if (delta.seq <= board_seq) return; //already have this move (e.g., it was in a board snapshot)
+		if (delta.seq != board_seq + 1) {
+			//missed a move; ignore deltas until the server sends the whole board:
+			if (!resync_requested) {
+				send_message(*c, MessageResync, &board_seq, sizeof(board_seq));
+				resync_requested = true;
+			}
+			return;
+		}
+		AddChessPiece(delta.x, delta.y, delta.player);
+		board_seq = delta.seq;
+	});
+	//'b' -- whole board (on join or after a resync request):
+	dispatcher.on(MessageBoard, [this](Connection *, MessageView const &message) {
+		BoardSnapshotHeader header;
+		if (!message.read(0, &header) || header.width != BoardWidth
+		 || message.size != sizeof(header) + PackedBoardBytes) {
+			throw std::runtime_error("Server sent a board snapshot of unexpected size.");
+		}
+		unpack_board(reinterpret_cast< uint8_t const * >(message.data + sizeof(header)), &chess_board);
+		chess_pieces.clear();
+		for (size_t x = 0; x < BoardWidth; ++x) {
+			for (size_t y = 0; y < BoardWidth; ++y) {
+				int player = chess_board.at(int(x), int(y));
+				chess_board.set(int(x), int(y), 0);
+				AddChessPiece(int(x) - NUM_PIECES_PER_LINE_HALF, int(y) - NUM_PIECES_PER_LINE_HALF, player);
+			}
+		}
+		board_seq = header.seq;
+		resync_requested = false;
+	});
+	//'n' text -- our player name:
+	dispatcher.on(MessageName, [this](Connection *, MessageView const &message) {
+		player_name = std::string(message.data, message.size);
+	});
+	//'t' text -- our status line:
+	dispatcher.on(MessageStatus, [this](Connection *, MessageView const &message) {
+		status_message = std::string(message.data, message.size);
+	});
+	//'k' -- key to our seat:
+	dispatcher.on(MessageSeat, [this](Connection *, MessageView const &message) {
+		if (message.size != sizeof(seat) || !message.read(0, &seat)) {
+			throw std::runtime_error("Server sent a seat key of unexpected size.");
+		}
+		have_seat = true;
+	});
 }
 
 PlayMode::~PlayMode() {
 }
 
+void PlayMode::watch(uint32_t room) {
+	spectating = true;
+	watch_room = room;
+	status_message = "Finding a game to watch . . .";
+	//(otherwise, sent once connected)
+	if (client->state == Client::Connected) {
+		WatchMessage message;
+		message.room = room;
+		send_message(client->connection, MessageWatch, &message, sizeof(message));
+	}
+}
+
+std::string PlayMode::connecting_status() const {
+	std::string where = host + ":" + port;
+	if (client->state == Client::Resolving) {
+		return "Looking up " + host + " . . .";
+	} else if (client->state == Client::Waiting) {
+		double wait = std::chrono::duration< double >(client->next_attempt - std::chrono::steady_clock::now()).count();
+		return "Can't reach " + where + "; retrying in " + std::to_string(int(std::ceil(std::max(0.0, wait)))) + "s . . .";
+	} else {
+		std::string text = "Connecting to " + where + " . . .";
+		if (client->attempt > 1) text += " (attempt " + std::to_string(client->attempt) + ")";
+		return text;
+	}
+}
+
 bool PlayMode::handle_event(SDL_Event const& evt, glm::uvec2 const& window_size) {
 
 	//if (evt.type == SDL_KEYDOWN) {
@@ -101,6 +187,18 @@ bool PlayMode::handle_event(SDL_Event const& evt, glm::uvec2 const& window_size)
 	return false;
 }
 
+void PlayMode::AddChessPiece(int x, int y, int player) {
+	if (player <= 0 || player >= int(chess_piece_colors.size())) return;
+	if (x < -NUM_PIECES_PER_LINE_HALF || x > NUM_PIECES_PER_LINE_HALF
+	 || y < -NUM_PIECES_PER_LINE_HALF || y > NUM_PIECES_PER_LINE_HALF) return;
+
+	if (player > PLAYER_NUM) return;
+	if (!chess_board.empty(x + NUM_PIECES_PER_LINE_HALF, y + NUM_PIECES_PER_LINE_HALF)) return;
+	chess_board.set(x + NUM_PIECES_PER_LINE_HALF, y + NUM_PIECES_PER_LINE_HALF, player);
+	glm::vec2 origin(x * CHESS_BOX_SIZE, y * CHESS_BOX_SIZE);
+	chessboard_texture_program->SetupChessPiece(chess_pieces, origin, chess_piece_colors[player]);
+}
+
 bool PlayMode::CheckMouseClickValid(const glm::uvec2& window_size) {
 	glm::vec2 pixel_size = {mouse_pos.x * window_size.x, mouse_pos.y * window_size.y};
 	int chessboard_x = static_cast<int>(std::round(pixel_size.x / CHESS_BOX_SIZE));
@@ -140,70 +238,61 @@ void PlayMode::update(float elapsed) {
 	//up.downs = 0;
 	//down.downs = 0;
 
-	if (should_send) {
-		client.connections.back().send('a');
-		client.connections.back().send(send_pos.first);
-		client.connections.back().send(send_pos.second);
+	//(moves made before the connection opens are dropped)
+	if (should_send && !spectating && client->state == Client::Connected) {
+		int8_t pos[2] = { send_pos.first, send_pos.second };
+		send_message(client->connection, MessageMove, pos, sizeof(pos));
 	}
 
 	should_send = false;
 
 
 	//send/receive data:
-	client.poll([this](Connection* c, Connection::Event event) {
+	bool lost = false;
+	client->poll([this, &lost](Connection* c, Connection::Event event) {
 		if (event == Connection::OnOpen) {
 			std::cout << "[" << c->socket << "] opened" << std::endl;
+			//(re)connected -- ask for the game we were watching, or our seat back if we had one:
+			if (spectating) {
+				WatchMessage message;
+				message.room = watch_room;
+				send_message(*c, MessageWatch, &message, sizeof(message));
+				status_message = "Finding a game to watch . . .";
+			} else if (have_seat) {
+				send_message(*c, MessageRejoin, &seat, sizeof(seat));
+				status_message = "Rejoining game . . .";
+			} else {
+				status_message = "Waiting for other players to join . . .";
+			}
+		}
+		else if (event == Connection::OnConnectFailed) {
+			//(client keeps trying; connecting_status() says when)
+			std::cout << "Connecting failed: " << client->error << std::endl;
 		}
 		else if (event == Connection::OnClose) {
 			std::cout << "[" << c->socket << "] closed (!)" << std::endl;
-			throw std::runtime_error("Lost connection to server!");
+			//(without a seat -- or a game to watch -- to go back to, there's nothing to reconnect for)
+			if (!have_seat && !spectating) throw std::runtime_error("Lost connection to server!");
+			lost = true;
 		}
 		else {
 			assert(event == Connection::OnRecv);
-			std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-			//expecting message(s) like 'm' + 3-byte length + length bytes of text:
-			while (c->recv_buffer.size() >= 4) {
-				std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-				char type = c->recv_buffer[0];
-				if (type != 'm') {
-					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
-				}
-				uint32_t size = (
-					(uint32_t(c->recv_buffer[1]) << 16) | (uint32_t(c->recv_buffer[2]) << 8) | (uint32_t(c->recv_buffer[3]))
-					);
-				if (c->recv_buffer.size() < 4 + size) break; //if whole message isn't here, can't process
-				//whole message *is* here, so set current server message:
-				server_message = std::string(c->recv_buffer.begin() + 4, c->recv_buffer.begin() + 4 + size);
-
-				//and consume this part of the buffer:
-				c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4 + size);
+			LOG_BYTES(Debug, "recv'd data; current buffer", c->recv_buffer.linearize(), c->recv_buffer.size());
+			//expecting messages as described in ChessMessages.hpp:
+			if (dispatcher.dispatch(c) != MessageDispatcher::Ok) {
+				throw std::runtime_error("Server sent unknown message type '" + std::to_string(dispatcher.bad_type) + "'");
 			}
 		}
 		}, 0.0);
 
-	size_t dot_pos1 = server_message.find(",");
-	size_t dot_pos2 = server_message.find(",", dot_pos1 + 1);
-	size_t dot_pos3 = server_message.find(",", dot_pos2 + 1);
-	size_t dot_pos4 = server_message.find(",", dot_pos3 + 1);
-
-	int color_to_draw = std::stoi(server_message.substr(0, dot_pos1));
-	//std::cout << "First stoi: " << color_to_draw << std::endl;
-	int chessboard_x = std::stoi(server_message.substr(dot_pos1+1, dot_pos2 - dot_pos1 - 1));
-	//std::cout << "Second stoi: " << chessboard_x << std::endl;
-	int chessboard_y = std::stoi(server_message.substr(dot_pos2+1, dot_pos3 - dot_pos2 - 1));
-	//std::cout << "Third stoi: " << chessboard_x << std::endl;
-	int chesspiece_origin_x = (chessboard_x) * CHESS_BOX_SIZE;
-	int chesspiece_origin_y = (chessboard_y) * CHESS_BOX_SIZE;
-
-	//if (color_to_draw == -1)
-	player_name = server_message.substr(dot_pos3+1, dot_pos4 - dot_pos3 - 1);
-
-	status_message = server_message.substr(dot_pos4 + 1);
-
-	if (chess_board[chessboard_x + NUM_PIECES_PER_LINE_HALF][chessboard_y + NUM_PIECES_PER_LINE_HALF] == 0 && color_to_draw != 0) {
-		chess_board[chessboard_x + NUM_PIECES_PER_LINE_HALF][chessboard_y + NUM_PIECES_PER_LINE_HALF] = color_to_draw;
-		chessboard_texture_program->SetupChessPiece(chess_pieces, glm::vec2(chesspiece_origin_x, chesspiece_origin_y), chess_piece_colors[color_to_draw]);
+	//lost the connection? start getting it (and our seat, or the game we were watching) back:
+	// (the new client retries with backoff until the server answers)
+	if (lost) {
+		std::cout << "Lost connection to server; reconnecting . . ." << std::endl;
+		client = std::make_unique< Client >(host, port, Client::Retry());
 	}
+
+	if (client->state != Client::Connected) status_message = connecting_status();
 }
 
 void PlayMode::draw(glm::uvec2 const& drawable_size) {
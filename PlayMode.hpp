@@ -1,24 +1,36 @@
 #include "Mode.hpp"
 
 #include "Connection.hpp"
+#include "MessageCodec.hpp"
 #include "ChessBoardData.hpp"
+#include "ChessBoard.hpp"
+#include "ChessMessages.hpp"
 #include "ColorTextureProgram.hpp"
 #include "ChessBoardTextureProgram.hpp"
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <memory>
+#include <string>
 #include <vector>
 #include <deque>
 
 struct PlayMode : Mode {
-	PlayMode(Client &client);
+	//play on the server at host:port, through a connection to it (which may still be connecting):
+	PlayMode(std::string const &host, std::string const &port, std::unique_ptr< Client > &&client);
 	virtual ~PlayMode();
 
+	//watch a game (0: the server's featured game) instead of playing:
+	void watch(uint32_t room);
+
 	//functions called by main loop:
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
 	bool CheckMouseClickValid(const glm::uvec2& window_size);
+	//record and draw a piece at board offsets (x, y) (ignored if the cell is taken or out of range):
+	void AddChessPiece(int x, int y, int player);
 
 	//input tracking:
 	struct Button {
@@ -32,17 +44,35 @@ struct PlayMode : Mode {
 
 	std::vector<uint8_t> message_buffer;
 	std::pair<int8_t, int8_t> send_pos;
-	std::vector<std::vector<int>> chess_board;
+	ChessBoard chess_board;
 	glm::vec2 mouse_pos;
 	std::vector<ChessBoardTextureProgram::Circle> chess_pieces;
 	std::vector<glm::u8vec4> chess_piece_colors;
 
-	//last message from server:
-	std::string server_message;
+	//last game state from server:
+	StateMessage state;
+	//number of moves applied to chess_board (sequence number of the last move delta):
+	uint32_t board_seq = 0;
+	//asked the server for a board snapshot after missing a move:
+	bool resync_requested = false;
 
 	std::string player_name;
 	std::string status_message = "Waiting for other players to join . . .";
 
-	//connection to server:
-	Client &client;
+	//handlers for messages from the server:
+	MessageDispatcher dispatcher;
+
+	//connection to server (replaced by a new, still-connecting one when the connection is lost):
+	std::string host, port;
+	std::unique_ptr< Client > client;
+	//status line to show while the client is connecting:
+	std::string connecting_status() const;
+
+	//key to our seat (from the server's 'k'), used to take it back after reconnecting:
+	bool have_seat = false;
+	SeatMessage seat;
+
+	//watching (after watch()) rather than playing:
+	bool spectating = false;
+	uint32_t watch_room = 0;
 };
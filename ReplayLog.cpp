@@ -0,0 +1,51 @@
+#include "ReplayLog.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+ReplayLog::ReplayLog(std::string const &path) : file(path, std::ios::binary | std::ios::app) {
+	if (!file) throw std::runtime_error("Failed to open replay log '" + path + "' for appending.");
+}
+
+void ReplayLog::append(Game const &game, std::vector< Move > const &moves) {
+	if (moves.empty()) return; //(nothing worth replaying)
+
+	//encode outside the lock; write the whole game at once:
+	Game header = game;
+	header.moves = uint32_t(moves.size());
+	std::ostringstream block;
+	write_chunk("rplg", std::vector< Game >{header}, &block);
+	write_chunk("rplm", moves, &block);
+	std::string bytes = block.str();
+
+	std::lock_guard< std::mutex > lock(mutex);
+	file.write(bytes.data(), bytes.size());
+	file.flush();
+	written += 1;
+}
+
+uint64_t ReplayLog::games_written() const {
+	std::lock_guard< std::mutex > lock(mutex);
+	return written;
+}
+
+bool ReplayLog::read(std::istream &from, std::function< void(Game const &, std::vector< Move > const &) > const &game) {
+	std::vector< Game > header;
+	std::vector< Move > moves;
+	while (from.peek() != std::istream::traits_type::eof()) {
+		try {
+			read_chunk(from, "rplg", &header);
+			read_chunk(from, "rplm", &moves);
+		} catch (std::runtime_error &) {
+			if (from.eof()) return false; //log ends partway through a game
+			throw;
+		}
+		if (header.size() != 1) throw std::runtime_error("Replay game header chunk holds " + std::to_string(header.size()) + " headers.");
+		if (header[0].version != Version) throw std::runtime_error("Replay log has unknown version " + std::to_string(header[0].version) + ".");
+		if (header[0].moves != moves.size()) throw std::runtime_error("Replay game header does not match its moves.");
+		game(header[0], moves);
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * ReplayLog records games as they are played, in an append-only binary file
+ * of read_write_chunk.hpp chunks -- two per game:
+ *  'rplg': one Game header (room, board size, rules, result, start time)
+ *  'rplm': the game's accepted moves, one Move each, in order
+ *
+ * Each move carries the outcome the rules gave it at the time, so a replay
+ * can re-run the moves through the current rule code and check every step.
+ *
+ * Rooms append a game when it ends (or when the room closes with the game
+ * unfinished). append() may be called from any shard's thread; each game is
+ * written and flushed as one block, so a crash loses at most games still in
+ * progress, never part of one.
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ReplayLog {
+	static constexpr uint8_t Version = 1;
+
+	//Move::result / Game::result values (other than a winning player, 1 .. PLAYER_NUM):
+	enum : uint8_t {
+		Playing = 0, //(moves) game continues; (games) game was abandoned before it ended
+		Tie = 0xff,
+	};
+
+	struct Game {
+		uint8_t version = Version;
+		uint8_t width = 0; //board is width x width
+		uint8_t win_length = 0; //pieces in a row needed to win
+		uint8_t players = 0; //seats in the game
+		uint32_t room = 0; //room id (for logging)
+		uint32_t moves = 0; //number of moves that follow
+		uint8_t result = Playing; //winning player, Tie, or Playing
+		uint8_t padding[3] = {0, 0, 0};
+		int64_t started = 0; //unix time (seconds) the game started
+	};
+	static_assert(sizeof(Game) == 24, "Game is packed.");
+
+	struct Move {
+		int8_t x = 0; //offsets from the center of the board (as in the 'a' message)
+		int8_t y = 0;
+		uint8_t player = 0; //who moved
+		uint8_t result = Playing; //Playing, or the game's result if this move ended it
+	};
+	static_assert(sizeof(Move) == 4, "Move is packed.");
+
+	//open 'path' for appending (throws on failure):
+	ReplayLog(std::string const &path);
+
+	//record one game (thread-safe):
+	void append(Game const &game, std::vector< Move > const &moves);
+
+	uint64_t games_written() const;
+
+	//read every game in a log, calling 'game' for each (throws on a malformed log):
+	// (a final game cut short by a crash or a full disk is reported via the return value, not thrown)
+	static bool read(std::istream &from, std::function< void(Game const &, std::vector< Move > const &) > const &game);
+
+private:
+	mutable std::mutex mutex;
+	std::ofstream file;
+	uint64_t written = 0;
+};
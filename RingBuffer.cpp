@@ -0,0 +1,82 @@
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void RingBuffer::reserve(size_t size) {
+	if (size <= storage.size()) return;
+
+	size_t new_capacity = std::max< size_t >(storage.size(), 64);
+	while (new_capacity < size) new_capacity *= 2;
+
+	//copy existing data (in order) to the front of the new storage:
+	std::vector< char > new_storage(new_capacity);
+	peek(0, new_storage.data(), count);
+	storage.swap(new_storage);
+	head = 0;
+}
+
+void RingBuffer::push(void const *data_, size_t size) {
+	if (size == 0) return;
+	reserve(count + size);
+
+	char const *data = reinterpret_cast< char const * >(data_);
+	size_t mask = storage.size() - 1;
+	size_t tail = (head + count) & mask;
+	size_t first = std::min(size, storage.size() - tail);
+	std::memcpy(storage.data() + tail, data, first);
+	std::memcpy(storage.data(), data + first, size - first);
+	count += size;
+}
+
+void RingBuffer::peek(size_t offset, void *out_, size_t size) const {
+	assert(offset + size <= count);
+	if (size == 0) return;
+
+	char *out = reinterpret_cast< char * >(out_);
+	size_t mask = storage.size() - 1;
+	size_t begin = (head + offset) & mask;
+	size_t first = std::min(size, storage.size() - begin);
+	std::memcpy(out, storage.data() + begin, first);
+	std::memcpy(out + first, storage.data(), size - first);
+}
+
+RingBuffer::Span RingBuffer::front() const {
+	Span span;
+	if (count == 0) return span;
+	span.data = storage.data() + head;
+	span.size = std::min(count, storage.size() - head);
+	return span;
+}
+
+size_t RingBuffer::spans(size_t offset, size_t size, Span out[2]) const {
+	assert(offset + size <= count);
+	if (size == 0) return 0;
+	size_t begin = (head + offset) & (storage.size() - 1);
+	out[0].data = storage.data() + begin;
+	out[0].size = std::min(size, storage.size() - begin);
+	if (out[0].size == size) return 1;
+	out[1].data = storage.data();
+	out[1].size = size - out[0].size;
+	return 2;
+}
+
+char const *RingBuffer::contiguous(size_t size) {
+	assert(size <= count);
+	if (head + size > storage.size()) {
+		//requested range wraps around the end of storage, so rotate data to start at index zero:
+		std::rotate(storage.begin(), storage.begin() + head, storage.end());
+		head = 0;
+	}
+	return storage.data() + head;
+}
+
+void RingBuffer::consume(size_t size) {
+	assert(size <= count);
+	count -= size;
+	if (count == 0) {
+		head = 0; //restart at the front so small buffers stay contiguous
+	} else {
+		head = (head + size) & (storage.size() - 1);
+	}
+}
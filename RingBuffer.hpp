@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * RingBuffer is a growable FIFO of bytes stored in a power-of-two circular array.
+ * Appending goes at the back, consuming drops bytes from the front -- neither
+ * moves the remaining data, so draining a long backlog a few bytes at a time is
+ * linear rather than quadratic (as it is with vector::erase(begin(), ...)).
+ *
+ * Readable data is at most two contiguous spans (before and after the wrap point);
+ * use spans() to get them both or contiguous() to make a prefix contiguous when a
+ * parser needs a single pointer.
+ */
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+
+struct RingBuffer {
+	//a contiguous run of readable bytes:
+	struct Span {
+		char const *data = nullptr;
+		size_t size = 0;
+	};
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t capacity() const { return storage.size(); }
+
+	//drop all data (keeps allocated storage):
+	void clear() { head = 0; count = 0; }
+	//make sure at least 'size' bytes can be held without reallocating:
+	void reserve(size_t size);
+
+	//append 'size' bytes to the back of the buffer:
+	void push(void const *data, size_t size);
+
+	//look at byte 'index' (counting from the front) without consuming it:
+	char operator[](size_t index) const {
+		assert(index < count);
+		return storage[(head + index) & (storage.size() - 1)];
+	}
+	//copy 'size' bytes starting 'offset' bytes from the front into 'out' without consuming them:
+	void peek(size_t offset, void *out, size_t size) const;
+	//copy 'size' bytes from the front into 'out' and consume them:
+	void read(void *out, size_t size) {
+		peek(0, out, size);
+		consume(size);
+	}
+
+	//first contiguous span of readable data (empty span if buffer is empty):
+	Span front() const;
+	//readable data as (up to) two spans; returns the number of non-empty spans written to 'out':
+	size_t spans(Span out[2]) const { return spans(0, count, out); }
+	//same, but only for the 'size' bytes starting 'offset' bytes from the front:
+	size_t spans(size_t offset, size_t size, Span out[2]) const;
+	//pointer to the first 'size' bytes as one contiguous block (rotates storage if they wrap):
+	char const *contiguous(size_t size);
+	//pointer to all readable data as one contiguous block:
+	char const *linearize() { return contiguous(count); }
+
+	//drop 'size' bytes from the front:
+	void consume(size_t size);
+
+private:
+	std::vector< char > storage; //size is always zero or a power of two
+	size_t head = 0; //index of first readable byte in storage
+	size_t count = 0; //number of readable bytes
+};
@@ -0,0 +1,265 @@
+#include "RoomStore.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+
+#ifndef _WIN32
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static_assert(std::is_trivially_copyable< RoomStore::Record >::value, "Records are copied into the snapshot as raw bytes.");
+static_assert(sizeof(RoomStore::Record) % 8 == 0, "Records are checksummed a word at a time.");
+
+namespace {
+	struct SnapshotHeader {
+		char magic[4] = {'r', 'm', 's', 't'};
+		uint32_t version = 1;
+		uint32_t record_size = sizeof(RoomStore::Record);
+		uint32_t rooms = 0;
+		uint64_t generation = 0;
+		uint64_t checksum = 0; //of everything else in the header and all the records
+	};
+	static_assert(sizeof(SnapshotHeader) == 32, "SnapshotHeader is written as raw bytes, so must be packed.");
+
+	//FNV-1a, a word at a time (so that checksumming a large snapshot stays cheap):
+	uint64_t checksum(SnapshotHeader header, void const *records, size_t bytes) {
+		header.checksum = 0;
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		auto mix = [&hash](uint64_t const *words, size_t count) {
+			for (size_t i = 0; i < count; ++i) {
+				hash ^= words[i];
+				hash *= 0x100000001b3ULL;
+			}
+		};
+		uint64_t header_words[sizeof(header) / 8];
+		std::memcpy(header_words, &header, sizeof(header));
+		mix(header_words, sizeof(header) / 8);
+		mix(reinterpret_cast< uint64_t const * >(records), bytes / 8);
+		return hash;
+	}
+
+	std::string const suffixes[2] = {".snap-a", ".snap-b"};
+
+	[[noreturn]] void fail(std::string const &what) {
+		throw std::system_error(errno, std::system_category(), what);
+	}
+
+	bool read_file(std::string const &path, std::vector< char > *data) {
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			if (errno == ENOENT) return false;
+			fail("failed to open '" + path + "'");
+		}
+		data->clear();
+		char buffer[1 << 16];
+		while (true) {
+			ssize_t got = ::read(fd, buffer, sizeof(buffer));
+			if (got < 0 && errno == EINTR) continue;
+			if (got < 0) {
+				int err = errno;
+				::close(fd);
+				errno = err;
+				fail("failed to read '" + path + "'");
+			}
+			if (got == 0) break;
+			data->insert(data->end(), buffer, buffer + got);
+		}
+		::close(fd);
+		return true;
+	}
+}
+
+RoomStore::RoomStore(std::string const &prefix_) : prefix(prefix_) {
+	//snapshot files are mapped whole; note which generation each holds, so the next snapshot overwrites the older:
+	for (size_t i = 0; i < 2; ++i) {
+		Mapped &file = files[i];
+		std::string path = prefix + suffixes[i];
+		file.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (file.fd < 0) fail("failed to open '" + path + "'");
+		struct stat info;
+		if (fstat(file.fd, &info) != 0) fail("failed to stat '" + path + "'");
+		file.size = size_t(info.st_size);
+		if (file.size >= sizeof(SnapshotHeader)) {
+			file.data = mmap(nullptr, file.size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+			if (file.data == MAP_FAILED) fail("failed to map '" + path + "'");
+			SnapshotHeader header;
+			std::memcpy(&header, file.data, sizeof(header));
+			size_t bytes = size_t(header.rooms) * sizeof(Record);
+			if (header.record_size == sizeof(Record) && sizeof(header) + bytes <= file.size
+			 && header.checksum == checksum(header, reinterpret_cast< char * >(file.data) + sizeof(header), bytes)) {
+				file.generation = header.generation;
+			}
+		}
+	}
+
+	std::string path = prefix + ".journal";
+	journal_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (journal_fd < 0) fail("failed to open '" + path + "'");
+}
+
+RoomStore::~RoomStore() {
+	for (auto &file : files) {
+		if (file.data) munmap(file.data, file.size);
+		if (file.fd >= 0) ::close(file.fd);
+	}
+	if (journal_fd >= 0) ::close(journal_fd);
+}
+
+void RoomStore::log(Entry const &entry) {
+	//(a single small O_APPEND write, so entries are never interleaved or split by other writes)
+	while (::write(journal_fd, &entry, sizeof(entry)) < 0) {
+		if (errno != EINTR) fail("failed to append to '" + prefix + ".journal'");
+	}
+	journal_entries += 1;
+}
+
+void RoomStore::snapshot(std::vector< Record > const &rooms) {
+	//write over the older snapshot, so the newer one stays good until this one is complete:
+	Mapped &file = (files[0].generation <= files[1].generation ? files[0] : files[1]);
+	uint64_t generation = std::max(files[0].generation, files[1].generation) + 1;
+
+	size_t bytes = rooms.size() * sizeof(Record);
+	size_t needed = sizeof(SnapshotHeader) + bytes;
+	if (file.size < needed) {
+		//grow (with room to spare, so a slowly-growing server doesn't remap every time):
+		size_t size = std::max(needed, file.size + file.size / 2);
+		if (file.data) munmap(file.data, file.size);
+		file.data = nullptr;
+		file.size = 0;
+		if (ftruncate(file.fd, off_t(size)) != 0) fail("failed to grow snapshot file for '" + prefix + "'");
+		void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+		if (data == MAP_FAILED) fail("failed to map snapshot file for '" + prefix + "'");
+		file.data = data;
+		file.size = size;
+	}
+
+	char *base = reinterpret_cast< char * >(file.data);
+	//invalidate the old header first, then write the records, then the new header:
+	std::memset(base, 0, sizeof(SnapshotHeader));
+	if (bytes) std::memcpy(base + sizeof(SnapshotHeader), rooms.data(), bytes);
+	SnapshotHeader header;
+	header.rooms = uint32_t(rooms.size());
+	header.generation = generation;
+	header.checksum = checksum(header, base + sizeof(SnapshotHeader), bytes);
+	std::memcpy(base, &header, sizeof(header));
+	//(start writing back to disk, but don't wait for it)
+	msync(file.data, needed, MS_ASYNC);
+	file.generation = generation;
+
+	//everything in the journal is in the snapshot now:
+	if (ftruncate(journal_fd, 0) != 0) fail("failed to empty '" + prefix + ".journal'");
+
+	snapshots += 1;
+	journal_entries = 0;
+	last_snapshot_bytes = needed;
+}
+
+bool RoomStore::load(std::string const &prefix, std::vector< Record > *rooms_) {
+	assert(rooms_);
+	auto &rooms = *rooms_;
+	rooms.clear();
+
+	bool found = false;
+
+	//newest snapshot that checks out:
+	uint64_t best = 0;
+	for (size_t i = 0; i < 2; ++i) {
+		std::vector< char > data;
+		if (!read_file(prefix + suffixes[i], &data)) continue;
+		found = true;
+		if (data.size() < sizeof(SnapshotHeader)) continue;
+		SnapshotHeader header;
+		std::memcpy(&header, data.data(), sizeof(header));
+		if (std::string(header.magic, 4) != "rmst" || header.version != 1 || header.record_size != sizeof(Record)) continue;
+		size_t bytes = size_t(header.rooms) * sizeof(Record);
+		if (sizeof(header) + bytes > data.size()) continue;
+		//(copy out first, so the records are suitably aligned to be checksummed a word at a time)
+		std::vector< Record > records(header.rooms);
+		if (bytes) std::memcpy(records.data(), data.data() + sizeof(header), bytes);
+		if (header.checksum != checksum(header, records.data(), bytes)) continue;
+		if (header.generation > best) {
+			best = header.generation;
+			rooms = std::move(records);
+		}
+	}
+
+	//changes since then:
+	std::vector< char > data;
+	if (read_file(prefix + ".journal", &data)) {
+		found = true;
+		std::unordered_map< uint32_t, size_t > index;
+		for (size_t i = 0; i < rooms.size(); ++i) index.emplace(rooms[i].id, i);
+		auto room = [&](uint32_t id) -> Record & {
+			auto f = index.find(id);
+			if (f != index.end()) return rooms[f->second];
+			index.emplace(id, rooms.size());
+			rooms.emplace_back();
+			rooms.back().id = id;
+			return rooms.back();
+		};
+		//(a partial entry at the end -- cut short by a crash -- is ignored)
+		for (size_t at = 0; at + sizeof(Entry) <= data.size(); at += sizeof(Entry)) {
+			Entry entry;
+			std::memcpy(&entry, data.data() + at, sizeof(entry));
+			if (entry.kind == EntrySeat) {
+				if (entry.seat >= 1 && entry.seat <= PLAYER_NUM) room(entry.room).seat_tokens[entry.seat - 1] = entry.value;
+			} else if (entry.kind == EntryStart) {
+				room(entry.room).game_state = 1;
+			} else if (entry.kind == EntryMove) {
+				Record &record = room(entry.room);
+				//(moves already in the snapshot are skipped; the journal is emptied right after each
+				// snapshot, but a crash in between can leave it holding entries the snapshot has)
+				if (entry.value == uint64_t(record.moves) + 1 && record.moves < MaxMoves) {
+					record.move_list[record.moves] = {entry.x, entry.y};
+					record.moves += 1;
+					record.game_state = 1;
+				}
+			} else if (entry.kind == EntryClose) {
+				auto f = index.find(entry.room);
+				if (f == index.end()) continue;
+				//(swap-remove, keeping the index up to date)
+				size_t i = f->second;
+				index.erase(f);
+				if (i + 1 != rooms.size()) {
+					rooms[i] = rooms.back();
+					index[rooms[i].id] = i;
+				}
+				rooms.pop_back();
+			} else {
+				throw std::runtime_error("Unknown entry kind " + std::to_string(entry.kind) + " in '" + prefix + ".journal'.");
+			}
+		}
+	}
+	return found;
+}
+
+void RoomStore::remove(std::string const &prefix) {
+	for (auto const &suffix : suffixes) ::unlink((prefix + suffix).c_str());
+	::unlink((prefix + ".journal").c_str());
+}
+
+#else //_WIN32
+
+//NOTE: saving rooms uses POSIX memory-mapped files, which aren't implemented for windows yet:
+RoomStore::RoomStore(std::string const &prefix_) : prefix(prefix_) {
+	throw std::runtime_error("Saving room state is not supported on windows.");
+}
+RoomStore::~RoomStore() { }
+void RoomStore::log(Entry const &) { }
+void RoomStore::snapshot(std::vector< Record > const &) { }
+bool RoomStore::load(std::string const &, std::vector< Record > *rooms) {
+	rooms->clear();
+	return false;
+}
+void RoomStore::remove(std::string const &) { }
+
+#endif
@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * RoomStore saves room state so a restarted server can pick up every game
+ * where it left off. It keeps three files per shard:
+ *
+ *  <prefix>.snap-a, <prefix>.snap-b: snapshots of all of the shard's rooms,
+ *   memory-mapped. Each snapshot is written into the older of the two files
+ *   (never over the newest one), then its header -- generation number and
+ *   checksum -- is filled in last. A crash partway through leaves a file
+ *   whose checksum doesn't match, and loading falls back to the other one.
+ *  <prefix>.journal: everything that changed since the last snapshot (seats
+ *   taken, games started, moves, rooms closed), appended as it happens and
+ *   emptied after each snapshot.
+ *
+ * Rooms are saved as their list of moves, not their board, so restoring a
+ * room replays its moves through the rules (and rebuilds everything else).
+ *
+ * A RoomStore belongs to one shard and is not thread-safe. Writes go through
+ * the OS page cache, so they survive the server process crashing; they are
+ * not synced to disk on every change.
+ */
+
+#include "ChessBoardData.hpp"
+#include "ChessBoard.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RoomStore {
+	static constexpr uint32_t MaxMoves = ChessBoard::Width * ChessBoard::Width;
+
+	//one room, as saved in a snapshot:
+	struct Record {
+		uint32_t id = 0;
+		uint8_t game_state = 0; //0: waiting for players, 1: playing (or over -- the moves say which)
+		uint8_t reserved = 0;
+		uint16_t moves = 0; //entries used in 'move_list'
+		std::array< uint64_t, PLAYER_NUM > seat_tokens{}; //key of the human each seat was given to (0: none)
+		std::array< std::array< int8_t, 2 >, MaxMoves > move_list{}; //(x, y) offsets from the center, in order
+	};
+
+	//one change, as appended to the journal:
+	enum EntryKind : uint8_t {
+		EntrySeat = 'j', //a human took seat 'seat' with key 'value'
+		EntryStart = 'g', //the game started
+		EntryMove = 'm', //move number 'value' (counting from 1) was made at (x, y)
+		EntryClose = 'x', //the room closed
+	};
+	struct Entry {
+		uint32_t room = 0;
+		uint8_t kind = 0;
+		uint8_t seat = 0;
+		int8_t x = 0;
+		int8_t y = 0;
+		uint64_t value = 0;
+	};
+	static_assert(sizeof(Entry) == 16, "Entry is written as raw bytes, so must be packed.");
+
+	//open (creating if needed) the files for 'prefix' to write new state:
+	// (existing state stays loadable until the first snapshot() replaces it)
+	RoomStore(std::string const &prefix);
+	~RoomStore();
+	RoomStore(RoomStore const &) = delete;
+	RoomStore &operator=(RoomStore const &) = delete;
+
+	//append a change to the journal:
+	void log(Entry const &entry);
+	//save all rooms (replacing the previous snapshot and emptying the journal):
+	void snapshot(std::vector< Record > const &rooms);
+
+	//read back the rooms saved under 'prefix' (the newest good snapshot, with the journal applied):
+	// returns false if there are no files for 'prefix'; throws if they can't be read
+	static bool load(std::string const &prefix, std::vector< Record > *rooms);
+	//delete the files for 'prefix' (e.g., left over from a server that had more shards):
+	static void remove(std::string const &prefix);
+
+	//stats:
+	uint64_t snapshots = 0; //snapshots written
+	uint64_t journal_entries = 0; //entries logged since the last snapshot
+	uint64_t last_snapshot_bytes = 0; //size of the last snapshot
+
+private:
+	struct Mapped {
+		int fd = -1;
+		void *data = nullptr;
+		size_t size = 0; //bytes mapped (= file size)
+		uint64_t generation = 0; //of the snapshot in this file (0: none)
+	};
+	std::string prefix;
+	std::array< Mapped, 2 > files;
+	int journal_fd = -1;
+};
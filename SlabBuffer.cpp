@@ -0,0 +1,222 @@
+#include "SlabBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+	struct FreeList {
+		Slab *head = nullptr;
+		size_t count = 0;
+		uint64_t allocated = 0;
+		uint64_t reused = 0;
+		~FreeList();
+	};
+	thread_local FreeList free_list;
+	thread_local bool free_list_gone = false; //(slabs given back during thread exit are just freed)
+
+	FreeList::~FreeList() {
+		while (head) {
+			Slab *slab = head;
+			head = slab->next;
+			delete slab;
+		}
+		count = 0;
+		free_list_gone = true;
+	}
+}
+
+Slab *SlabPool::take() {
+	if (!free_list_gone && free_list.head) {
+		Slab *slab = free_list.head;
+		free_list.head = slab->next;
+		free_list.count -= 1;
+		free_list.reused += 1;
+		slab->next = nullptr;
+		slab->begin = slab->end = 0;
+		return slab;
+	}
+	if (!free_list_gone) free_list.allocated += 1;
+	return new Slab; //(data is left uninitialized)
+}
+
+void SlabPool::give(Slab *slab) {
+	if (!slab) return;
+	if (free_list_gone || free_list.count >= MaxFree) {
+		delete slab;
+		return;
+	}
+	slab->next = free_list.head;
+	free_list.head = slab;
+	free_list.count += 1;
+}
+
+size_t SlabPool::free_count() { return free_list_gone ? 0 : free_list.count; }
+uint64_t SlabPool::allocated() { return free_list_gone ? 0 : free_list.allocated; }
+uint64_t SlabPool::reused() { return free_list_gone ? 0 : free_list.reused; }
+
+//---------------------------------
+
+SlabBuffer::SlabBuffer(SlabBuffer &&other) {
+	*this = std::move(other);
+}
+
+SlabBuffer &SlabBuffer::operator=(SlabBuffer &&other) {
+	if (this == &other) return *this;
+	release();
+	head = other.head;
+	tail = other.tail;
+	spare[0] = other.spare[0];
+	spare[1] = other.spare[1];
+	count = other.count;
+	scratch.swap(other.scratch);
+	other.head = other.tail = other.spare[0] = other.spare[1] = nullptr;
+	other.count = 0;
+	return *this;
+}
+
+void SlabBuffer::release() {
+	while (head) {
+		Slab *slab = head;
+		head = slab->next;
+		SlabPool::give(slab);
+	}
+	SlabPool::give(spare[0]);
+	SlabPool::give(spare[1]);
+	head = tail = spare[0] = spare[1] = nullptr;
+	count = 0;
+	scratch.clear();
+	scratch.shrink_to_fit();
+}
+
+size_t SlabBuffer::space(Space out[2]) {
+	size_t n = 0;
+	if (tail && tail->end < Slab::Capacity) {
+		out[n].data = tail->data + tail->end;
+		out[n].size = Slab::Capacity - tail->end;
+		n += 1;
+	}
+	for (size_t i = 0; n < 2; ++i, ++n) {
+		if (!spare[i]) spare[i] = SlabPool::take();
+		out[n].data = spare[i]->data;
+		out[n].size = Slab::Capacity;
+	}
+	return n;
+}
+
+void SlabBuffer::commit(size_t size) {
+	if (tail && tail->end < Slab::Capacity) {
+		size_t step = std::min(size, Slab::Capacity - tail->end);
+		tail->end += uint32_t(step);
+		count += step;
+		size -= step;
+	}
+	//(spare slabs join the chain only once they hold data, so every slab in it does)
+	for (size_t i = 0; size > 0; ++i) {
+		assert(i < 2 && spare[i]);
+		Slab *slab = spare[i];
+		spare[i] = nullptr;
+		size_t step = std::min(size, Slab::Capacity);
+		slab->begin = 0;
+		slab->end = uint32_t(step);
+		slab->next = nullptr;
+		if (tail) tail->next = slab;
+		else head = slab;
+		tail = slab;
+		count += step;
+		size -= step;
+	}
+	if (!spare[0]) std::swap(spare[0], spare[1]);
+}
+
+void SlabBuffer::trim() {
+	SlabPool::give(spare[0]);
+	SlabPool::give(spare[1]);
+	spare[0] = spare[1] = nullptr;
+	if (count == 0) release(); //(scratch, too)
+}
+
+void SlabBuffer::push(void const *data_, size_t size) {
+	char const *data = reinterpret_cast< char const * >(data_);
+	while (size > 0) {
+		Space out[2];
+		size_t n = space(out);
+		size_t step = 0;
+		for (size_t i = 0; i < n && step < size; ++i) {
+			size_t part = std::min(size - step, out[i].size);
+			std::memcpy(out[i].data, data + step, part);
+			step += part;
+		}
+		commit(step);
+		data += step;
+		size -= step;
+	}
+	trim();
+}
+
+void SlabBuffer::peek(size_t offset, void *out_, size_t size) const {
+	assert(offset + size <= count);
+	char *out = reinterpret_cast< char * >(out_);
+	for (Slab const *slab = head; size > 0; slab = slab->next) {
+		assert(slab);
+		size_t have = slab->end - slab->begin;
+		if (offset >= have) {
+			offset -= have;
+			continue;
+		}
+		size_t step = std::min(size, have - offset);
+		std::memcpy(out, slab->data + slab->begin + offset, step);
+		out += step;
+		size -= step;
+		offset = 0;
+	}
+}
+
+SlabBuffer::Span SlabBuffer::front() const {
+	Span span;
+	if (count == 0) return span;
+	span.data = head->data + head->begin;
+	span.size = head->end - head->begin;
+	return span;
+}
+
+char const *SlabBuffer::contiguous(size_t size) {
+	assert(size <= count);
+	if (size == 0) return head ? head->data + head->begin : scratch.data();
+	if (size <= size_t(head->end - head->begin)) return head->data + head->begin;
+	//(spans slabs)
+	scratch.resize(size);
+	peek(0, scratch.data(), size);
+	return scratch.data();
+}
+
+void SlabBuffer::consume(size_t size) {
+	assert(size <= count);
+	count -= size;
+	while (size > 0) {
+		size_t have = head->end - head->begin;
+		if (size < have) {
+			head->begin += uint32_t(size);
+			break;
+		}
+		size -= have;
+		Slab *slab = head;
+		head = slab->next;
+		if (!head) tail = nullptr;
+		SlabPool::give(slab);
+	}
+	if (count == 0) {
+		//nothing buffered: give back everything (idle connections hold no slabs)
+		release();
+	} else if (scratch.capacity() > Slab::Capacity) {
+		//(don't keep a large message's copy around)
+		scratch.clear();
+		scratch.shrink_to_fit();
+	}
+}
+
+size_t SlabBuffer::slabs() const {
+	size_t n = (spare[0] ? 1 : 0) + (spare[1] ? 1 : 0);
+	for (Slab const *slab = head; slab; slab = slab->next) ++n;
+	return n;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+/*
+ * SlabBuffer is a FIFO of bytes stored in a chain of fixed-size slabs, for
+ * data received from a socket: the socket reads straight into free space at
+ * the back (see space() / commit()), and framing code reads from the front
+ * in place -- only a message that straddles two slabs is ever copied (into
+ * a scratch block, by contiguous()).
+ *
+ * Slabs come from (and go back to) a per-thread pool, and a buffer hands
+ * back every slab it isn't using -- so idle connections hold no memory
+ * for receiving, and the pool's size tracks how much data is in flight on
+ * the thread rather than how many connections it has.
+ *
+ * The reading side works like RingBuffer's.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+struct Slab {
+	static constexpr size_t Bytes = 16384; //allocation size (header included)
+	static constexpr size_t Capacity = Bytes - sizeof(void *) - 2 * sizeof(uint32_t); //data bytes per slab
+
+	Slab *next = nullptr; //(next in a chain or in the pool)
+	uint32_t begin = 0, end = 0; //readable data is [begin, end)
+	char data[Capacity];
+};
+static_assert(sizeof(Slab) == Slab::Bytes, "slabs should be exactly Bytes large");
+
+//per-thread free list of slabs (slabs may be returned on a thread other than the one that took them):
+struct SlabPool {
+	static Slab *take();
+	static void give(Slab *slab);
+
+	//slabs kept on each thread's free list, at most (the rest are freed):
+	static constexpr size_t MaxFree = 256;
+
+	//this thread's counts (for stats):
+	static size_t free_count();
+	static uint64_t allocated(); //slabs allocated from the heap (over the thread's lifetime)
+	static uint64_t reused(); //slabs taken from the free list instead
+};
+
+struct SlabBuffer {
+	//a contiguous run of readable bytes:
+	struct Span {
+		char const *data = nullptr;
+		size_t size = 0;
+	};
+	//a contiguous run of free space to write into:
+	struct Space {
+		char *data = nullptr;
+		size_t size = 0;
+	};
+
+	SlabBuffer() = default;
+	~SlabBuffer() { release(); }
+	SlabBuffer(SlabBuffer const &) = delete;
+	SlabBuffer &operator=(SlabBuffer const &) = delete;
+	SlabBuffer(SlabBuffer &&other);
+	SlabBuffer &operator=(SlabBuffer &&other);
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//drop all data (and give back all slabs):
+	void clear() { release(); }
+
+	//---- writing ----
+	//free space at the back to receive into directly: the rest of the last slab (if any), then fresh ones.
+	// returns the number of spans written to 'out' (always 2)
+	size_t space(Space out[2]);
+	//mark the first 'size' bytes of the space() just handed out as readable:
+	void commit(size_t size);
+	//give back slabs holding no data (e.g., space() that a receive didn't use):
+	void trim();
+
+	//append a copy of 'size' bytes:
+	void push(void const *data, size_t size);
+
+	//---- reading ----
+	//look at byte 'index' (counting from the front) without consuming it:
+	char operator[](size_t index) const {
+		assert(index < count);
+		Slab const *slab = head;
+		while (index >= slab->end - slab->begin) {
+			index -= slab->end - slab->begin;
+			slab = slab->next;
+		}
+		return slab->data[slab->begin + index];
+	}
+	//copy 'size' bytes starting 'offset' bytes from the front into 'out' without consuming them:
+	void peek(size_t offset, void *out, size_t size) const;
+	//copy 'size' bytes from the front into 'out' and consume them:
+	void read(void *out, size_t size) {
+		peek(0, out, size);
+		consume(size);
+	}
+
+	//first contiguous span of readable data (empty span if buffer is empty):
+	Span front() const;
+	//pointer to the first 'size' bytes as one contiguous block:
+	// (points into the first slab if they are all there; otherwise they are copied to scratch space --
+	//  either way, only valid until the buffer is next consumed or appended to)
+	char const *contiguous(size_t size);
+	//pointer to all readable data as one contiguous block:
+	char const *linearize() { return contiguous(count); }
+
+	//drop 'size' bytes from the front (slabs emptied go back to the pool):
+	void consume(size_t size);
+
+	//slabs currently held:
+	size_t slabs() const;
+
+private:
+	Slab *head = nullptr; //first slab (every slab in the chain holds data)
+	Slab *tail = nullptr; //last slab
+	Slab *spare[2] = {nullptr, nullptr}; //(handed out by space() after tail; not yet holding data)
+	size_t count = 0; //number of readable bytes
+	std::vector< char > scratch; //for contiguous() across slabs
+
+	void release();
+};
@@ -0,0 +1,148 @@
+#include "TickScheduler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+TickScheduler::TickScheduler(double rate, CatchUp catch_up_, uint32_t max_burst_) : catch_up(catch_up_), max_burst(max_burst_) {
+	if (!(rate > 0.0)) throw std::runtime_error("Tick rate must be positive.");
+	period_seconds = 1.0 / rate;
+	period_duration = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(period_seconds));
+	next_tick = Clock::now() + period_duration;
+}
+
+double TickScheduler::until_tick() const {
+	return std::chrono::duration< double >(next_tick - Clock::now()).count();
+}
+
+void TickScheduler::begin_tick() {
+	Clock::time_point now = Clock::now();
+	double behind = std::chrono::duration< double >(now - next_tick).count();
+	assert(behind >= 0.0 && "begin_tick() called before the tick was due");
+	behind = std::max(0.0, behind);
+
+	ticks.fetch_add(1, std::memory_order_relaxed);
+	lateness.add(behind);
+	if (behind > 0.0) late.fetch_add(1, std::memory_order_relaxed);
+
+	//ticks (after this one) whose scheduled time has already passed:
+	uint64_t missed = uint64_t(behind / period_seconds);
+	if (missed == 0) {
+		next_tick += period_duration;
+		burst_run = 0;
+		return;
+	}
+
+	overruns.fetch_add(1, std::memory_order_relaxed);
+	if (catch_up == Burst && burst_run < max_burst) {
+		//run the next missed tick right away:
+		burst_run += 1;
+		burst.fetch_add(1, std::memory_order_relaxed);
+		next_tick += period_duration;
+	} else {
+		//drop the missed ticks and keep to the schedule from here:
+		skipped.fetch_add(missed, std::memory_order_relaxed);
+		next_tick += period_duration * int64_t(missed + 1);
+		burst_run = 0;
+	}
+}
+
+void TickScheduler::end_tick() {
+	for (size_t p = 0; p < PhaseCount; ++p) {
+		phases[p].add(tick_time[p]);
+		tick_time[p] = 0.0;
+	}
+}
+
+void TickScheduler::add_time(Phase phase, Clock::time_point start) {
+	tick_time[phase] += std::chrono::duration< double >(Clock::now() - start).count();
+}
+
+TickScheduler::Stats TickScheduler::stats() const {
+	Stats ret;
+	ret.ticks = ticks.load(std::memory_order_relaxed);
+	ret.late = late.load(std::memory_order_relaxed);
+	ret.overruns = overruns.load(std::memory_order_relaxed);
+	ret.skipped = skipped.load(std::memory_order_relaxed);
+	ret.burst = burst.load(std::memory_order_relaxed);
+	for (size_t p = 0; p < PhaseCount; ++p) {
+		ret.phases[p] = phases[p].load();
+	}
+	ret.lateness = lateness.load();
+	ret.max_lateness = ret.lateness.max;
+	return ret;
+}
+
+char const *TickScheduler::phase_name(Phase phase) {
+	if (phase == Poll) return "poll";
+	if (phase == Logic) return "logic";
+	if (phase == Broadcast) return "broadcast";
+	return "?";
+}
+
+//------------------------------------------
+
+void TickScheduler::AtomicHistogram::add(double seconds) {
+	double us = seconds * 1e6;
+	size_t bucket = 0;
+	if (us >= 1.0) bucket = std::min< size_t >(Histogram::Buckets - 1, size_t(std::floor(std::log2(us))) + 1);
+	counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	samples.fetch_add(1, std::memory_order_relaxed);
+	//(only the owning thread adds samples, so a plain compare-then-store is enough)
+	if (seconds > max.load(std::memory_order_relaxed)) max.store(seconds, std::memory_order_relaxed);
+}
+
+TickScheduler::Histogram TickScheduler::AtomicHistogram::load() const {
+	Histogram ret;
+	for (size_t i = 0; i < Histogram::Buckets; ++i) {
+		ret.counts[i] = counts[i].load(std::memory_order_relaxed);
+	}
+	ret.samples = samples.load(std::memory_order_relaxed);
+	ret.max = max.load(std::memory_order_relaxed);
+	return ret;
+}
+
+double TickScheduler::Histogram::percentile(double fraction) const {
+	if (samples == 0) return 0.0;
+	uint64_t target = uint64_t(std::ceil(fraction * double(samples)));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < Buckets; ++i) {
+		seen += counts[i];
+		if (seen >= std::max< uint64_t >(target, 1)) return std::min(max, std::ldexp(1.0, int(i)) * 1e-6);
+	}
+	return max;
+}
+
+TickScheduler::Histogram &TickScheduler::Histogram::operator+=(Histogram const &other) {
+	for (size_t i = 0; i < Buckets; ++i) counts[i] += other.counts[i];
+	samples += other.samples;
+	max = std::max(max, other.max);
+	return *this;
+}
+
+TickScheduler::Stats &TickScheduler::Stats::operator+=(Stats const &other) {
+	ticks += other.ticks;
+	late += other.late;
+	overruns += other.overruns;
+	skipped += other.skipped;
+	burst += other.burst;
+	max_lateness = std::max(max_lateness, other.max_lateness);
+	for (size_t p = 0; p < PhaseCount; ++p) phases[p] += other.phases[p];
+	lateness += other.lateness;
+	return *this;
+}
+
+void TickScheduler::Stats::print(std::ostream &out) const {
+	auto ms = [](double seconds) { return seconds * 1e3; };
+	auto line = [&](char const *name, Histogram const &h) {
+		out << "  " << std::setw(10) << std::left << name << std::right
+		    << " p50 <=" << ms(h.percentile(0.5)) << "ms, p99 <=" << ms(h.percentile(0.99)) << "ms, max " << ms(h.max) << "ms\n";
+	};
+	out << "ticks " << ticks << " (late " << late << ", overruns " << overruns
+	    << ", skipped " << skipped << ", burst " << burst << ", max lateness " << ms(max_lateness) << "ms)\n";
+	for (size_t p = 0; p < PhaseCount; ++p) line(phase_name(Phase(p)), phases[p]);
+	line("lateness", lateness);
+}
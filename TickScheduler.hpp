@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * TickScheduler runs a fixed-timestep loop and keeps timing statistics for it.
+ *
+ * The owning thread asks until_tick() how long it may wait (e.g., as a poll
+ * timeout), calls begin_tick() once a tick is due, times the tick's phases
+ * with add_time(), and calls end_tick() when the tick's work is done.
+ *
+ * When the loop falls behind by more than one tick, the catch-up policy
+ * decides what happens to the ticks that were missed:
+ *  Skip: drop them and keep to the schedule from now on (counted in 'skipped').
+ *  Burst: run them back-to-back until caught up (counted in 'burst'), but never
+ *   more than max_burst in a row -- beyond that, the rest are skipped.
+ *
+ * Counters and histograms are atomics, so stats() may be called from any
+ * thread (e.g., to print them while load testing) while the loop runs.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+struct TickScheduler {
+	typedef std::chrono::steady_clock Clock;
+
+	enum CatchUp : uint8_t {
+		Skip,
+		Burst,
+	};
+
+	//parts of a tick that are timed separately:
+	enum Phase : uint8_t {
+		Poll, //waiting for and handling network events between ticks
+		Logic, //updating game state
+		Broadcast, //sending updates to clients
+		PhaseCount
+	};
+
+	TickScheduler(double rate, CatchUp catch_up = Skip, uint32_t max_burst = 4);
+
+	double period() const { return period_seconds; }
+
+	//seconds until the next tick is due (zero or negative if it is due now):
+	double until_tick() const;
+	//start a tick (call once until_tick() <= 0); records lateness and applies the catch-up policy:
+	void begin_tick();
+	//finish the tick started by begin_tick() (records this tick's phase times):
+	void end_tick();
+	//add the time since 'start' to this tick's total for 'phase':
+	void add_time(Phase phase, Clock::time_point start);
+
+	//Durations in power-of-two microsecond buckets: bucket 0 is under 1us, bucket i is [2^(i-1), 2^i) us.
+	struct Histogram {
+		static constexpr size_t Buckets = 32;
+		std::array< uint64_t, Buckets > counts{};
+		uint64_t samples = 0;
+		double max = 0.0; //seconds
+
+		//upper bound of the bucket containing the given fraction of samples (seconds; at most 'max'):
+		double percentile(double fraction) const;
+		Histogram &operator+=(Histogram const &other);
+	};
+	//Histogram that one thread adds to while others read it (also used for other server timings):
+	struct AtomicHistogram {
+		std::array< std::atomic< uint64_t >, Histogram::Buckets > counts{};
+		std::atomic< uint64_t > samples{0};
+		std::atomic< double > max{0.0};
+		void add(double seconds); //(from one thread only)
+		Histogram load() const;
+	};
+
+	//A copy of the counters at one moment (stats() from several schedulers can be added together):
+	struct Stats {
+		uint64_t ticks = 0; //ticks run
+		uint64_t late = 0; //ticks that started after their scheduled time (by any amount)
+		uint64_t overruns = 0; //ticks that started a whole period or more late
+		uint64_t skipped = 0; //ticks dropped to catch up
+		uint64_t burst = 0; //extra ticks run back-to-back to catch up
+		double max_lateness = 0.0; //seconds
+		std::array< Histogram, PhaseCount > phases;
+		Histogram lateness;
+
+		Stats &operator+=(Stats const &other);
+		//human-readable summary:
+		void print(std::ostream &out) const;
+	};
+	Stats stats() const;
+
+	static char const *phase_name(Phase phase);
+
+private:
+	double period_seconds;
+	Clock::duration period_duration;
+	CatchUp catch_up;
+	uint32_t max_burst;
+
+	//(only touched by the owning thread:)
+	Clock::time_point next_tick; //when the next tick is scheduled
+	uint32_t burst_run = 0; //ticks run back-to-back so far
+	std::array< double, PhaseCount > tick_time{}; //this tick's per-phase totals
+
+	std::atomic< uint64_t > ticks{0};
+	std::atomic< uint64_t > late{0};
+	std::atomic< uint64_t > overruns{0};
+	std::atomic< uint64_t > skipped{0};
+	std::atomic< uint64_t > burst{0};
+	std::array< AtomicHistogram, PhaseCount > phases;
+	AtomicHistogram lateness;
+};
@@ -0,0 +1,573 @@
+//--------- OS-specific socket-related headers ---------
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1 //so we can use strerror()
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#undef APIENTRY
+#include <winsock2.h>
+#include <ws2tcpip.h> //for getaddrinfo
+#undef max
+#undef min
+
+#pragma comment(lib, "Ws2_32.lib") //link against the winsock2 library
+
+#define MSG_DONTWAIT 0 //on windows, sockets are set to non-blocking with an ioctl
+typedef int ssize_t;
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+
+#define closesocket close
+
+#endif
+
+#include "UdpChannel.hpp"
+
+//------------------------------------------------------
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+//Packet layout (multi-byte fields big-endian):
+//  u16 magic, u8 flags, u16 seq, u16 ack, u32 ack_bits
+//  then messages, each: u16 (size | 0x8000 if reliable), [u16 id if reliable], data
+static constexpr uint16_t Magic = 0x4331;
+static constexpr uint8_t FlagAcks = 0x01; //ack / ack_bits are valid
+static constexpr size_t HeaderSize = 11;
+static constexpr uint16_t ReliableBit = 0x8000;
+
+namespace {
+	//is sequence number a newer than b (allowing for wrap-around)?
+	bool newer(uint16_t a, uint16_t b) {
+		return int16_t(uint16_t(a - b)) > 0;
+	}
+
+	void put16(std::vector< char > &out, uint16_t v) {
+		out.push_back(char(v >> 8));
+		out.push_back(char(v & 0xff));
+	}
+	void put32(std::vector< char > &out, uint32_t v) {
+		put16(out, uint16_t(v >> 16));
+		put16(out, uint16_t(v & 0xffff));
+	}
+	uint16_t get16(char const *at) {
+		return uint16_t((uint8_t(at[0]) << 8) | uint8_t(at[1]));
+	}
+	uint32_t get32(char const *at) {
+		return (uint32_t(get16(at)) << 16) | get16(at + 2);
+	}
+
+	std::string address_name(char const *address, size_t size) {
+		char ip[INET6_ADDRSTRLEN];
+		sockaddr_storage storage;
+		std::memset(&storage, 0, sizeof(storage));
+		std::memcpy(&storage, address, std::min(size, sizeof(storage)));
+		if (storage.ss_family == AF_INET) {
+			sockaddr_in const &s = reinterpret_cast< sockaddr_in const & >(storage);
+			inet_ntop(AF_INET, &s.sin_addr, ip, sizeof(ip));
+			return std::string(ip) + ":" + std::to_string(ntohs(s.sin_port));
+		} else if (storage.ss_family == AF_INET6) {
+			sockaddr_in6 const &s = reinterpret_cast< sockaddr_in6 const & >(storage);
+			inet_ntop(AF_INET6, &s.sin6_addr, ip, sizeof(ip));
+			return "[" + std::string(ip) + "]:" + std::to_string(ntohs(s.sin6_port));
+		} else {
+			return "[unknown family]";
+		}
+	}
+
+	bool would_block() {
+		#ifdef _WIN32
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+		#else
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+		#endif
+	}
+}
+
+static_assert(sizeof(sockaddr_storage) <= sizeof(UdpChannel::address), "UdpChannel::address must hold any socket address.");
+
+//---------------------------------
+//UdpChannel:
+
+size_t UdpChannel::max_message_size() const {
+	return std::min< size_t >(mtu - HeaderSize - 4, 0x7fff);
+}
+
+void UdpChannel::send(void const *data, size_t size, bool reliable) {
+	if (size > max_message_size()) {
+		throw std::runtime_error("UdpChannel message of " + std::to_string(size) + " bytes doesn't fit in a packet (max " + std::to_string(max_message_size()) + ").");
+	}
+	if (closed) return;
+	char const *bytes = reinterpret_cast< char const * >(data);
+	if (reliable) {
+		reliable_out.emplace_back();
+		reliable_out.back().id = next_reliable_id++;
+		reliable_out.back().data.assign(bytes, bytes + size);
+	} else {
+		unreliable_out.emplace_back(bytes, bytes + size);
+	}
+	stats.messages_sent += 1;
+}
+
+void UdpChannel::ack_packet(uint16_t seq, Clock::time_point now) {
+	SentPacket &packet = sent[seq % Window];
+	if (!packet.used || packet.seq != seq || packet.acked) return;
+	packet.acked = true;
+	stats.packets_acked += 1;
+
+	double sample = std::chrono::duration< double >(now - packet.time).count();
+	if (stats.packets_acked == 1) rtt = sample;
+	else rtt += 0.125 * (sample - rtt);
+
+	for (uint16_t id : packet.reliable) {
+		if (reliable_out.empty()) break;
+		size_t index = uint16_t(id - reliable_out.front().id);
+		if (index < reliable_out.size()) reliable_out[index].acked = true;
+	}
+	while (!reliable_out.empty() && reliable_out.front().acked) reliable_out.pop_front();
+}
+
+bool UdpChannel::receive_packet(char const *data, size_t size, Clock::time_point now) {
+	if (size < HeaderSize || get16(data) != Magic) {
+		stats.malformed += 1;
+		return false;
+	}
+	uint8_t flags = uint8_t(data[2]);
+	uint16_t seq = get16(data + 3);
+	uint16_t ack = get16(data + 5);
+	uint32_t bits = get32(data + 7);
+
+	//check the messages are well-formed before changing any state:
+	for (size_t at = HeaderSize; at < size; ) {
+		if (at + 2 > size) { stats.malformed += 1; return false; }
+		uint16_t word = get16(data + at);
+		at += 2 + ((word & ReliableBit) ? 2 : 0) + (word & ~ReliableBit);
+		if (at > size) { stats.malformed += 1; return false; }
+	}
+
+	//track which packets have arrived (to ack them, and to drop duplicates):
+	// (acks only cover the newest 33, but duplicates are caught as far back as the window goes)
+	if (!received_any) {
+		received_any = true;
+		remote_seq = seq;
+		ack_bits = 0;
+	} else if (newer(seq, remote_seq)) {
+		uint16_t shift = uint16_t(seq - remote_seq);
+		if (shift > 32) ack_bits = 0;
+		else if (shift == 32) ack_bits = 0x80000000u;
+		else ack_bits = (ack_bits << shift) | (1u << (shift - 1));
+		//(forget whatever the skipped-over slots held, so they can't match a later packet)
+		for (uint16_t s = uint16_t(remote_seq + 1), n = 0; s != seq && n < Window; ++s, ++n) seen[s % Window] = -1;
+		remote_seq = seq;
+	} else {
+		uint16_t back = uint16_t(remote_seq - seq);
+		if (back >= Window) {
+			stats.stale += 1;
+			return false;
+		}
+		if (seen[seq % Window] == int32_t(seq)) {
+			stats.duplicates += 1;
+			if (size > HeaderSize) ack_owed = true; //(our ack may have been lost)
+			return false;
+		}
+		if (back <= 32) ack_bits |= (1u << (back - 1));
+	}
+	seen[seq % Window] = int32_t(seq);
+	//(packets with messages are acked even if we have nothing to say; acking empty ones would ping-pong)
+	if (size > HeaderSize) ack_owed = true;
+	last_received = now;
+	stats.packets_received += 1;
+	stats.bytes_received += size;
+
+	//acks for our packets:
+	if (flags & FlagAcks) {
+		ack_packet(ack, now);
+		for (uint32_t i = 0; i < 32; ++i) {
+			if (bits & (1u << i)) ack_packet(uint16_t(ack - 1 - i), now);
+		}
+		if (!have_acks || newer(ack, newest_ack)) {
+			newest_ack = ack;
+			have_acks = true;
+		}
+		//packets that 32 newer ones were acked ahead of aren't coming back:
+		uint16_t edge = uint16_t(newest_ack - 32);
+		while (loss_edge != next_seq && newer(edge, loss_edge)) {
+			SentPacket &packet = sent[loss_edge % Window];
+			if (packet.used && packet.seq == loss_edge && !packet.acked) {
+				stats.packets_lost += 1;
+				//resend its reliable messages on the next flush instead of waiting for the timer:
+				// (unless they already went out again since)
+				for (uint16_t id : packet.reliable) {
+					if (reliable_out.empty()) break;
+					size_t index = uint16_t(id - reliable_out.front().id);
+					if (index < reliable_out.size() && reliable_out[index].last_sent == packet.time) reliable_out[index].due = true;
+				}
+				packet.used = false;
+			}
+			loss_edge += 1;
+		}
+	}
+
+	//messages:
+	for (size_t at = HeaderSize; at < size; ) {
+		uint16_t word = get16(data + at);
+		at += 2;
+		size_t length = word & ~ReliableBit;
+		if (!(word & ReliableBit)) {
+			received.emplace_back();
+			received.back().data.assign(data + at, data + at + length);
+			stats.messages_received += 1;
+		} else {
+			uint16_t id = get16(data + at);
+			at += 2;
+			//(ids before next_deliver wrap around to large offsets -- those are duplicates)
+			size_t offset = uint16_t(id - next_deliver);
+			if (offset < Window) {
+				Held &slot = held[id % Window];
+				if (!slot.held) {
+					slot.held = true;
+					slot.data.assign(data + at, data + at + length);
+				}
+				//hand over everything that is now in order:
+				while (held[next_deliver % Window].held) {
+					Held &next = held[next_deliver % Window];
+					received.emplace_back();
+					received.back().reliable = true;
+					received.back().data = std::move(next.data);
+					next.data.clear();
+					next.held = false;
+					next_deliver += 1;
+					stats.messages_received += 1;
+				}
+			}
+		}
+		at += length;
+	}
+	return true;
+}
+
+void UdpChannel::build_packets(Clock::time_point now, UdpSettings const &settings, std::vector< std::vector< char > > *packets_) {
+	assert(packets_);
+	auto &packets = *packets_;
+	double resend_after = std::max(settings.min_resend, 1.5 * rtt);
+	auto resend_after_duration = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(resend_after));
+
+	std::vector< char > *packet = nullptr;
+	SentPacket *record = nullptr;
+	auto start_packet = [&]() {
+		packets.emplace_back();
+		packet = &packets.back();
+		packet->reserve(mtu);
+		put16(*packet, Magic);
+		packet->push_back(char(received_any ? FlagAcks : 0));
+		put16(*packet, next_seq);
+		put16(*packet, remote_seq);
+		put32(*packet, ack_bits);
+
+		record = &sent[next_seq % Window];
+		record->used = true;
+		record->acked = false;
+		record->seq = next_seq;
+		record->time = now;
+		record->reliable.clear();
+		next_seq += 1;
+	};
+	auto room_for = [&](size_t bytes) {
+		if (!packet || packet->size() + bytes > mtu) start_packet();
+	};
+
+	//reliable messages that are new, or due to be resent (only within the window the receiver can hold):
+	size_t in_window = std::min(reliable_out.size(), Window);
+	for (size_t i = 0; i < in_window; ++i) {
+		Outgoing &message = reliable_out[i];
+		if (message.acked) continue;
+		if (!message.due && now - message.last_sent < resend_after_duration) continue;
+		room_for(4 + message.data.size());
+		put16(*packet, uint16_t(message.data.size() | ReliableBit));
+		put16(*packet, message.id);
+		packet->insert(packet->end(), message.data.begin(), message.data.end());
+		record->reliable.emplace_back(message.id);
+		if (message.last_sent != Clock::time_point()) stats.resends += 1;
+		message.last_sent = now;
+		message.due = false;
+	}
+
+	for (auto const &data : unreliable_out) {
+		room_for(2 + data.size());
+		put16(*packet, uint16_t(data.size()));
+		packet->insert(packet->end(), data.begin(), data.end());
+	}
+	unreliable_out.clear();
+
+	//nothing to say, but owe the other side an ack (or it hasn't heard from us in a while):
+	if (!packet && (ack_owed || now - last_sent >= std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(settings.keepalive)))) {
+		start_packet();
+	}
+
+	if (packet) {
+		ack_owed = false;
+		last_sent = now;
+	}
+}
+
+//---------------------------------
+//UdpSocket:
+
+UdpSocket::UdpSocket() {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+	recv_buffer.resize(65536);
+}
+
+UdpSocket::~UdpSocket() {
+	if (socket != InvalidSocket) {
+		::closesocket(socket);
+		socket = InvalidSocket;
+	}
+}
+
+UdpChannel &UdpSocket::add_channel(char const *address, uint32_t address_size) {
+	channels.emplace_back();
+	UdpChannel &channel = channels.back();
+	std::memset(channel.address.data(), 0, channel.address.size());
+	std::memcpy(channel.address.data(), address, address_size);
+	channel.address_size = address_size;
+	channel.name = address_name(address, address_size);
+	channel.mtu = settings.mtu;
+	channel.last_received = UdpChannel::Clock::now();
+	by_address[std::string(address, address_size)] = &channel;
+	return channel;
+}
+
+void UdpSocket::send_to(char const *address, uint32_t address_size, std::vector< char > const &data) {
+	ssize_t ret = sendto(socket, data.data(), int(data.size()), MSG_DONTWAIT, reinterpret_cast< sockaddr const * >(address), int(address_size));
+	//(a full socket buffer just drops the packet -- it's UDP)
+	if (ret < 0 && !would_block()) {
+		std::cerr << "[UdpSocket] sendto failed: " << strerror(errno) << std::endl;
+	}
+}
+
+void UdpSocket::send_packet(UdpChannel &channel, std::vector< char > const &data, UdpChannel::Clock::time_point now) {
+	channel.stats.packets_sent += 1;
+	channel.stats.bytes_sent += data.size();
+	if (!impairment.active()) {
+		send_to(channel.address.data(), channel.address_size, data);
+		return;
+	}
+	std::uniform_real_distribution< double > unit(0.0, 1.0);
+	if (unit(mt) < impairment.loss) return;
+	double delay = impairment.latency + impairment.jitter * unit(mt);
+	if (unit(mt) < impairment.reorder) delay += impairment.reorder_delay;
+	if (delay <= 0.0) {
+		send_to(channel.address.data(), channel.address_size, data);
+		return;
+	}
+	Delayed packet;
+	packet.address = channel.address;
+	packet.address_size = channel.address_size;
+	packet.data = data;
+	delayed.emplace(now + std::chrono::duration_cast< UdpChannel::Clock::duration >(std::chrono::duration< double >(delay)), std::move(packet));
+}
+
+void UdpSocket::flush(UdpChannel::Clock::time_point now) {
+	for (auto &channel : channels) {
+		if (channel.closed) continue;
+		packets.clear();
+		channel.build_packets(now, settings, &packets);
+		for (auto const &packet : packets) send_packet(channel, packet, now);
+	}
+	//impaired packets whose time has come:
+	while (!delayed.empty() && delayed.begin()->first <= now) {
+		Delayed const &packet = delayed.begin()->second;
+		send_to(packet.address.data(), packet.address_size, packet.data);
+		delayed.erase(delayed.begin());
+	}
+}
+
+void UdpSocket::receive(UdpChannel::Clock::time_point now, std::function< void(UdpChannel *, UdpChannel::Event event) > const &on_event) {
+	while (true) {
+		sockaddr_storage from;
+		socklen_t from_size = sizeof(from);
+		ssize_t got = recvfrom(socket, recv_buffer.data(), int(recv_buffer.size()), MSG_DONTWAIT, reinterpret_cast< sockaddr * >(&from), &from_size);
+		if (got < 0) {
+			if (would_block()) break;
+			#ifndef _WIN32
+			if (errno == EINTR) continue;
+			#endif
+			//(e.g., ICMP port unreachable reported for an earlier send -- nothing to do but carry on)
+			break;
+		}
+
+		char const *address = reinterpret_cast< char const * >(&from);
+		UdpChannel *channel = nullptr;
+		auto f = by_address.find(std::string(address, from_size));
+		if (f != by_address.end()) {
+			channel = f->second;
+		} else if (accept_new && size_t(got) >= HeaderSize && get16(recv_buffer.data()) == Magic) {
+			channel = &add_channel(address, uint32_t(from_size));
+		} else {
+			continue; //(not from anyone we talk to)
+		}
+		if (channel->closed) continue;
+
+		size_t before = channel->received.size();
+		if (!channel->receive_packet(recv_buffer.data(), size_t(got), now)) continue;
+		if (!channel->opened) {
+			channel->opened = true;
+			if (on_event) on_event(channel, UdpChannel::OnOpen);
+		}
+		if (channel->received.size() != before && on_event) on_event(channel, UdpChannel::OnRecv);
+	}
+}
+
+void UdpSocket::poll(std::function< void(UdpChannel *, UdpChannel::Event event) > const &on_event, double timeout) {
+	typedef UdpChannel::Clock Clock;
+	Clock::time_point now = Clock::now();
+
+	//send whatever was queued since the last poll:
+	flush(now);
+
+	{ //wait for packets (or until the next delayed packet is due):
+		double wait = std::max(0.0, timeout);
+		if (!delayed.empty()) wait = std::min(wait, std::max(0.0, std::chrono::duration< double >(delayed.begin()->first - now).count()));
+		fd_set read_fds;
+		FD_ZERO(&read_fds);
+		FD_SET(socket, &read_fds);
+		struct timeval tv;
+		tv.tv_sec = long(wait);
+		tv.tv_usec = long((wait - std::floor(wait)) * 1e6);
+		int ret = select(int(socket) + 1, &read_fds, nullptr, nullptr, &tv);
+		if (ret < 0 && errno != EINTR) {
+			throw std::system_error(errno, std::system_category(), "failed to select() on udp socket");
+		}
+	}
+
+	now = Clock::now();
+	receive(now, on_event);
+
+	//close channels that went quiet (and forget closed ones, if a server):
+	auto timeout_duration = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(settings.timeout));
+	for (auto c = channels.begin(); c != channels.end(); /* later */) {
+		auto old = c;
+		++c;
+		if (!old->closed && now - old->last_received >= timeout_duration) {
+			std::cerr << "[UdpSocket] nothing from " << old->name << " for " << settings.timeout << "s, closing." << std::endl;
+			old->closed = true;
+			if (on_event) on_event(&*old, UdpChannel::OnClose);
+		}
+		if (old->closed && accept_new) {
+			by_address.erase(std::string(old->address.data(), old->address_size));
+			channels.erase(old);
+		}
+	}
+
+	//acks for what just arrived, and anything sent from the event handler:
+	flush(Clock::now());
+}
+
+//---------------------------------
+//UdpServer / UdpClient:
+
+static Socket make_udp_socket(int family, int type, int protocol) {
+	Socket s = ::socket(family, type, protocol);
+	if (s == InvalidSocket) return s;
+	#ifdef _WIN32
+	unsigned long one = 1;
+	bool nonblocking = (0 == ioctlsocket(s, FIONBIO, &one));
+	#else
+	int flags = fcntl(s, F_GETFL, 0);
+	bool nonblocking = (flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0);
+	#endif
+	if (!nonblocking) {
+		::closesocket(s);
+		return InvalidSocket;
+	}
+	return s;
+}
+
+UdpServer::UdpServer(std::string const &port) {
+	accept_new = true;
+
+	struct addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		Socket s = make_udp_socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == InvalidSocket) continue;
+		if (bind(s, info->ai_addr, int(info->ai_addrlen)) != 0) {
+			::closesocket(s);
+			continue;
+		}
+		socket = s;
+		std::cout << "[UdpServer] listening on " << address_name(reinterpret_cast< char const * >(info->ai_addr), info->ai_addrlen) << "." << std::endl;
+		break;
+	}
+	freeaddrinfo(res);
+
+	if (socket == InvalidSocket) {
+		throw std::runtime_error("Failed to bind to udp port " + port);
+	}
+}
+
+UdpClient::UdpClient(std::string const &host, std::string const &port) : channel(connect_to(host, port)) {
+	std::cout << "[UdpClient] talking to " << channel.name << "." << std::endl;
+}
+
+UdpChannel &UdpClient::connect_to(std::string const &host, std::string const &port) {
+	struct addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+	//(with no handshake to tell which address answers, prefer IPv4 -- what UdpServer binds first)
+	struct addrinfo *pick = res;
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		if (info->ai_family == AF_INET) {
+			pick = info;
+			break;
+		}
+	}
+	socket = make_udp_socket(pick->ai_family, pick->ai_socktype, pick->ai_protocol);
+	if (socket == InvalidSocket) {
+		int err = errno;
+		freeaddrinfo(res);
+		throw std::system_error(err, std::system_category(), "failed to create udp socket");
+	}
+	UdpChannel &c = add_channel(reinterpret_cast< char const * >(pick->ai_addr), uint32_t(pick->ai_addrlen));
+	freeaddrinfo(res);
+	return c;
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+/*
+ * UdpChannel is a message channel over UDP, for data that should arrive
+ * quickly rather than in order (e.g., per-frame input or state): unlike a
+ * TCP Connection, one lost packet doesn't hold up everything sent after it.
+ *
+ * As with Connection, you don't create channels yourself; a UdpServer makes
+ * a channel for each address that sends it packets, and a UdpClient has one
+ * channel to its server:
+
+//simple server
+UdpServer server("1337");
+while (true) {
+	server.poll([](UdpChannel *channel, UdpChannel::Event evt){
+		if (evt == UdpChannel::OnRecv) {
+			while (!channel->received.empty()) {
+				UdpChannel::Message &message = channel->received.front();
+				//... handle message.data ...
+				channel->received.pop_front();
+			}
+		}
+	}, 1.0);
+}
+
+//simple client
+UdpClient client("localhost", "1337");
+while (true) {
+	client.channel.send(&input, sizeof(input)); //unreliable
+	client.poll([](UdpChannel *channel, UdpChannel::Event evt){ }, 0.0);
+}
+
+ * Messages:
+ *  - unreliable messages (the default) are sent once; they may be lost or
+ *    arrive out of order, but never twice.
+ *  - reliable messages are resent until acknowledged and are delivered in
+ *    the order they were sent -- but never hold up unreliable ones.
+ *  - messages queued between polls are coalesced into as few packets as fit
+ *    in settings.mtu bytes.
+ *
+ * Each packet carries a sequence number and acknowledges the newest packet
+ * received along with the 32 before it (as a bitfield), so when traffic
+ * flows both ways acks cost no packets of their own. A packet not acked by
+ * the time 32 newer ones are is counted as lost, and any reliable messages
+ * in it are resent right away.
+ */
+
+#include "Connection.hpp" //for Socket
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct UdpSettings {
+	size_t mtu = 1200; //largest packet to send (bytes, including the packet header)
+	double keepalive = 0.25; //send an (empty) packet after this long without sending anything (seconds)
+	double timeout = 5.0; //close a channel after this long without hearing from it (seconds)
+	double min_resend = 0.02; //wait at least this long before resending an unacked reliable message (seconds)
+};
+
+//Packets to lose or delay on the way out (for testing how a game copes with a bad network):
+struct UdpImpairment {
+	double loss = 0.0; //probability that a packet is dropped
+	double latency = 0.0; //delay added to every packet (seconds)
+	double jitter = 0.0; //extra delay, uniform in [0, jitter] (seconds)
+	double reorder = 0.0; //probability that a packet is held back by reorder_delay (so later ones overtake it)
+	double reorder_delay = 0.02; //(seconds)
+	bool active() const { return loss > 0.0 || latency > 0.0 || jitter > 0.0 || reorder > 0.0; }
+};
+
+struct UdpChannel {
+	typedef std::chrono::steady_clock Clock;
+
+	//Queue a message (at most max_message_size() bytes) to go out on the next poll:
+	void send(void const *data, size_t size, bool reliable = false);
+	//Helper that sends any type as a message:
+	template< typename T >
+	void send(T const &t, bool reliable = false) {
+		send(&t, sizeof(T), reliable);
+	}
+	//largest message that fits in one packet:
+	size_t max_message_size() const;
+
+	//Messages received (oldest first); pop them once handled:
+	struct Message {
+		bool reliable = false;
+		std::vector< char > data;
+	};
+	std::deque< Message > received;
+
+	//Stop using this channel (a server forgets it on its next poll, without an OnClose event):
+	void close() { closed = true; }
+	explicit operator bool() const { return !closed; }
+
+	std::string name; //remote address, e.g., "127.0.0.1:1337"
+	double rtt = 0.1; //smoothed round-trip time (seconds; a guess until the first ack)
+
+	struct Stats {
+		uint64_t packets_sent = 0;
+		uint64_t packets_acked = 0;
+		uint64_t packets_lost = 0; //(judged lost when 32 newer packets were acked first)
+		uint64_t packets_received = 0;
+		uint64_t duplicates = 0; //received packets dropped as already seen
+		uint64_t stale = 0; //received packets dropped as too old to tell (Window or more behind)
+		uint64_t malformed = 0;
+		uint64_t messages_sent = 0;
+		uint64_t messages_received = 0;
+		uint64_t resends = 0; //reliable messages sent again
+		uint64_t bytes_sent = 0;
+		uint64_t bytes_received = 0;
+	} stats;
+
+	enum Event {
+		OnOpen, //(client: first packet from the server arrived; server: first packet from a new address)
+		OnRecv, //messages were added to 'received'
+		OnClose, //nothing heard for settings.timeout
+	};
+
+	//internals:
+	static constexpr size_t Window = 1024; //packets remembered for acks / reliable messages in flight
+	std::array< char, 128 > address; //(a sockaddr_storage)
+	uint32_t address_size = 0;
+	bool closed = false;
+	bool opened = false; //OnOpen generated
+	Clock::time_point last_sent, last_received;
+
+	//sending:
+	uint16_t next_seq = 0;
+	struct SentPacket {
+		bool used = false;
+		bool acked = false;
+		uint16_t seq = 0;
+		Clock::time_point time;
+		std::vector< uint16_t > reliable; //ids of the reliable messages it carried
+	};
+	std::vector< SentPacket > sent = std::vector< SentPacket >(Window); //indexed by seq % Window
+	bool have_acks = false;
+	uint16_t newest_ack = 0;
+	uint16_t loss_edge = 0; //oldest packet not yet acked or judged lost
+	struct Outgoing {
+		uint16_t id = 0;
+		std::vector< char > data;
+		bool acked = false;
+		bool due = true; //send (again) on the next flush regardless of time
+		Clock::time_point last_sent;
+	};
+	std::deque< Outgoing > reliable_out; //in id order, starting with the oldest unacked
+	uint16_t next_reliable_id = 0;
+	std::deque< std::vector< char > > unreliable_out;
+	size_t mtu = 1200; //(copied from the owner's settings)
+
+	//receiving:
+	bool received_any = false;
+	bool ack_owed = false; //received packets with messages since last sending one
+	uint16_t remote_seq = 0; //newest packet received
+	uint32_t ack_bits = 0; //bit i: packet remote_seq - 1 - i received
+	std::vector< int32_t > seen = std::vector< int32_t >(Window, -1); //sequence numbers received, by seq % Window (-1: none)
+	uint16_t next_deliver = 0; //next reliable id to hand over
+	struct Held {
+		bool held = false;
+		std::vector< char > data;
+	};
+	std::vector< Held > held = std::vector< Held >(Window); //reliable messages that arrived early, by id % Window
+
+	//handle a packet; returns false if it was dropped (duplicate, stale, or malformed):
+	bool receive_packet(char const *data, size_t size, Clock::time_point now);
+	void ack_packet(uint16_t seq, Clock::time_point now);
+	//build the packets to send now (appends to 'packets'):
+	void build_packets(Clock::time_point now, UdpSettings const &settings, std::vector< std::vector< char > > *packets);
+};
+
+//Socket shared by a UdpServer's / UdpClient's channels:
+struct UdpSocket {
+	UdpSocket();
+	~UdpSocket();
+	UdpSocket(UdpSocket const &) = delete;
+	UdpSocket &operator=(UdpSocket const &) = delete;
+
+	//poll() sends queued messages, receives packets, and closes silent channels:
+	// (will wait up to 'timeout' for the first packet)
+	void poll(
+		std::function< void(UdpChannel *, UdpChannel::Event event) > const &channel_event = nullptr,
+		double timeout = 0.0 //timeout (seconds)
+	);
+
+	std::list< UdpChannel > channels;
+	UdpSettings settings;
+	UdpImpairment impairment; //(applied to packets sent from this socket)
+
+	//internals:
+	Socket socket = InvalidSocket;
+	bool accept_new = false; //make channels for unknown addresses (server)
+	std::unordered_map< std::string, UdpChannel * > by_address;
+	std::vector< std::vector< char > > packets; //(scratch space for flush)
+	std::vector< char > recv_buffer;
+	//impaired packets waiting to go out (by release time):
+	struct Delayed {
+		std::array< char, 128 > address;
+		uint32_t address_size = 0;
+		std::vector< char > data;
+	};
+	std::multimap< UdpChannel::Clock::time_point, Delayed > delayed;
+	std::mt19937 mt{0x15466};
+
+	UdpChannel &add_channel(char const *address, uint32_t address_size);
+	void flush(UdpChannel::Clock::time_point now);
+	void send_packet(UdpChannel &channel, std::vector< char > const &data, UdpChannel::Clock::time_point now);
+	void send_to(char const *address, uint32_t address_size, std::vector< char > const &data);
+	void receive(UdpChannel::Clock::time_point now, std::function< void(UdpChannel *, UdpChannel::Event event) > const &on_event);
+};
+
+struct UdpServer : UdpSocket {
+	UdpServer(std::string const &port); //pass the port number to listen on, as a string
+};
+
+struct UdpClient : UdpSocket {
+	//look up host:port (blocking) and make a channel to it; OnOpen comes when the server first answers:
+	UdpClient(std::string const &host, std::string const &port);
+	UdpChannel &channel; //the only channel
+
+	//internals:
+	UdpChannel &connect_to(std::string const &host, std::string const &port); //(makes the socket and channel)
+};
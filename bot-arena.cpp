@@ -0,0 +1,167 @@
+//Headless bot benchmark:
+// - measures Monte Carlo playouts/second, on one thread and on all of them
+// - plays games between bot configurations (rotating seats) and reports win rates
+//
+// Usage: ./bot-arena [--games N] [--time seconds-per-move] [--threads N] [config ...]
+// where each config is 'maxn', 'random', or 'mcts' with optional settings,
+// e.g. 'mcts:batch=1' or 'mcts:batch=16:c=0.7'. (default: maxn mcts mcts:batch=1)
+
+#include "ChessBot.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Config {
+	std::string name;
+	ChessBot::Method method = ChessBot::MaxN;
+	bool random = false; //just play a random legal move
+	uint32_t batch = 8;
+	float exploration = 1.0f;
+	std::unique_ptr< ChessBot > bot;
+
+	uint32_t wins = 0, ties = 0, losses = 0;
+};
+
+static bool parse_config(std::string const &spec, Config *config) {
+	config->name = spec;
+	std::istringstream in(spec);
+	std::string part;
+	std::getline(in, part, ':');
+	if (part == "maxn") config->method = ChessBot::MaxN;
+	else if (part == "mcts") config->method = ChessBot::MonteCarlo;
+	else if (part == "random") config->random = true;
+	else return false;
+	while (std::getline(in, part, ':')) {
+		if (part.compare(0, 6, "batch=") == 0) config->batch = uint32_t(std::stoul(part.substr(6)));
+		else if (part.compare(0, 2, "c=") == 0) config->exploration = std::stof(part.substr(2));
+		else return false;
+	}
+	return true;
+}
+
+//wait for a search to finish (the arena has nothing better to do):
+static void wait(ChessBot::Search const &search) {
+	while (!search.done()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+int main(int argc, char **argv) {
+	size_t games = 12;
+	double budget = 0.1;
+	size_t threads = std::max(1U, std::thread::hardware_concurrency());
+	std::vector< std::string > specs;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--games" && argi + 1 < argc) games = std::stoul(argv[++argi]);
+		else if (arg == "--time" && argi + 1 < argc) budget = std::stod(argv[++argi]);
+		else if (arg == "--threads" && argi + 1 < argc) threads = std::max< size_t >(1, std::stoul(argv[++argi]));
+		else if (arg[0] != '-') specs.emplace_back(arg);
+		else {
+			std::cerr << "Usage:\n\t./bot-arena [--games N] [--time seconds-per-move] [--threads N] [config ...]" << std::endl;
+			return 1;
+		}
+	}
+	if (specs.empty()) specs = {"maxn", "mcts", "mcts:batch=1"};
+
+	std::vector< Config > configs(specs.size());
+	for (size_t i = 0; i < specs.size(); ++i) {
+		if (!parse_config(specs[i], &configs[i])) {
+			std::cerr << "Unknown bot config '" << specs[i] << "'." << std::endl;
+			return 1;
+		}
+		configs[i].bot = std::make_unique< ChessBot >(threads);
+		configs[i].bot->playout_batch = configs[i].batch;
+		configs[i].bot->exploration = configs[i].exploration;
+	}
+
+	//------------ playout speed ------------
+	{
+		//a position from the middle of a game (so playouts are not trivially short or long):
+		ChessBoard board;
+		std::mt19937 mt(466);
+		for (int placed = 0; placed < ChessBoard::Width * ChessBoard::Width / 5; ) {
+			int x = int(mt() % ChessBoard::Width), y = int(mt() % ChessBoard::Width);
+			if (!board.empty(x, y)) continue;
+			int player = placed % PLAYER_NUM + 1;
+			board.set(x, y, player);
+			if (board.has_line(player)) board.set(x, y, 0);
+			else ++placed;
+		}
+
+		std::cout << "Monte Carlo playouts (" << ChessBoard::Width << "x" << ChessBoard::Width << " board, 1s each):" << std::endl;
+		for (size_t count : {size_t(1), threads}) {
+			ChessBot bot(count);
+			auto search = bot.think(board, 1, 1.0, ChessBot::MonteCarlo);
+			auto before = std::chrono::steady_clock::now();
+			wait(*search);
+			double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+			double rate = search->playouts / seconds;
+			std::cout << "  " << count << " thread(s): " << std::fixed << std::setprecision(0) << rate << " playouts/s, "
+			          << rate / count << " per core (tree: " << search->nodes << " nodes, depth " << search->depth << ")" << std::endl;
+			std::cout.unsetf(std::ios::fixed);
+			if (count == threads) break;
+		}
+	}
+
+	//------------ arena ------------
+	std::cout << "Arena: " << games << " games, " << budget << "s per move, " << threads << " thread(s) per bot." << std::endl;
+	std::mt19937 mt(0x15466);
+	for (size_t game = 0; game < games; ++game) {
+		//rotate who sits where, so no config always moves first:
+		std::vector< Config * > seats;
+		for (int seat = 0; seat < PLAYER_NUM; ++seat) {
+			seats.emplace_back(&configs[(game + seat) % configs.size()]);
+		}
+
+		ChessBoard board;
+		int player = 1;
+		int winner = 0;
+		for (int move = 0; move < ChessBoard::Width * ChessBoard::Width; ++move) {
+			Config &config = *seats[player - 1];
+			int x = -1, y = -1;
+			if (config.random) {
+				do {
+					x = int(mt() % ChessBoard::Width);
+					y = int(mt() % ChessBoard::Width);
+				} while (!board.empty(x, y));
+			} else {
+				auto search = config.bot->think(board, player, budget, config.method);
+				wait(*search);
+				x = search->x;
+				y = search->y;
+			}
+			if (x < 0) break;
+			board.set(x, y, player);
+			if (board.has_line(player)) {
+				winner = player;
+				break;
+			}
+			player = player % PLAYER_NUM + 1;
+		}
+
+		std::cout << "  game " << game + 1 << ":";
+		for (int seat = 0; seat < PLAYER_NUM; ++seat) {
+			Config &config = *seats[seat];
+			if (winner == 0) config.ties += 1;
+			else if (winner == seat + 1) config.wins += 1;
+			else config.losses += 1;
+			std::cout << " " << (seat + 1) << "=" << config.name;
+		}
+		std::cout << " -> " << (winner ? "player " + std::to_string(winner) + " (" + seats[winner - 1]->name + ") wins" : std::string("tie")) << std::endl;
+	}
+
+	std::cout << "Results:" << std::endl;
+	for (auto const &config : configs) {
+		uint32_t played = config.wins + config.ties + config.losses;
+		std::cout << "  " << std::setw(20) << std::left << config.name << std::right
+		          << " played " << played << ", won " << config.wins << " (" << (played ? 100 * config.wins / played : 0) << "%), tied " << config.ties << std::endl;
+	}
+	return 0;
+}
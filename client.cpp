@@ -14,6 +14,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -34,13 +35,21 @@ int main(int argc, char **argv) {
 	try {
 #endif
 	//------------ command line arguments ------------
-	if (argc != 3) {
-		std::cerr << "Usage:\n\t./client <host> <port>" << std::endl;
+	//(--watch [room]: watch a game -- by default, whichever the server is featuring -- instead of playing)
+	bool watch = false;
+	uint32_t watch_room = 0;
+	if (argc == 4 || argc == 5) {
+		watch = (std::string(argv[3]) == "--watch");
+		if (watch && argc == 5) watch_room = uint32_t(std::stoul(argv[4]));
+	}
+	if (argc != 3 && !watch) {
+		std::cerr << "Usage:\n\t./client <host> <port> [--watch [room]]" << std::endl;
 		return 1;
 	}
 
 	//------------ connect to server --------------
-	Client client(argv[1], argv[2]);
+	//(without blocking: PlayMode shows the connection's progress, and it retries until the server answers)
+	auto client = std::make_unique< Client >(argv[1], argv[2], Client::Retry());
 
 	//------------  initialization ------------
 
@@ -109,7 +118,9 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >(client));
+	auto play = std::make_shared< PlayMode >(argv[1], argv[2], std::move(client));
+	if (watch) play->watch(watch_room);
+	Mode::set_current(play);
 
 	//------------ main loop ------------
 
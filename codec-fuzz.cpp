@@ -0,0 +1,355 @@
+//Headless test of MessageCodec framing and the ChessMessages payloads (no SDL, no sockets).
+// Usage: ./codec-fuzz [--seed N] [--rounds R]
+//  round-trip: every message type in ChessMessages.hpp (boards through pack_board/unpack_board)
+//    is sent with send_message, encode_message, and append_message, delivered in random-sized
+//    pieces, and must come out of MessageDispatcher::dispatch unchanged.
+//  truncated: each message cut short at every length is left buffered, unhandled, until the
+//    rest arrives.
+//  oversized: a payload above max_payload stops dispatch with TooLarge before it is buffered.
+//  random: streams of random frames (unknown types, sizes over max_payload, payloads crossing
+//    slabs) and of random bytes are fed in random-sized pieces; every message a handler sees
+//    must be exactly the next bytes that were delivered, and dispatch must only stop where the
+//    front of the buffer really is incomplete or bad.
+// Handlers check each MessageView against a copy of everything delivered, so a view that runs
+// past the data in recv_buffer is caught; build with -fsanitize=address to also catch reads.
+// Exits non-zero on the first failure.
+
+#include "MessageCodec.hpp"
+#include "ChessMessages.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static void fail(std::string const &what) {
+	std::cerr << "FAILED: " << what << std::endl;
+	std::exit(1);
+}
+
+//A receiving connection plus a copy of every byte delivered to it, so handlers can check
+// that each message they are shown is exactly the next bytes of the stream:
+struct Receiver {
+	Connection connection;
+	MessageDispatcher dispatcher;
+	std::vector< char > delivered; //every byte pushed into recv_buffer
+	size_t handled = 0; //bytes of 'delivered' consumed by handled messages
+	std::vector< std::pair< uint8_t, std::vector< char > > > messages; //(type, payload) of each handled message
+
+	Receiver() {
+		//(never a real socket; dispatch just needs the connection to look open)
+		connection.socket = Socket(1);
+	}
+	~Receiver() {
+		connection.socket = InvalidSocket;
+	}
+
+	//register a checking handler for 'type':
+	void expect(uint8_t type) {
+		dispatcher.on(type, [this](Connection *c, MessageView const &message) {
+			if (c != &connection) fail("handler called with the wrong connection");
+			SlabBuffer &buffer = connection.recv_buffer;
+			size_t whole = MessageHeaderSize + message.size;
+			if (buffer.size() < whole) fail("message extends past the end of recv_buffer");
+			if (handled + buffer.size() != delivered.size()) fail("recv_buffer lost track of the stream");
+			if (message.size > dispatcher.max_payload) fail("handler saw a payload over max_payload");
+			if (uint8_t(delivered[handled]) != message.type) fail("message type doesn't match the stream");
+			char const *expected = delivered.data() + handled;
+			if (message.size && std::memcmp(message.data, expected + MessageHeaderSize, message.size) != 0) {
+				fail("payload doesn't match the stream");
+			}
+			if (std::memcmp(message.data - MessageHeaderSize, expected, MessageHeaderSize) != 0) {
+				fail("header isn't right before the payload");
+			}
+			messages.emplace_back(message.type, std::vector< char >(message.data, message.data + message.size));
+			handled += whole;
+		});
+	}
+
+	void deliver(char const *data, size_t size) {
+		connection.recv_buffer.push(data, size);
+		delivered.insert(delivered.end(), data, data + size);
+	}
+
+	//dispatch, then check that it stopped for the reason it gave:
+	MessageDispatcher::Status dispatch() {
+		MessageDispatcher::Status status = dispatcher.dispatch(&connection);
+		SlabBuffer &buffer = connection.recv_buffer;
+		if (handled + buffer.size() != delivered.size()) fail("dispatch consumed bytes no handler was shown");
+		if (buffer.size() < MessageHeaderSize) {
+			if (status != MessageDispatcher::Ok) fail("error status without a whole header buffered");
+			return status;
+		}
+		uint8_t type = uint8_t(buffer[0]);
+		size_t size = (size_t(uint8_t(buffer[1])) << 16) | (size_t(uint8_t(buffer[2])) << 8) | size_t(uint8_t(buffer[3]));
+		if (status == MessageDispatcher::UnknownType) {
+			if (dispatcher.handlers[type] || dispatcher.bad_type != type) fail("UnknownType for a type with a handler");
+		} else if (status == MessageDispatcher::TooLarge) {
+			if (size <= dispatcher.max_payload || dispatcher.bad_type != type) fail("TooLarge for a payload within max_payload");
+		} else {
+			if (!dispatcher.handlers[type]) fail("Ok with an unknown type at the front");
+			if (size > dispatcher.max_payload) fail("Ok with an oversized payload at the front");
+			if (buffer.size() >= MessageHeaderSize + size) fail("Ok with a complete message left unhandled");
+		}
+		return status;
+	}
+
+	//after an error the server would disconnect; start over on a fresh stream:
+	void reset() {
+		connection.recv_buffer.clear();
+		delivered.clear();
+		handled = 0;
+	}
+};
+
+//all bytes queued on a (socketless) connection by send/send_message:
+static std::vector< char > sent_bytes(Connection &connection) {
+	std::vector< char > bytes;
+	for (auto const &segment : connection.send_segments) {
+		if (segment.block) {
+			bytes.insert(bytes.end(), segment.block->begin() + segment.offset, segment.block->begin() + segment.offset + segment.size);
+		} else {
+			size_t at = bytes.size();
+			bytes.resize(at + segment.size);
+			connection.send_buffer.read(bytes.data() + at, segment.size);
+		}
+	}
+	return bytes;
+}
+
+//deliver 'bytes' in random-sized pieces, dispatching after each:
+static void deliver_in_pieces(Receiver &receiver, std::vector< char > const &bytes, std::mt19937 &mt, size_t max_piece) {
+	for (size_t at = 0; at < bytes.size(); /* later */) {
+		size_t piece = std::min(bytes.size() - at, size_t(1 + mt() % max_piece));
+		receiver.deliver(bytes.data() + at, piece);
+		at += piece;
+		if (receiver.dispatch() != MessageDispatcher::Ok) fail("dispatch failed on valid messages");
+	}
+}
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./codec-fuzz [--seed N] [--rounds R]" << std::endl;
+		return 1;
+	};
+	uint32_t seed = 1;
+	size_t rounds = 200;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--seed" && argi + 1 < argc) seed = uint32_t(std::stoul(argv[++argi]));
+		else if (arg == "--rounds" && argi + 1 < argc) rounds = std::stoul(argv[++argi]);
+		else return usage();
+	}
+	if (rounds == 0) return usage();
+	std::mt19937 mt(seed);
+
+	uint8_t const types[] = {
+		MessageMove, MessageResync, MessageRejoin, MessageWatch, MessageBoard,
+		MessageMoveDelta, MessageState, MessageName, MessageStatus, MessageSeat,
+	};
+
+	//a random board, and a random message of each type (as (type, payload)):
+	auto random_board = [&]() {
+		ChessBoard board;
+		for (int x = 0; x < ChessBoard::Width; ++x) {
+			for (int y = 0; y < ChessBoard::Width; ++y) {
+				if (mt() % 3 == 0) board.set(x, y, int(1 + mt() % PLAYER_NUM));
+			}
+		}
+		return board;
+	};
+	auto random_text = [&]() {
+		std::string text(mt() % 64, ' ');
+		for (char &c : text) c = char(' ' + mt() % 95);
+		return std::vector< char >(text.begin(), text.end());
+	};
+	auto as_bytes = [](auto const &value) {
+		char const *at = reinterpret_cast< char const * >(&value);
+		return std::vector< char >(at, at + sizeof(value));
+	};
+	std::vector< ChessBoard > boards; //(boards sent, in order, to check after unpacking)
+	auto random_message = [&](uint8_t type) -> std::vector< char > {
+		if (type == MessageMove) {
+			int8_t xy[2] = {int8_t(mt()), int8_t(mt())};
+			return std::vector< char >(reinterpret_cast< char * >(xy), reinterpret_cast< char * >(xy) + 2);
+		} else if (type == MessageResync) {
+			return as_bytes(uint32_t(mt()));
+		} else if (type == MessageRejoin || type == MessageSeat) {
+			SeatMessage seat;
+			seat.room = mt();
+			seat.seat = mt() % (PLAYER_NUM + 1);
+			seat.token = (uint64_t(mt()) << 32) | mt();
+			return as_bytes(seat);
+		} else if (type == MessageWatch) {
+			WatchMessage watch;
+			watch.room = mt();
+			return as_bytes(watch);
+		} else if (type == MessageBoard) {
+			boards.emplace_back(random_board());
+			BoardSnapshotHeader header;
+			header.seq = mt();
+			header.width = uint8_t(BoardWidth);
+			std::vector< char > payload = as_bytes(header);
+			uint8_t packed[PackedBoardBytes];
+			pack_board(boards.back(), packed);
+			payload.insert(payload.end(), packed, packed + PackedBoardBytes);
+			return payload;
+		} else if (type == MessageMoveDelta) {
+			MoveDeltaMessage delta;
+			delta.seq = mt();
+			delta.x = int8_t(mt());
+			delta.y = int8_t(mt());
+			delta.player = uint8_t(1 + mt() % PLAYER_NUM);
+			return as_bytes(delta);
+		} else if (type == MessageState) {
+			StateMessage state;
+			state.current_player = uint8_t(mt() % (PLAYER_NUM + 1));
+			state.game_state = uint8_t(mt() % 3);
+			state.player_id = uint8_t(mt() % (PLAYER_NUM + 1));
+			return as_bytes(state);
+		} else { //MessageName, MessageStatus
+			return random_text();
+		}
+	};
+
+	//---- round-trip ----
+	for (size_t round = 0; round < rounds; ++round) {
+		Receiver receiver;
+		for (uint8_t type : types) receiver.expect(type);
+		boards.clear();
+
+		std::vector< std::pair< uint8_t, std::vector< char > > > expected;
+		std::vector< char > stream;
+		//each type, three ways:
+		Connection sender;
+		for (uint8_t type : types) {
+			expected.emplace_back(type, random_message(type));
+			send_message(sender, type, expected.back().second.data(), expected.back().second.size());
+		}
+		stream = sent_bytes(sender);
+		for (uint8_t type : types) {
+			expected.emplace_back(type, random_message(type));
+			SharedBytes block = encode_message(type, expected.back().second.data(), expected.back().second.size());
+			stream.insert(stream.end(), block->begin(), block->end());
+		}
+		std::vector< char > block;
+		for (uint8_t type : types) {
+			expected.emplace_back(type, random_message(type));
+			append_message(&block, type, expected.back().second.data(), expected.back().second.size());
+		}
+		stream.insert(stream.end(), block.begin(), block.end());
+
+		deliver_in_pieces(receiver, stream, mt, (round % 2 ? 7 : 1 << 15));
+		if (receiver.connection.recv_buffer.size() != 0) fail("round-trip: bytes left over");
+		if (receiver.messages != expected) fail("round-trip: messages differ from what was sent");
+
+		//boards survive pack_board/unpack_board:
+		size_t board_index = 0;
+		for (auto const &message : receiver.messages) {
+			if (message.first != MessageBoard) continue;
+			if (message.second.size() != sizeof(BoardSnapshotHeader) + PackedBoardBytes) fail("round-trip: board payload has the wrong size");
+			ChessBoard board = random_board(); //(unpack_board must clear whatever was there)
+			unpack_board(reinterpret_cast< uint8_t const * >(message.second.data() + sizeof(BoardSnapshotHeader)), &board);
+			ChessBoard const &original = boards.at(board_index++);
+			for (int x = 0; x < ChessBoard::Width; ++x) {
+				for (int y = 0; y < ChessBoard::Width; ++y) {
+					if (board.at(x, y) != original.at(x, y)) fail("round-trip: unpacked board differs");
+				}
+			}
+		}
+		if (board_index != boards.size()) fail("round-trip: boards went missing");
+	}
+	std::cout << "round-trip: " << rounds << " rounds of " << 3 * sizeof(types) << " messages ok" << std::endl;
+
+	//---- truncated ----
+	for (uint8_t type : types) {
+		std::vector< char > payload = random_message(type);
+		SharedBytes whole = encode_message(type, payload.data(), payload.size());
+		for (size_t cut = 0; cut < whole->size(); ++cut) {
+			Receiver receiver;
+			receiver.expect(type);
+			receiver.deliver(whole->data(), cut);
+			if (receiver.dispatch() != MessageDispatcher::Ok) fail("truncated: dispatch failed on a partial message");
+			if (!receiver.messages.empty()) fail("truncated: partial message was handled");
+			if (receiver.connection.recv_buffer.size() != cut) fail("truncated: partial message wasn't left buffered");
+			receiver.deliver(whole->data() + cut, whole->size() - cut);
+			if (receiver.dispatch() != MessageDispatcher::Ok || receiver.messages.size() != 1) fail("truncated: completed message wasn't handled");
+		}
+	}
+	std::cout << "truncated: every cut of every type ok" << std::endl;
+
+	//---- oversized ----
+	{
+		Receiver receiver;
+		receiver.expect(MessageName);
+		receiver.dispatcher.max_payload = 64;
+		std::vector< char > payload(65, 'x');
+		SharedBytes block = encode_message(MessageName, payload.data(), payload.size());
+		receiver.deliver(block->data(), MessageHeaderSize); //(just the header: rejected before the payload arrives)
+		if (receiver.dispatch() != MessageDispatcher::TooLarge) fail("oversized: payload over max_payload accepted");
+		if (!receiver.messages.empty()) fail("oversized: message was handled");
+
+		Receiver biggest;
+		biggest.expect(MessageName);
+		biggest.dispatcher.max_payload = 1 << 16;
+		char header[MessageHeaderSize] = {char(MessageName), char(0xff), char(0xff), char(0xff)};
+		biggest.deliver(header, sizeof(header));
+		if (biggest.dispatch() != MessageDispatcher::TooLarge) fail("oversized: largest size field accepted");
+	}
+	std::cout << "oversized: ok" << std::endl;
+
+	//---- random ----
+	uint64_t frames = 0, errors = 0, handled = 0;
+	for (size_t round = 0; round < rounds; ++round) {
+		Receiver receiver;
+		//a random subset of types have handlers, and a random payload limit:
+		for (uint32_t type = 0; type < 256; ++type) {
+			if (mt() % 4 != 0) receiver.expect(uint8_t(type));
+		}
+		receiver.dispatcher.max_payload = (round % 3 == 0 ? MaxMessagePayload : size_t(mt() % 40000));
+
+		//random frames (sometimes with random bytes in between), crossing slab boundaries now and then:
+		std::vector< char > stream;
+		std::vector< size_t > starts; //where each frame starts (to pick up from after a bad one)
+		while (stream.size() < 200000) {
+			uint32_t kind = mt() % 16;
+			if (kind == 0) {
+				size_t count = mt() % 16;
+				for (size_t i = 0; i < count; ++i) stream.emplace_back(char(mt()));
+				continue;
+			}
+			size_t size = (kind < 3 ? size_t(mt() % 40000) : size_t(mt() % 64));
+			std::vector< char > payload(size);
+			for (char &c : payload) c = char(mt());
+			starts.emplace_back(stream.size());
+			append_message(&stream, uint8_t(mt()), payload.data(), payload.size());
+			frames += 1;
+		}
+		if (round % 4 == 1) {
+			for (char &c : stream) c = char(mt()); //(or nothing but noise)
+			starts.clear();
+		}
+
+		for (size_t at = 0; at < stream.size(); /* later */) {
+			size_t piece = std::min(stream.size() - at, size_t(1 + mt() % (round % 2 ? 16 : 20000)));
+			receiver.deliver(stream.data() + at, piece);
+			at += piece;
+			if (receiver.dispatch() != MessageDispatcher::Ok) {
+				//(as if the sender had reconnected and carried on with its next frame)
+				errors += 1;
+				handled += receiver.messages.size();
+				receiver.messages.clear();
+				receiver.reset();
+				auto next = std::upper_bound(starts.begin(), starts.end(), at - 1);
+				if (next != starts.end()) at = *next;
+			}
+		}
+		handled += receiver.messages.size();
+	}
+	std::cout << "random: " << frames << " frames in " << rounds << " streams ok (" << handled << " messages handled, "
+	          << errors << " stops at a bad frame)" << std::endl;
+	return 0;
+}
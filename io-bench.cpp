@@ -0,0 +1,193 @@
+//Benchmark: the Server's socket polling backends (select / epoll / io_uring), on loopback.
+// Usage: ./io-bench [--port P] [--connections N] [--idle M] [--depth D] [--size bytes] [--seconds S] [--backends select,epoll,uring]
+// For each backend, runs an echo Server on its own thread; N connections (driven from this
+// thread by a second, epoll-based Server) each keep D messages in flight, sending a new one
+// whenever one comes back. M more connections just sit there idle, which is what costs
+// select() (and no one else) time per poll. Reports echoed messages per second, the echo
+// thread's CPU time per message, and round-trip latency percentiles.
+
+#include "Connection.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./io-bench [--port P] [--connections N] [--idle M] [--depth D] [--size bytes] [--seconds S] [--backends select,epoll,uring]" << std::endl;
+		return 1;
+	};
+	int port = 15470;
+	size_t connections = 100;
+	size_t idle = 0;
+	size_t depth = 4;
+	size_t size = 64;
+	double seconds = 3.0;
+	std::string backends = "select,epoll,uring";
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--port" && argi + 1 < argc) port = std::stoi(argv[++argi]);
+		else if (arg == "--connections" && argi + 1 < argc) connections = std::stoul(argv[++argi]);
+		else if (arg == "--idle" && argi + 1 < argc) idle = std::stoul(argv[++argi]);
+		else if (arg == "--depth" && argi + 1 < argc) depth = std::stoul(argv[++argi]);
+		else if (arg == "--size" && argi + 1 < argc) size = std::stoul(argv[++argi]);
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else if (arg == "--backends" && argi + 1 < argc) backends = argv[++argi];
+		else return usage();
+	}
+	typedef std::chrono::steady_clock Clock;
+	size = std::max(size, sizeof(int64_t));
+	if (!(connections > 0 && depth > 0 && seconds > 0.0)) return usage();
+
+	Log::set_level(Log::Warn); //(don't log every connection)
+
+	std::cout << connections << " connections (+" << idle << " idle), " << depth << " messages of " << size << " bytes in flight on each, "
+	          << seconds << "s per backend:" << std::endl;
+
+	for (size_t at = 0; at < backends.size(); /* later */) {
+		size_t comma = std::min(backends.find(',', at), backends.size());
+		std::string name = backends.substr(at, comma - at);
+		at = comma + 1;
+		PollBackend backend;
+		if (name == "select") backend = PollBackend::Select;
+		else if (name == "epoll") backend = PollBackend::Epoll;
+		else if (name == "uring") backend = PollBackend::IoUring;
+		else return usage();
+		if (backend == PollBackend::Select && 2 * (connections + idle) + 16 > FD_SETSIZE) {
+			std::cout << "  select: skipped (" << 2 * (connections + idle) << " sockets (both ends) won't fit in an fd_set)" << std::endl;
+			continue;
+		}
+
+		//------------ echo server ------------
+		std::string service = std::to_string(port++); //(a fresh port per backend, so nothing lingers in TIME_WAIT)
+		Server echo(service, backend);
+		if (echo.backend != backend) {
+			std::cout << "  " << name << ": not available here (would fall back to " << Server::backend_name(echo.backend) << "), skipped" << std::endl;
+			continue;
+		}
+		std::atomic< bool > stop(false);
+		std::thread echo_thread([&]() {
+			std::vector< char > data;
+			while (!stop.load(std::memory_order_relaxed)) {
+				echo.poll([&](Connection *c, Connection::Event evt) {
+					if (evt != Connection::OnRecv) return;
+					data.resize(c->recv_buffer.size());
+					c->recv_buffer.read(data.data(), data.size());
+					c->send_raw(data.data(), data.size());
+				}, 0.01);
+			}
+		});
+
+		//------------ load ------------
+		//connect everything first (blocking connects, then handed to a poll-driven Server):
+		Server load(PollBackend::Epoll);
+		std::vector< Socket > idle_sockets;
+		bool failed = false;
+		for (size_t i = 0; i < connections + idle && !failed; ++i) {
+			Socket s = socket(AF_INET, SOCK_STREAM, 0);
+			struct sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons(uint16_t(std::stoi(service)));
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (s == InvalidSocket || connect(s, reinterpret_cast< struct sockaddr * >(&address), sizeof(address)) != 0) {
+				std::cerr << "  " << name << ": connect failed (" << strerror(errno) << ")" << std::endl;
+				if (s != InvalidSocket) close(s);
+				failed = true;
+				break;
+			}
+			if (i < connections) load.hand_off(s);
+			else idle_sockets.emplace_back(s);
+		}
+
+		//each message starts with when it was sent:
+		std::vector< char > message(size, '\0');
+		uint64_t echoed = 0;
+		std::vector< double > latency;
+		bool measuring = false;
+		auto now_ns = [&]() {
+			return int64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now().time_since_epoch()).count());
+		};
+		auto send_one = [&](Connection *c) {
+			int64_t stamp = now_ns();
+			memcpy(message.data(), &stamp, sizeof(stamp));
+			c->send_raw(message.data(), message.size());
+		};
+		auto on_event = [&](Connection *c, Connection::Event evt) {
+			if (evt == Connection::OnOpen) {
+				for (size_t i = 0; i < depth; ++i) send_one(c);
+			} else if (evt == Connection::OnRecv) {
+				while (c->recv_buffer.size() >= size) {
+					int64_t stamp;
+					c->recv_buffer.read(reinterpret_cast< char * >(&stamp), sizeof(stamp));
+					c->recv_buffer.consume(size - sizeof(stamp));
+					if (measuring) {
+						echoed += 1;
+						latency.emplace_back((now_ns() - stamp) * 1e-9);
+					}
+					send_one(c);
+				}
+			} else if (evt == Connection::OnClose) {
+				failed = true;
+			}
+		};
+
+		//warm up, then measure:
+		Clock::time_point warm_until = Clock::now() + std::chrono::milliseconds(500);
+		while (!failed && Clock::now() < warm_until) load.poll(on_event, 0.001);
+
+		#ifndef _WIN32
+		clockid_t echo_clock;
+		pthread_getcpuclockid(echo_thread.native_handle(), &echo_clock);
+		auto echo_cpu = [&]() {
+			struct timespec ts;
+			clock_gettime(echo_clock, &ts);
+			return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+		};
+		#else
+		auto echo_cpu = []() { return 0.0; };
+		#endif
+
+		measuring = true;
+		double cpu_before = echo_cpu();
+		Clock::time_point before = Clock::now();
+		Clock::time_point until = before + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(seconds));
+		while (!failed && Clock::now() < until) load.poll(on_event, 0.001);
+		double elapsed = std::chrono::duration< double >(Clock::now() - before).count();
+		double cpu = echo_cpu() - cpu_before;
+		measuring = false;
+
+		stop = true;
+		echo_thread.join();
+		for (Socket s : idle_sockets) close(s);
+		if (failed) {
+			std::cout << "  " << name << ": FAILED (connection lost)" << std::endl;
+			return 1;
+		}
+
+		auto percentile = [](std::vector< double > &v, double f) {
+			if (v.empty()) return 0.0;
+			size_t i = std::min(v.size() - 1, size_t(f * double(v.size())));
+			std::nth_element(v.begin(), v.begin() + i, v.end());
+			return v[i];
+		};
+		std::cout << "  " << name << ": " << uint64_t(double(echoed) / elapsed) << " messages/s, echo thread "
+		          << (echoed ? cpu / double(echoed) * 1e9 : 0.0) << "ns CPU per message (" << cpu / elapsed * 100.0 << "% busy), round trip p50 "
+		          << percentile(latency, 0.5) * 1e6 << "us, p99 " << percentile(latency, 0.99) * 1e6 << "us" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,235 @@
+//Microbenchmark: ChessBoard::has_line vs. the nested-vector judge it replaced.
+// Usage: ./judge-bench [boards] [fill percent]
+// Checks that both agree on every random board, then times each over all boards.
+// Also checks LineRuns (including undo) against the judge and a brute-force run count,
+// on this game's board and on a much larger one.
+
+#include "ChessBoard.hpp"
+#include "LineRuns.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//The previous server-side judge (walks out from the last move in four directions):
+// Code inspired by : https://github.com/tdang33/Gomoku-Five-in-a-row-/blob/master/src/Board.cpp
+static bool legacy_judge_game(std::vector<std::vector<int>> const &chess_board, int x, int y, uint8_t value) {
+	bool res = false;
+	uint8_t max_size = NUM_PIECES_PER_LINE_HALF * 2;
+	// Check column
+	{
+		uint8_t sum = 1;
+		uint8_t count = 1;
+		while (y - count >= 0 && chess_board[x][y - count] == value) { sum++; count++; }
+		count = 1;
+		while (y + count <= max_size && chess_board[x][y + count] == value) { sum++; count++; }
+		res = sum >= NUM_PIECE_TO_WIN;
+	}
+	if (res) return true;
+	// Check row
+	{
+		uint8_t sum = 1;
+		uint8_t count = 1;
+		while (x - count >= 0 && chess_board[x - count][y] == value) { sum++; count++; }
+		count = 1;
+		while (x + count <= max_size && chess_board[x + count][y] == value) { sum++; count++; }
+		res = sum >= NUM_PIECE_TO_WIN;
+	}
+	if (res) return true;
+	// Check diag 1
+	{
+		uint8_t sum = 1;
+		uint8_t count = 1;
+		while (x - count >= 0 && y - count >= 0 && chess_board[x - count][y - count] == value) { sum++; count++; }
+		count = 1;
+		while (x + count <= max_size && y + count <= max_size && chess_board[x + count][y + count] == value) { sum++; count++; }
+		res = sum >= NUM_PIECE_TO_WIN;
+	}
+	if (res) return true;
+	// Check diag 2
+	{
+		uint8_t sum = 1;
+		uint8_t count = 1;
+		while (x - count >= 0 && y + count <= max_size && chess_board[x - count][y + count] == value) { sum++; count++; }
+		count = 1;
+		while (x + count <= max_size && y - count >= 0 && chess_board[x + count][y - count] == value) { sum++; count++; }
+		res = sum >= NUM_PIECE_TO_WIN;
+	}
+	return res;
+}
+
+//Same question as the legacy judge, for any board size and win length:
+static bool legacy_judge_game_any(std::vector<std::vector<int>> const &grid, int x, int y, int player, int k) {
+	int w = int(grid.size());
+	int const dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+	for (auto const &dir : dirs) {
+		int sum = 1;
+		for (int s = -1; s <= 1; s += 2) {
+			for (int cx = x + s * dir[0], cy = y + s * dir[1]; cx >= 0 && cx < w && cy >= 0 && cy < w && grid[cx][cy] == player; cx += s * dir[0], cy += s * dir[1]) ++sum;
+		}
+		if (sum >= k) return true;
+	}
+	return false;
+}
+
+//Brute-force count of 'player's runs per direction, by length (capped at k), for checking LineRuns:
+static std::vector< uint32_t > naive_runs(std::vector<std::vector<int>> const &grid, int k, int player) {
+	int w = int(grid.size());
+	std::vector< uint32_t > counts(k + 1, 0);
+	int const dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+	for (auto const &dir : dirs) {
+		for (int x = 0; x < w; ++x) {
+			for (int y = 0; y < w; ++y) {
+				if (grid[x][y] != player) continue;
+				//only count from the first cell of each run:
+				int px = x - dir[0], py = y - dir[1];
+				if (px >= 0 && px < w && py >= 0 && py < w && grid[px][py] == player) continue;
+				int length = 0;
+				for (int cx = x, cy = y; cx >= 0 && cx < w && cy >= 0 && cy < w && grid[cx][cy] == player; cx += dir[0], cy += dir[1]) ++length;
+				counts[std::min(length, k)] += 1;
+			}
+		}
+	}
+	return counts;
+}
+
+//Play random moves (with random take-backs) on a w x w board, checking LineRuns after every step.
+// returns the number of disagreements:
+static size_t check_line_runs(int w, int steps, std::mt19937 &mt) {
+	LineRuns runs(w);
+	int const k = runs.win_length();
+	std::vector<std::vector<int>> grid(w, std::vector<int>(w, 0));
+	std::vector< std::pair< int, int > > played;
+	size_t errors = 0;
+
+	auto agree = [&]() {
+		for (int p = 1; p <= PLAYER_NUM; ++p) {
+			std::vector< uint32_t > expected = naive_runs(grid, k, p);
+			for (int length = 1; length <= k; ++length) {
+				if (runs.runs(p, length) != expected[length]) return false;
+			}
+		}
+		return true;
+	};
+
+	for (int i = 0; i < steps; ++i) {
+		if (!played.empty() && mt() % 4 == 0) {
+			runs.undo();
+			grid[played.back().first][played.back().second] = 0;
+			played.pop_back();
+		} else {
+			int x = int(mt() % w), y = int(mt() % w);
+			if (grid[x][y] != 0) continue;
+			int player = int(mt() % PLAYER_NUM) + 1;
+			grid[x][y] = player;
+			played.emplace_back(x, y);
+			bool line = runs.place(x, y, player) >= k;
+			if (line != legacy_judge_game_any(grid, x, y, player, k)) ++errors;
+		}
+		if (!agree()) ++errors;
+	}
+	return errors;
+}
+
+struct Sample {
+	std::vector<std::vector<int>> grid;
+	ChessBoard board;
+	int x = 0, y = 0, player = 0; //last move
+};
+
+int main(int argc, char **argv) {
+	size_t count = (argc > 1 ? std::stoul(argv[1]) : 100000);
+	int fill = (argc > 2 ? std::stoi(argv[2]) : 30);
+
+	constexpr int W = ChessBoard::Width;
+
+	//Random boards, each with a random last move. The legacy judge only looks at
+	// lines through the last move, so boards are built by playing moves in order and
+	// stopping at the first win (as a real game does) -- then both must agree:
+	std::mt19937 mt(0x15466);
+	std::vector< Sample > samples(count);
+	for (auto &s : samples) {
+		s.grid.assign(W, std::vector<int>(W, 0));
+		int moves = W * W * fill / 100;
+		for (int m = 0; m < moves; ++m) {
+			int x = int(mt() % W), y = int(mt() % W);
+			if (s.grid[x][y] != 0) continue;
+			int player = int(mt() % PLAYER_NUM) + 1;
+			s.grid[x][y] = player;
+			s.board.set(x, y, player);
+			s.x = x; s.y = y; s.player = player;
+			if (legacy_judge_game(s.grid, x, y, uint8_t(player))) break;
+		}
+	}
+
+	size_t mismatches = 0;
+	size_t wins = 0;
+	for (auto const &s : samples) {
+		if (s.player == 0) continue;
+		bool a = legacy_judge_game(s.grid, s.x, s.y, uint8_t(s.player));
+		bool b = s.board.has_line(s.player);
+		if (a != b) ++mismatches;
+		if (a) ++wins;
+	}
+	std::cout << count << " boards (" << W << "x" << W << ", ~" << fill << "% filled), " << wins << " won, "
+	          << mismatches << " mismatches." << std::endl;
+
+	auto time = [&](char const *name, auto &&judge) {
+		size_t hits = 0;
+		auto before = std::chrono::steady_clock::now();
+		for (int rep = 0; rep < 10; ++rep) {
+			for (auto const &s : samples) {
+				if (s.player != 0 && judge(s)) ++hits;
+			}
+		}
+		auto after = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count() / (10.0 * count);
+		std::cout << "  " << name << ": " << ns << " ns/board (" << hits << " hits)" << std::endl;
+	};
+	time("legacy judge_game", [](Sample const &s){ return legacy_judge_game(s.grid, s.x, s.y, uint8_t(s.player)); });
+	time("ChessBoard::has_line", [](Sample const &s){ return s.board.has_line(s.player); });
+
+	//LineRuns should agree with the judge after every move and with a brute-force count after every move or undo:
+	size_t run_errors = 0;
+	run_errors += check_line_runs(ChessBoard::Width, 2000, mt);
+	run_errors += check_line_runs(61, 4000, mt);
+	std::cout << "LineRuns: " << run_errors << " mismatches." << std::endl;
+
+	//whole-board "has anyone won?" after each move of a long game on a big board:
+	// LineRuns answers from its counts, a rescan has to look at every piece:
+	{
+		int w = 201;
+		LineRuns runs(w);
+		std::vector<std::vector<int>> grid(w, std::vector<int>(w, 0));
+		std::vector< std::pair< int, int > > pieces;
+		size_t moves = size_t(w) * w / 4;
+		double rescan_ns = 0.0, runs_ns = 0.0;
+		size_t rescan_hits = 0, runs_hits = 0;
+		for (size_t m = 0; m < moves; ++m) {
+			int x = int(mt() % w), y = int(mt() % w);
+			if (grid[x][y] != 0) continue;
+			int player = int(mt() % PLAYER_NUM) + 1;
+			grid[x][y] = player;
+			pieces.emplace_back(x, y);
+
+			auto before = std::chrono::steady_clock::now();
+			runs.place(x, y, player);
+			for (int p = 1; p <= PLAYER_NUM; ++p) runs_hits += runs.has_line(p);
+			auto middle = std::chrono::steady_clock::now();
+			if (m % 64 == 0) { //(rescans are slow, so only sample them)
+				for (auto const &[px, py] : pieces) rescan_hits += legacy_judge_game_any(grid, px, py, grid[px][py], runs.win_length());
+			}
+			auto after = std::chrono::steady_clock::now();
+			runs_ns += std::chrono::duration< double, std::nano >(middle - before).count();
+			rescan_ns += std::chrono::duration< double, std::nano >(after - middle).count() * 64.0;
+		}
+		std::cout << "  " << w << "x" << w << " board, " << pieces.size() << " moves, whole-board win check per move:" << std::endl;
+		std::cout << "    rescan: " << rescan_ns / pieces.size() << " ns/move (" << rescan_hits << " hits)" << std::endl;
+		std::cout << "    LineRuns place + has_line: " << runs_ns / pieces.size() << " ns/move (" << runs_hits << " hits)" << std::endl;
+	}
+
+	return (mismatches == 0 && run_errors == 0 ? 0 : 1);
+}
@@ -0,0 +1,388 @@
+//Headless load generator: simulates many players against a running server.
+//
+// Each simulated player connects with its own Client, keeps a copy of the board from
+// the server's snapshots and move deltas, places a random legal move (after a short
+// "think" delay) whenever it is their turn, and disconnects at random (or once their
+// game ends) -- reconnecting a little later as a new player.
+//
+// Simulated spectators (--spectators) watch the server's featured game and stay
+// connected; "stalled" ones (--stalled-spectators) never read what they are sent,
+// to check that the server skips and then drops them rather than queueing forever.
+//
+// Reports (on stderr, so they aren't lost among Client's connection messages on stdout):
+//  - move round-trip latency: from sending 'a' to receiving the 'd' delta for that move
+//  - time to match: from connecting to receiving a seat ('k')
+//  - throughput: moves sent, deltas received, bytes in/out per second
+//  - protocol errors: undecodable messages, bad snapshots, missed deltas (resyncs), failed connects
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include "Connection.hpp"
+#include "MessageCodec.hpp"
+#include "ChessBoard.hpp"
+#include "ChessMessages.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Totals {
+	uint64_t connects = 0;
+	uint64_t connect_failures = 0;
+	uint64_t disconnects = 0; //by us
+	uint64_t dropped = 0; //by the server
+	uint64_t moves = 0; //'a' sent
+	uint64_t deltas = 0; //'d' received
+	uint64_t games_finished = 0;
+	uint64_t stalled = 0; //left a game that stopped moving (e.g., someone else left it)
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	uint64_t protocol_errors = 0; //unknown / malformed messages
+	uint64_t resyncs = 0; //missed deltas
+	uint64_t spectator_deltas = 0; //'d' received by spectators
+	uint64_t spectator_boards = 0; //'b' received by spectators (on watching, and after falling behind)
+	uint64_t spectators_dropped = 0; //spectators closed by the server
+	std::vector< float > rtt; //seconds, one per acknowledged move
+	std::vector< float > seat_times; //seconds from connecting to being seated
+};
+
+struct Player {
+	//(watching: be a spectator rather than a player; stalled: also never read anything)
+	Player(char const *host, char const *port, Totals &totals_, std::mt19937 &mt, bool watching_ = false, bool stalled_ = false) : totals(totals_), watching(watching_), stalled(stalled_) {
+		connected_at = Clock::now();
+		client = std::make_unique< Client >(host, port);
+		if (watching) {
+			if (stalled) {
+				//(a small receive buffer, so the server's send queue for us backs up sooner)
+				int size = 4096;
+				setsockopt(client->connection.socket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast< char const * >(&size), sizeof(size));
+			}
+			WatchMessage watch;
+			send_message(client->connection, MessageWatch, &watch, sizeof(watch));
+			totals.bytes_out += MessageHeaderSize + sizeof(watch);
+		}
+
+		//'s' -- game state:
+		dispatcher.on(MessageState, [this](Connection *, MessageView const &message) {
+			if (!message.read(0, &state)) bad("truncated state");
+		});
+		//'d' -- a move:
+		dispatcher.on(MessageMoveDelta, [this](Connection *c, MessageView const &message) {
+			MoveDeltaMessage delta;
+			if (!message.read(0, &delta)) return bad("truncated move delta");
+			(watching ? totals.spectator_deltas : totals.deltas) += 1;
+			last_progress = Clock::now();
+			//our own move coming back? that's one round trip:
+			if (waiting_for_ack && delta.player == state.player_id && delta.x == sent_x && delta.y == sent_y) {
+				totals.rtt.emplace_back(std::chrono::duration< float >(Clock::now() - sent_at).count());
+				waiting_for_ack = false;
+			}
+			if (delta.seq <= board_seq) return;
+			if (delta.seq != board_seq + 1) {
+				if (!resync_requested) {
+					totals.resyncs += 1;
+					send_message(*c, MessageResync, &board_seq, sizeof(board_seq));
+					resync_requested = true;
+				}
+				return;
+			}
+			int x = delta.x + NUM_PIECES_PER_LINE_HALF, y = delta.y + NUM_PIECES_PER_LINE_HALF;
+			if (x < 0 || x >= ChessBoard::Width || y < 0 || y >= ChessBoard::Width || delta.player < 1 || delta.player > PLAYER_NUM) {
+				return bad("move delta off the board");
+			}
+			board.set(x, y, delta.player);
+			board_seq = delta.seq;
+			//the turn passes on with the move (the 's' saying so arrives at the next broadcast):
+			state.current_player = uint8_t(delta.player % PLAYER_NUM + 1);
+		});
+		//'b' -- whole board:
+		dispatcher.on(MessageBoard, [this](Connection *, MessageView const &message) {
+			BoardSnapshotHeader header;
+			if (!message.read(0, &header) || header.width != BoardWidth || message.size != sizeof(header) + PackedBoardBytes) {
+				return bad("bad board snapshot");
+			}
+			unpack_board(reinterpret_cast< uint8_t const * >(message.data + sizeof(header)), &board);
+			board_seq = header.seq;
+			if (watching) totals.spectator_boards += 1;
+			resync_requested = false;
+		});
+		//'k' -- seat key (just timed here):
+		dispatcher.on(MessageSeat, [this](Connection *, MessageView const &) {
+			totals.seat_times.emplace_back(std::chrono::duration< float >(Clock::now() - connected_at).count());
+		});
+		//'n', 't' -- name and status text (not needed here):
+		dispatcher.on(MessageName, [](Connection *, MessageView const &) { });
+		dispatcher.on(MessageStatus, [](Connection *, MessageView const &) { });
+
+		think_until = Clock::now() + think_time(mt);
+		last_progress = Clock::now();
+	}
+
+	void bad(char const *what) {
+		totals.protocol_errors += 1;
+		if (totals.protocol_errors <= 10) std::cerr << "protocol error: " << what << std::endl;
+	}
+
+	std::chrono::milliseconds think_time(std::mt19937 &mt) const {
+		return std::chrono::milliseconds(think_min + (think_max > think_min ? mt() % (think_max - think_min) : 0));
+	}
+
+	//returns false once the connection is gone:
+	bool update(std::mt19937 &mt) {
+		//(a stalled spectator sends its 'w', then never polls again)
+		if (stalled && sent_watch) return true;
+		sent_watch = true;
+
+		bool alive = true;
+		client->poll([&](Connection *c, Connection::Event event) {
+			if (event == Connection::OnClose) {
+				alive = false;
+			} else if (event == Connection::OnRecv) {
+				totals.bytes_in += c->recv_buffer.size();
+				if (dispatcher.dispatch(c) != MessageDispatcher::Ok) {
+					bad("unknown message type or size");
+					c->close();
+					alive = false;
+				}
+			}
+		}, 0.0);
+		if (!alive || !client->connection) return false;
+
+		//our turn? (and not still waiting to hear back about the last move)
+		if (state.game_state == 1 && state.current_player == state.player_id && state.player_id != 0 && !waiting_for_ack) {
+			if (Clock::now() >= think_until) {
+				std::vector< std::pair< int8_t, int8_t > > empty;
+				for (int x = 0; x < ChessBoard::Width; ++x) {
+					for (int y = 0; y < ChessBoard::Width; ++y) {
+						if (board.empty(x, y)) empty.emplace_back(int8_t(x - NUM_PIECES_PER_LINE_HALF), int8_t(y - NUM_PIECES_PER_LINE_HALF));
+					}
+				}
+				if (!empty.empty()) {
+					auto pick = empty[mt() % empty.size()];
+					int8_t pos[2] = {pick.first, pick.second};
+					send_message(client->connection, MessageMove, pos, sizeof(pos));
+					totals.bytes_out += MessageHeaderSize + sizeof(pos);
+					totals.moves += 1;
+					sent_x = pick.first;
+					sent_y = pick.second;
+					sent_at = Clock::now();
+					waiting_for_ack = true;
+				}
+				think_until = Clock::now() + think_time(mt);
+			}
+		}
+		return true;
+	}
+
+	Totals &totals;
+	bool watching = false;
+	bool stalled = false;
+	bool sent_watch = false;
+	std::unique_ptr< Client > client;
+	MessageDispatcher dispatcher;
+	StateMessage state;
+	ChessBoard board;
+	uint32_t board_seq = 0;
+	bool resync_requested = false;
+
+	bool waiting_for_ack = false;
+	int8_t sent_x = 0, sent_y = 0;
+	Clock::time_point sent_at;
+	Clock::time_point connected_at;
+
+	uint32_t think_min = 50, think_max = 250; //ms
+	Clock::time_point think_until;
+	Clock::time_point finished_at; //when the game ended (if it has)
+	Clock::time_point last_progress; //when a move was last seen
+};
+
+static float percentile(std::vector< float > &samples, double fraction) {
+	if (samples.empty()) return 0.0f;
+	size_t index = std::min(samples.size() - 1, size_t(fraction * double(samples.size())));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./loadgen <host> <port> [--players N] [--seconds S] [--connect-rate per-second]\n"
+		             "\t\t[--disconnect-rate per-player-per-second] [--think min-ms max-ms] [--stall seconds] [--seed N]\n"
+		             "\t\t[--spectators N] [--stalled-spectators N]" << std::endl;
+		return 1;
+	};
+	if (argc < 3) return usage();
+	char const *host = argv[1];
+	char const *port = argv[2];
+
+	size_t target_players = 300;
+	double seconds = 30.0;
+	double connect_rate = 500.0;
+	double disconnect_rate = 0.01;
+	double stall_seconds = 5.0;
+	uint32_t think_min = 50, think_max = 250;
+	uint32_t seed = 15466;
+	size_t target_spectators = 0;
+	size_t stalled_spectators = 0;
+	for (int argi = 3; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--players" && argi + 1 < argc) target_players = std::stoul(argv[++argi]);
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else if (arg == "--connect-rate" && argi + 1 < argc) connect_rate = std::stod(argv[++argi]);
+		else if (arg == "--disconnect-rate" && argi + 1 < argc) disconnect_rate = std::stod(argv[++argi]);
+		else if (arg == "--think" && argi + 2 < argc) {
+			think_min = uint32_t(std::stoul(argv[++argi]));
+			think_max = uint32_t(std::stoul(argv[++argi]));
+		}
+		else if (arg == "--stall" && argi + 1 < argc) stall_seconds = std::stod(argv[++argi]);
+		else if (arg == "--seed" && argi + 1 < argc) seed = uint32_t(std::stoul(argv[++argi]));
+		else if (arg == "--spectators" && argi + 1 < argc) target_spectators = std::stoul(argv[++argi]);
+		else if (arg == "--stalled-spectators" && argi + 1 < argc) stalled_spectators = std::stoul(argv[++argi]);
+		else return usage();
+	}
+
+	Log::set_level(Log::Warn); //(don't log every connection)
+
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution< double > unit(0.0, 1.0);
+	Totals totals;
+	totals.rtt.reserve(1 << 20);
+	std::vector< std::unique_ptr< Player > > players;
+	std::vector< std::unique_ptr< Player > > spectators; //(stalled ones first)
+
+	auto start = Clock::now();
+	auto end = start + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(seconds));
+	auto last_loop = start;
+	auto next_report = start + std::chrono::seconds(1);
+	double connect_budget = 0.0; //connections we may open now (accumulates at connect_rate)
+	Totals last; //totals at the last report
+
+	while (Clock::now() < end) {
+		auto now = Clock::now();
+		double elapsed = std::chrono::duration< double >(now - last_loop).count();
+		last_loop = now;
+
+		//top up to the target number of players, no faster than connect_rate:
+		connect_budget = std::min(connect_budget + elapsed * connect_rate, std::max(1.0, connect_rate));
+		while (players.size() < target_players && connect_budget >= 1.0) {
+			connect_budget -= 1.0;
+			try {
+				players.emplace_back(std::make_unique< Player >(host, port, totals, mt));
+				players.back()->think_min = think_min;
+				players.back()->think_max = think_max;
+				totals.connects += 1;
+			} catch (std::exception const &e) {
+				totals.connect_failures += 1;
+				if (totals.connect_failures <= 10) std::cerr << "connect failed: " << e.what() << std::endl;
+			}
+		}
+
+		//spectators (connected after the players, sharing the same connect rate):
+		while (players.size() >= target_players && spectators.size() < target_spectators + stalled_spectators && connect_budget >= 1.0) {
+			connect_budget -= 1.0;
+			try {
+				bool stalled = (spectators.size() < stalled_spectators);
+				spectators.emplace_back(std::make_unique< Player >(host, port, totals, mt, true, stalled));
+				totals.connects += 1;
+			} catch (std::exception const &e) {
+				totals.connect_failures += 1;
+				if (totals.connect_failures <= 10) std::cerr << "connect failed: " << e.what() << std::endl;
+			}
+		}
+		for (size_t i = 0; i < spectators.size(); ) {
+			if (spectators[i]->update(mt)) {
+				++i;
+			} else {
+				//(replaced by a new spectator, above)
+				totals.spectators_dropped += 1;
+				spectators.erase(spectators.begin() + i);
+			}
+		}
+
+		//update everyone, dropping players who leave:
+		double leave_chance = disconnect_rate * elapsed;
+		for (size_t i = 0; i < players.size(); ) {
+			Player &player = *players[i];
+			bool keep = player.update(mt);
+			if (!keep) {
+				totals.dropped += 1;
+			} else if (player.state.game_state == 2) {
+				//game over -- leave shortly after, to make room for new games:
+				if (player.finished_at == Clock::time_point()) {
+					player.finished_at = now;
+					totals.games_finished += 1;
+				} else if (now - player.finished_at > std::chrono::milliseconds(500)) {
+					keep = false;
+				}
+			} else if (player.state.game_state == 1 && now - player.last_progress > std::chrono::duration< double >(stall_seconds)) {
+				//nobody has moved in a while -- the player to move probably left (and there are no bots to take over):
+				totals.stalled += 1;
+				keep = false;
+			} else if (unit(mt) < leave_chance) {
+				totals.disconnects += 1;
+				keep = false;
+			}
+			if (keep) {
+				++i;
+			} else {
+				std::swap(players[i], players.back());
+				players.pop_back();
+			}
+		}
+
+		if (now >= next_report) {
+			next_report += std::chrono::seconds(1);
+			std::vector< float > recent(totals.rtt.begin() + last.rtt.size(), totals.rtt.end());
+			std::cerr << std::fixed << std::setprecision(2)
+			          << "[" << std::chrono::duration< double >(now - start).count() << "s] players " << players.size()
+			          << ", moves/s " << (totals.moves - last.moves)
+			          << ", deltas/s " << (totals.deltas - last.deltas)
+			          << ", in " << (totals.bytes_in - last.bytes_in) / 1024.0 << "KiB/s"
+			          << ", rtt p50 " << percentile(recent, 0.5) * 1e3 << "ms p99 " << percentile(recent, 0.99) * 1e3 << "ms"
+			          << ", errors " << totals.protocol_errors;
+			if (!spectators.empty()) std::cerr << ", spectators " << spectators.size() << " (deltas/s " << (totals.spectator_deltas - last.spectator_deltas) << ")";
+			std::cerr << std::endl;
+			std::cerr.unsetf(std::ios::fixed);
+			last.moves = totals.moves;
+			last.deltas = totals.deltas;
+			last.spectator_deltas = totals.spectator_deltas;
+			last.bytes_in = totals.bytes_in;
+			last.rtt.resize(totals.rtt.size());
+		}
+
+		//don't spin flat out when there's nothing to do:
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+
+	double total_seconds = std::chrono::duration< double >(Clock::now() - start).count();
+	std::cerr << std::fixed << std::setprecision(1) << "=== loadgen: " << total_seconds << "s against " << host << ":" << port << " ===\n"
+	          << "connects " << totals.connects << " (failed " << totals.connect_failures << "), left " << totals.disconnects
+	          << ", dropped by server " << totals.dropped << ", games finished " << totals.games_finished << ", stalled " << totals.stalled << "\n"
+	          << "moves " << totals.moves << " (" << totals.moves / total_seconds << "/s), deltas " << totals.deltas
+	          << " (" << totals.deltas / total_seconds << "/s)\n"
+	          << "bytes in " << totals.bytes_in << " (" << totals.bytes_in / total_seconds / 1024.0 << " KiB/s), out " << totals.bytes_out << "\n"
+	          << "move rtt (" << totals.rtt.size() << " samples): p50 " << percentile(totals.rtt, 0.5) * 1e3
+	          << "ms, p90 " << percentile(totals.rtt, 0.9) * 1e3 << "ms, p99 " << percentile(totals.rtt, 0.99) * 1e3
+	          << "ms, p99.9 " << percentile(totals.rtt, 0.999) * 1e3 << "ms, max " << percentile(totals.rtt, 1.0) * 1e3 << "ms\n"
+	          << "time to match (" << totals.seat_times.size() << " seated): p50 " << percentile(totals.seat_times, 0.5) * 1e3
+	          << "ms, p90 " << percentile(totals.seat_times, 0.9) * 1e3 << "ms, p99 " << percentile(totals.seat_times, 0.99) * 1e3
+	          << "ms, max " << percentile(totals.seat_times, 1.0) * 1e3 << "ms\n"
+	          << "protocol errors " << totals.protocol_errors << ", resyncs " << totals.resyncs << "\n"
+	          << "spectators: deltas " << totals.spectator_deltas << ", boards " << totals.spectator_boards
+	          << ", dropped by server " << totals.spectators_dropped << std::endl;
+
+	return (totals.protocol_errors == 0 ? 0 : 1);
+}
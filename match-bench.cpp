@@ -0,0 +1,85 @@
+//Microbenchmark: the server's Matchmaker under a steady stream of joins.
+// Usage: ./match-bench [--rate joins-per-second] [--seconds S] [--tick-rate hz] [--leave fraction] [--max-wait seconds]
+// Simulates the server's loop on a virtual clock -- each tick, that tick's share of joins
+// are queued (a fraction of waiting players leave again) and matches are formed -- then
+// reports time-to-match (in simulated time) and how fast the matchmaker itself ran.
+
+#include "Connection.hpp"
+#include "Matchmaker.hpp"
+#include "ChessBoardData.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./match-bench [--rate joins-per-second] [--seconds S] [--tick-rate hz] [--leave fraction] [--max-wait seconds]" << std::endl;
+		return 1;
+	};
+	double rate = 5000.0;
+	double seconds = 60.0;
+	double tick_rate = 10.0;
+	double leave = 0.05; //fraction of joins that leave before being matched (if they can)
+	double max_wait = 10.0;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--rate" && argi + 1 < argc) rate = std::stod(argv[++argi]);
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else if (arg == "--tick-rate" && argi + 1 < argc) tick_rate = std::stod(argv[++argi]);
+		else if (arg == "--leave" && argi + 1 < argc) leave = std::stod(argv[++argi]);
+		else if (arg == "--max-wait" && argi + 1 < argc) max_wait = std::stod(argv[++argi]);
+		else return usage();
+	}
+	if (!(rate > 0.0 && seconds > 0.0 && tick_rate > 0.0)) return usage();
+
+	//(the matchmaker only uses connections as keys, so a pool of them is reused round-robin)
+	std::vector< Connection > pool(1 << 16);
+	size_t next = 0;
+
+	Matchmaker matchmaker(PLAYER_NUM, max_wait);
+	std::mt19937 mt(15466);
+	std::uniform_real_distribution< double > unit(0.0, 1.0);
+	std::vector< Connection * > recent; //(leavers are picked from these)
+	uint64_t seated = 0;
+
+	auto clock = Matchmaker::Clock::time_point(); //(virtual)
+	auto period = std::chrono::duration_cast< Matchmaker::Clock::duration >(std::chrono::duration< double >(1.0 / tick_rate));
+	size_t ticks = size_t(seconds * tick_rate);
+	double due = 0.0; //joins owed (fractional)
+
+	auto before = std::chrono::steady_clock::now();
+	for (size_t tick = 0; tick < ticks; ++tick) {
+		clock += period;
+
+		//this tick's joins, spread evenly over the tick:
+		due += rate / tick_rate;
+		size_t joins = size_t(due);
+		due -= double(joins);
+		recent.clear();
+		for (size_t i = 0; i < joins; ++i) {
+			Connection *c = &pool[next];
+			next = (next + 1) % pool.size();
+			matchmaker.enqueue(c, clock - period + period * int64_t(i) / int64_t(joins));
+			recent.emplace_back(c);
+		}
+		for (size_t i = 0; i < recent.size(); ++i) {
+			if (unit(mt) < leave) matchmaker.remove(recent[i]);
+		}
+
+		matchmaker.form(clock, [&](std::vector< Connection * > const &players, Matchmaker::Clock::time_point) {
+			seated += players.size();
+		});
+	}
+	double elapsed = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+
+	TickScheduler::Histogram waits = matchmaker.time_to_match.load();
+	std::cout << "Simulated " << seconds << "s at " << rate << " joins/s (" << tick_rate << "Hz ticks, " << leave * 100.0 << "% leave, max wait " << max_wait << "s):\n"
+	          << "  joined " << matchmaker.joined << ", left " << matchmaker.left << ", seated " << seated << ", still waiting " << matchmaker.size() << "\n"
+	          << "  matches: " << matchmaker.full << " full, " << matchmaker.partial << " smaller\n"
+	          << "  time to match: p50 <=" << waits.percentile(0.5) * 1e3 << "ms, p99 <=" << waits.percentile(0.99) * 1e3 << "ms, max " << waits.max * 1e3 << "ms\n"
+	          << "  matchmaker ran in " << elapsed * 1e3 << "ms (" << double(matchmaker.joined) / elapsed << " joins/s)" << std::endl;
+	return 0;
+}
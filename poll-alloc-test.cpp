@@ -0,0 +1,203 @@
+//Check: a steady-state Server::poll allocates nothing, whatever the number of connections.
+// Usage: ./poll-alloc-test [--port P] [--connections N] [--backlogged M] [--polls K] [--backends select,epoll,uring]
+// Replaces the global operator new with one that counts calls made (on this thread) while
+// Server::poll runs. N loopback connections are opened to a Server; M of them are sent 1MB
+// the client never reads, so they sit with bytes pending in their send queues; the rest each
+// send a 3-byte message per round, which the server echoes. After a warm-up (so buffers, slab
+// pools, and queues have grown to size), K more polls must make zero allocations.
+// Exits non-zero if any backend allocated.
+
+#include "Connection.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+//------------ counting allocator ------------
+static thread_local bool counting = false;
+static thread_local uint64_t allocations = 0;
+
+static void *counted_alloc(std::size_t size, std::size_t align) {
+	if (counting) allocations += 1;
+	if (size == 0) size = 1;
+	void *ret = nullptr;
+	if (align <= alignof(std::max_align_t)) ret = std::malloc(size);
+	#ifdef _WIN32
+	else ret = _aligned_malloc(size, align);
+	#else
+	else if (posix_memalign(&ret, align, size) != 0) ret = nullptr;
+	#endif
+	if (!ret) throw std::bad_alloc();
+	return ret;
+}
+static void counted_free(void *ptr, std::size_t align) {
+	#ifdef _WIN32
+	if (align > alignof(std::max_align_t)) {
+		_aligned_free(ptr);
+		return;
+	}
+	#else
+	(void)align;
+	#endif
+	std::free(ptr);
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size, 0); }
+void *operator new[](std::size_t size) { return counted_alloc(size, 0); }
+void *operator new(std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+void *operator new[](std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+void operator delete(void *ptr) noexcept { counted_free(ptr, 0); }
+void operator delete[](void *ptr) noexcept { counted_free(ptr, 0); }
+void operator delete(void *ptr, std::size_t) noexcept { counted_free(ptr, 0); }
+void operator delete[](void *ptr, std::size_t) noexcept { counted_free(ptr, 0); }
+void operator delete(void *ptr, std::align_val_t align) noexcept { counted_free(ptr, std::size_t(align)); }
+void operator delete[](void *ptr, std::align_val_t align) noexcept { counted_free(ptr, std::size_t(align)); }
+void operator delete(void *ptr, std::size_t, std::align_val_t align) noexcept { counted_free(ptr, std::size_t(align)); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t align) noexcept { counted_free(ptr, std::size_t(align)); }
+
+//------------ test ------------
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./poll-alloc-test [--port P] [--connections N] [--backlogged M] [--polls K] [--backends select,epoll,uring]" << std::endl;
+		return 1;
+	};
+	int port = 15480;
+	size_t connections = 200;
+	size_t backlogged = 20;
+	size_t polls = 2000;
+	std::string backends = "select,epoll,uring";
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--port" && argi + 1 < argc) port = std::stoi(argv[++argi]);
+		else if (arg == "--connections" && argi + 1 < argc) connections = std::stoul(argv[++argi]);
+		else if (arg == "--backlogged" && argi + 1 < argc) backlogged = std::stoul(argv[++argi]);
+		else if (arg == "--polls" && argi + 1 < argc) polls = std::stoul(argv[++argi]);
+		else if (arg == "--backends" && argi + 1 < argc) backends = argv[++argi];
+		else return usage();
+	}
+	if (!(connections > backlogged && polls > 0)) return usage();
+
+	Log::set_level(Log::Warn); //(don't log every connection)
+
+	std::cout << connections << " connections (" << backlogged << " with 1MB pending), " << polls << " polls after warm-up:" << std::endl;
+	bool failed = false;
+	for (size_t at = 0; at < backends.size(); /* later */) {
+		size_t comma = std::min(backends.find(',', at), backends.size());
+		std::string name = backends.substr(at, comma - at);
+		at = comma + 1;
+		PollBackend backend;
+		if (name == "select") backend = PollBackend::Select;
+		else if (name == "epoll") backend = PollBackend::Epoll;
+		else if (name == "uring") backend = PollBackend::IoUring;
+		else return usage();
+		if (backend == PollBackend::Select && 2 * connections + 16 > FD_SETSIZE) {
+			std::cout << "  select: skipped (" << 2 * connections << " sockets (both ends) won't fit in an fd_set)" << std::endl;
+			continue;
+		}
+
+		std::string service = std::to_string(port++); //(a fresh port per backend, so nothing lingers in TIME_WAIT)
+		Server server(service, backend);
+		if (server.backend != backend) {
+			std::cout << "  " << name << ": not available here, skipped" << std::endl;
+			continue;
+		}
+
+		//connect (client ends are plain non-blocking sockets, driven directly):
+		std::vector< Socket > clients;
+		for (size_t i = 0; i < connections; ++i) {
+			Socket s = socket(AF_INET, SOCK_STREAM, 0);
+			if (s != InvalidSocket && i < backlogged) {
+				int size = 4096;
+				setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+			}
+			struct sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons(uint16_t(std::stoi(service)));
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (s == InvalidSocket || connect(s, reinterpret_cast< struct sockaddr * >(&address), sizeof(address)) != 0) {
+				std::cerr << "  " << name << ": connect failed (" << strerror(errno) << ")" << std::endl;
+				return 1;
+			}
+			fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+			clients.emplace_back(s);
+		}
+
+		//(built once: converting a capturing lambda to std::function may itself allocate)
+		size_t opened = 0;
+		std::vector< char > big(1 << 20, 'x');
+		std::function< void(Connection *, Connection::Event) > on_event = [&](Connection *c, Connection::Event evt) {
+			if (evt == Connection::OnOpen) {
+				//(sockets are accepted in connect order, so the first 'backlogged' get the backlog)
+				if (opened < backlogged) {
+					//(small socket buffers on both ends, so most of the 1MB stays in the send queue)
+					int size = 4096;
+					setsockopt(c->socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+					c->send_raw(big.data(), big.size());
+				}
+				opened += 1;
+			} else if (evt == Connection::OnRecv) {
+				//echo whole 3-byte messages:
+				char message[3];
+				while (c->recv_buffer.size() >= sizeof(message)) {
+					c->recv_buffer.read(message, sizeof(message));
+					c->send_raw(message, sizeof(message));
+				}
+			}
+		};
+		for (size_t tries = 0; opened < connections && tries < 10000; ++tries) server.poll(on_event, 0.001);
+		if (opened < connections) {
+			std::cerr << "  " << name << ": only " << opened << " of " << connections << " connections arrived" << std::endl;
+			return 1;
+		}
+
+		//one round: every connection that isn't backlogged sends a message and reads back any echoes,
+		// then the server polls:
+		char const message[3] = {'a', 0, 0};
+		char drain[4096];
+		uint64_t echoed = 0;
+		auto round = [&](bool count) {
+			for (size_t i = backlogged; i < clients.size(); ++i) {
+				ssize_t got;
+				while ((got = recv(clients[i], drain, sizeof(drain), 0)) > 0) echoed += uint64_t(got) / 3;
+				if (send(clients[i], message, sizeof(message), MSG_NOSIGNAL) != sizeof(message)) return false;
+			}
+			counting = count;
+			server.poll(on_event, 0.001);
+			counting = false;
+			return true;
+		};
+
+		bool ok = true;
+		for (size_t i = 0; i < 500 && ok; ++i) ok = round(false); //warm up
+		allocations = 0;
+		echoed = 0;
+		for (size_t i = 0; i < polls && ok; ++i) ok = round(true);
+
+		size_t pending = 0;
+		for (auto const &c : server.connections) pending += c.queued_bytes();
+		std::cout << "  " << name << ": " << allocations << " allocations in " << polls << " polls (" << echoed << " messages echoed, "
+		          << pending << " bytes pending)";
+		if (!ok || allocations != 0 || server.connections.size() != connections) {
+			std::cout << " -- FAILED" << std::endl;
+			failed = true;
+		} else {
+			std::cout << " -- ok" << std::endl;
+		}
+		for (Socket s : clients) close(s);
+	}
+	return failed ? 1 : 0;
+}
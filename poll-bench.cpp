@@ -0,0 +1,261 @@
+//Benchmark: how long one Server::poll takes with many idle connections and some busy ones.
+// Usage: ./poll-bench [--port P] [--idle N] [--active M] [--interval ms] [--seconds S] [--backends epoll,select]
+// A child process opens N idle + M active loopback connections to a Server in this process;
+// every 'interval' milliseconds it sends one 3-byte message on each active connection. This
+// process calls poll (timeout 0) back to back and reports how long each call took -- in CPU
+// time, so the numbers show what a poll costs (per connection held, busy or not) even when the
+// load shares a core with the poller; wall-clock time, which includes being descheduled, is
+// reported too.
+// select() can only watch sockets numbered below FD_SETSIZE, so when N + M won't fit, both
+// backends are also run side by side at the largest size that does.
+
+#include "Connection.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+int main(int argc, char **argv) {
+	std::cerr << "poll-bench needs fork() and loopback sockets; it doesn't run on windows." << std::endl;
+	return 1;
+}
+#else
+
+typedef std::chrono::steady_clock Clock;
+
+static double thread_cpu() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+//the load side (runs in the child process): connect, wait for 'go', then send until 'stop' (or the pipe closes):
+static int run_load(uint16_t port, size_t idle, size_t active, double interval, int go_fd) {
+	std::vector< Socket > sockets;
+	sockets.reserve(idle + active);
+	for (size_t i = 0; i < idle + active; ++i) {
+		Socket s = socket(AF_INET, SOCK_STREAM, 0);
+		struct sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (s == InvalidSocket || connect(s, reinterpret_cast< struct sockaddr * >(&address), sizeof(address)) != 0) {
+			std::cerr << "  (load: connect " << i << " failed: " << strerror(errno) << ")" << std::endl;
+			return 1;
+		}
+		sockets.emplace_back(s);
+	}
+	char go = 0;
+	if (read(go_fd, &go, 1) != 1) return 1;
+
+	char const message[3] = {'a', 0, 0};
+	Clock::time_point next = Clock::now();
+	while (true) {
+		for (size_t i = idle; i < sockets.size(); ++i) {
+			if (send(sockets[i], message, sizeof(message), MSG_NOSIGNAL) != sizeof(message)) return 1;
+		}
+		next += std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(interval));
+		//wait for the next round (or for the parent to say stop):
+		struct pollfd p;
+		p.fd = go_fd;
+		p.events = POLLIN;
+		int wait_ms = int(std::max(0.0, std::chrono::duration< double, std::milli >(next - Clock::now()).count()));
+		if (::poll(&p, 1, wait_ms) != 0) return 0;
+	}
+}
+
+struct Result {
+	bool ok = false;
+	uint64_t polls = 0;
+	uint64_t messages = 0;
+	double elapsed = 0.0;
+	double p50 = 0.0, p99 = 0.0, max = 0.0; //CPU seconds per poll
+	double wall_p50 = 0.0, wall_p99 = 0.0; //wall-clock seconds per poll
+};
+
+static Result run(PollBackend backend, uint16_t port, size_t idle, size_t active, double interval, double seconds) {
+	Result result;
+	Server server(std::to_string(port), backend);
+
+	int pipe_fds[2];
+	if (pipe(pipe_fds) != 0) return result;
+	pid_t child = fork();
+	if (child < 0) return result;
+	if (child == 0) {
+		close(pipe_fds[1]);
+		_exit(run_load(port, idle, active, interval, pipe_fds[0]));
+	}
+	close(pipe_fds[0]);
+
+	//accept everything:
+	size_t accepted = 0;
+	uint64_t messages = 0;
+	auto on_event = [&](Connection *c, Connection::Event evt) {
+		if (evt == Connection::OnOpen) {
+			accepted += 1;
+		} else if (evt == Connection::OnRecv) {
+			size_t whole = c->recv_buffer.size() / 3 * 3;
+			messages += whole / 3;
+			c->recv_buffer.consume(whole);
+		}
+	};
+	Clock::time_point give_up = Clock::now() + std::chrono::seconds(60);
+	while (accepted < idle + active && Clock::now() < give_up) {
+		server.poll(on_event, 0.01);
+		if (waitpid(child, nullptr, WNOHANG) == child) break;
+	}
+
+	if (accepted == idle + active) {
+		char go = 'g';
+		if (write(pipe_fds[1], &go, 1) == 1) {
+			//warm up, then time polls back to back:
+			Clock::time_point warm_until = Clock::now() + std::chrono::milliseconds(500);
+			while (Clock::now() < warm_until) server.poll(on_event, 0.0);
+
+			std::vector< double > times, walls;
+			times.reserve(1 << 20);
+			walls.reserve(1 << 20);
+			messages = 0;
+			Clock::time_point before = Clock::now();
+			Clock::time_point until = before + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(seconds));
+			Clock::time_point now = before;
+			double cpu = thread_cpu();
+			while (now < until) {
+				server.poll(on_event, 0.0);
+				Clock::time_point after = Clock::now();
+				double cpu_after = thread_cpu();
+				times.emplace_back(cpu_after - cpu);
+				walls.emplace_back(std::chrono::duration< double >(after - now).count());
+				now = after;
+				cpu = cpu_after;
+			}
+			result.elapsed = std::chrono::duration< double >(now - before).count();
+			result.polls = times.size();
+			result.messages = messages;
+			auto percentile = [](std::vector< double > &v, double f) {
+				size_t i = std::min(v.size() - 1, size_t(f * double(v.size())));
+				std::nth_element(v.begin(), v.begin() + i, v.end());
+				return v[i];
+			};
+			result.p50 = percentile(times, 0.5);
+			result.p99 = percentile(times, 0.99);
+			result.max = *std::max_element(times.begin(), times.end());
+			result.wall_p50 = percentile(walls, 0.5);
+			result.wall_p99 = percentile(walls, 0.99);
+			result.ok = (accepted == idle + active && server.connections.size() == idle + active);
+		}
+	} else {
+		std::cerr << "  (only " << accepted << " of " << (idle + active) << " connections arrived)" << std::endl;
+	}
+
+	close(pipe_fds[1]); //(tells the child to stop)
+	waitpid(child, nullptr, 0);
+	return result;
+}
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./poll-bench [--port P] [--idle N] [--active M] [--interval ms] [--seconds S] [--backends epoll,select]" << std::endl;
+		return 1;
+	};
+	int port = 15490;
+	size_t idle = 10000;
+	size_t active = 1000;
+	double interval = 0.01;
+	double seconds = 3.0;
+	std::string backends = "epoll,select";
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--port" && argi + 1 < argc) port = std::stoi(argv[++argi]);
+		else if (arg == "--idle" && argi + 1 < argc) idle = std::stoul(argv[++argi]);
+		else if (arg == "--active" && argi + 1 < argc) active = std::stoul(argv[++argi]);
+		else if (arg == "--interval" && argi + 1 < argc) interval = std::stod(argv[++argi]) * 1e-3;
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else if (arg == "--backends" && argi + 1 < argc) backends = argv[++argi];
+		else return usage();
+	}
+	if (!(idle + active > 0 && interval > 0.0 && seconds > 0.0)) return usage();
+
+	Log::set_level(Log::Warn); //(don't log every connection)
+
+	{ //each process holds one end of every connection (plus a few more):
+		struct rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && idle + active + 64 > limit.rlim_cur) {
+			std::cerr << "Need " << (idle + active + 64) << " file descriptors per process, but the limit is " << limit.rlim_cur << "." << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector< PollBackend > list;
+	for (size_t at = 0; at < backends.size(); /* later */) {
+		size_t comma = std::min(backends.find(',', at), backends.size());
+		std::string name = backends.substr(at, comma - at);
+		at = comma + 1;
+		if (name == "epoll") list.emplace_back(PollBackend::Epoll);
+		else if (name == "select") list.emplace_back(PollBackend::Select);
+		else if (name == "uring") list.emplace_back(PollBackend::IoUring);
+		else return usage();
+	}
+
+	auto report = [&](PollBackend backend, size_t n_idle, size_t n_active) {
+		Result r = run(backend, uint16_t(port++), n_idle, n_active, interval, seconds); //(a fresh port per run, so nothing lingers in TIME_WAIT)
+		std::cout << "  " << Server::backend_name(backend) << ", " << n_idle << " idle + " << n_active << " active: ";
+		if (!r.ok) {
+			std::cout << "FAILED" << std::endl;
+			return false;
+		}
+		std::cout << "poll p50 " << r.p50 * 1e6 << "us, p99 " << r.p99 * 1e6 << "us, max " << r.max * 1e6 << "us CPU"
+		          << " (wall p50 " << r.wall_p50 * 1e6 << "us, p99 " << r.wall_p99 * 1e6 << "us; "
+		          << uint64_t(double(r.polls) / r.elapsed) << " polls/s, " << uint64_t(double(r.messages) / r.elapsed) << " messages/s)" << std::endl;
+		return true;
+	};
+
+	//(sockets numbered past FD_SETSIZE can't go in an fd_set; a few low numbers are already taken)
+	size_t select_max = FD_SETSIZE - 32;
+	std::cout << idle << " idle + " << active << " active connections, each active one sending every " << interval * 1e3 << "ms; "
+	          << seconds << "s of back-to-back polls per run:" << std::endl;
+	bool scaled = false;
+	for (PollBackend backend : list) {
+		if (backend == PollBackend::Select && idle + active > select_max) {
+			std::cout << "  select: skipped (" << (idle + active) << " sockets won't fit in an fd_set)" << std::endl;
+			scaled = true;
+			continue;
+		}
+		if (!report(backend, idle, active)) return 1;
+	}
+	if (scaled) {
+		//the same mix, scaled down until select() can take part:
+		double f = double(select_max) / double(idle + active);
+		size_t small_idle = size_t(double(idle) * f), small_active = std::max< size_t >(1, size_t(double(active) * f));
+		small_idle = std::min(small_idle, select_max - small_active);
+		std::cout << "The same mix at a size select() can handle:" << std::endl;
+		for (PollBackend backend : list) {
+			if (!report(backend, small_idle, small_active)) return 1;
+		}
+	}
+	return 0;
+}
+
+#endif //_WIN32
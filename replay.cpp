@@ -0,0 +1,124 @@
+//Replay checker: re-runs games from a server replay log (see ReplayLog.hpp) through
+// the server's rule code (ChessRoom), as fast as it can, checking that every move is
+// accepted and judged exactly as it was when the game was played.
+//
+// Usage: ./replay <replay-log> [--repeat N]
+// Stops at the first move that plays out differently; reports games/second otherwise.
+
+#include "ChessRoom.hpp"
+#include "ReplayLog.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct RecordedGame {
+	ReplayLog::Game game;
+	std::vector< ReplayLog::Move > moves;
+};
+
+static std::string result_name(uint8_t result) {
+	if (result == ReplayLog::Playing) return "game continues";
+	if (result == ReplayLog::Tie) return "tie";
+	return "player " + std::to_string(result) + " wins";
+}
+
+//replay one game; returns an empty string if it played out as recorded, otherwise what went differently:
+static std::string replay(RecordedGame const &recorded, size_t *at_move) {
+	ChessRoom room(recorded.game.room, ChessRoom::BotSettings(), nullptr);
+	//(the server starts a game once the room fills, and the next update picks the first player:)
+	room.game_state = 1;
+	room.update();
+
+	for (size_t i = 0; i < recorded.moves.size(); ++i) {
+		*at_move = i;
+		ReplayLog::Move const &move = recorded.moves[i];
+		if (room.curr_player != move.player) {
+			return "player " + std::to_string(move.player) + " moved, but it is player " + std::to_string(room.curr_player) + "'s turn";
+		}
+		if (!room.place_piece(move.x, move.y)) {
+			return "move to (" + std::to_string(move.x) + ", " + std::to_string(move.y) + ") was rejected";
+		}
+		uint8_t result = (room.game_state == 2 ? room.winner : uint8_t(ReplayLog::Playing));
+		if (result != move.result) {
+			return "recorded: " + result_name(move.result) + "; replayed: " + result_name(result);
+		}
+		room.update();
+	}
+	*at_move = recorded.moves.size();
+	if (room.game_state == 2 ? room.winner != recorded.game.result : recorded.game.result != ReplayLog::Playing) {
+		return "game recorded as '" + result_name(recorded.game.result) + "' ended differently";
+	}
+	return "";
+}
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./replay <replay-log> [--repeat N]" << std::endl;
+		return 1;
+	};
+	if (argc < 2) return usage();
+	size_t repeat = 1;
+	for (int argi = 2; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--repeat" && argi + 1 < argc) repeat = std::max< size_t >(1, std::stoul(argv[++argi]));
+		else return usage();
+	}
+
+	//------------ load ------------
+	//(everything is read up front, so the timing below is of the rules alone)
+	std::vector< RecordedGame > games;
+	{
+		std::ifstream from(argv[1], std::ios::binary);
+		if (!from) {
+			std::cerr << "Failed to open '" << argv[1] << "'." << std::endl;
+			return 1;
+		}
+		bool complete = ReplayLog::read(from, [&](ReplayLog::Game const &game, std::vector< ReplayLog::Move > const &moves) {
+			games.emplace_back(RecordedGame{game, moves});
+		});
+		if (!complete) std::cerr << "Note: log ends partway through a game; replaying the " << games.size() << " complete games." << std::endl;
+	}
+
+	size_t moves = 0;
+	for (auto const &recorded : games) {
+		moves += recorded.moves.size();
+		if (recorded.game.width != ChessBoard::Width || recorded.game.win_length != NUM_PIECE_TO_WIN || recorded.game.players != PLAYER_NUM) {
+			std::cerr << "Game from room " << recorded.game.room << " was played on a " << int(recorded.game.width) << "x" << int(recorded.game.width)
+			          << " board with " << int(recorded.game.players) << " players needing " << int(recorded.game.win_length) << " in a row,"
+			          << " but these rules use " << ChessBoard::Width << "x" << ChessBoard::Width << ", " << PLAYER_NUM << ", and " << NUM_PIECE_TO_WIN << "." << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Replaying " << games.size() << " games (" << moves << " moves) from '" << argv[1] << "'"
+	          << (repeat > 1 ? " " + std::to_string(repeat) + " times" : std::string()) << "." << std::endl;
+
+	//------------ replay ------------
+	auto before = std::chrono::steady_clock::now();
+	for (size_t pass = 0; pass < repeat; ++pass) {
+		for (size_t g = 0; g < games.size(); ++g) {
+			size_t at_move = 0;
+			std::string difference = replay(games[g], &at_move);
+			if (difference.empty()) continue;
+
+			RecordedGame const &recorded = games[g];
+			std::cout << "DIVERGED: game " << g << " (room " << recorded.game.room << ", started " << recorded.game.started
+			          << "), move " << at_move << " of " << recorded.moves.size() << ": " << difference << "\n";
+			std::cout << "  moves:";
+			for (size_t i = 0; i < recorded.moves.size() && i <= at_move; ++i) {
+				auto const &move = recorded.moves[i];
+				std::cout << " " << int(move.player) << "@(" << int(move.x) << "," << int(move.y) << ")";
+			}
+			std::cout << std::endl;
+			return 1;
+		}
+	}
+	double seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+
+	double total_games = double(games.size()) * repeat;
+	std::cout << "All games replayed as recorded: " << total_games << " games in " << seconds << "s ("
+	          << total_games / seconds << " games/s, " << double(moves) * repeat / seconds << " moves/s)." << std::endl;
+	return 0;
+}
@@ -0,0 +1,104 @@
+//Benchmark: draining a backlog of small messages from a receive buffer.
+// Usage: ./ring-bench [--bytes B] [--seconds S]
+// Fills a buffer with B bytes (1MB by default) of 3-byte messages, then drains it the way
+// server.cpp does -- look at the front message, then consume it -- and reports messages per
+// second for:
+//  vector: std::vector< char > with erase(begin(), begin() + 3) (the old Connection buffers;
+//          every consume moves the whole backlog, so a drain is quadratic)
+//  ring:   RingBuffer (consume just moves the head)
+//  slab:   SlabBuffer (what Connection::recv_buffer is now)
+// Each buffer is refilled and drained until S seconds have passed (the vector at least once).
+
+#include "RingBuffer.hpp"
+#include "SlabBuffer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./ring-bench [--bytes B] [--seconds S]" << std::endl;
+		return 1;
+	};
+	size_t bytes = 1 << 20;
+	double seconds = 1.0;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--bytes" && argi + 1 < argc) bytes = std::stoul(argv[++argi]);
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else return usage();
+	}
+	if (!(bytes >= 3 && seconds > 0.0)) return usage();
+
+	//the backlog: 'a' messages with a counter in the other two bytes:
+	std::vector< char > messages(bytes / 3 * 3);
+	for (size_t i = 0; i < messages.size(); i += 3) {
+		messages[i] = 'a';
+		messages[i + 1] = char(i / 3);
+		messages[i + 2] = char((i / 3) >> 8);
+	}
+	size_t count = messages.size() / 3;
+
+	//run 'fill' then 'drain' (which returns a checksum, so nothing is optimized away) until 'seconds' pass:
+	auto report = [&](char const *name, auto &&fill, auto &&drain) {
+		uint64_t drained = 0;
+		uint64_t checksum = 0;
+		double elapsed = 0.0;
+		while (drained == 0 || elapsed < seconds) {
+			fill();
+			Clock::time_point before = Clock::now();
+			checksum += drain();
+			elapsed += std::chrono::duration< double >(Clock::now() - before).count();
+			drained += count;
+		}
+		std::cout << "  " << name << ": " << uint64_t(double(drained) / elapsed) << " messages/s ("
+		          << elapsed / double(drained / count) * 1e3 << "ms per drain; checksum " << checksum << ")" << std::endl;
+	};
+
+	std::cout << "Draining " << messages.size() << " bytes of 3-byte messages:" << std::endl;
+	{
+		std::vector< char > buffer;
+		report("vector", [&]() {
+			buffer.assign(messages.begin(), messages.end());
+		}, [&]() {
+			uint64_t sum = 0;
+			while (buffer.size() >= 3) {
+				if (buffer[0] == 'a') sum += uint8_t(buffer[1]);
+				buffer.erase(buffer.begin(), buffer.begin() + 3);
+			}
+			return sum;
+		});
+	}
+	{
+		RingBuffer buffer;
+		report("ring", [&]() {
+			buffer.push(messages.data(), messages.size());
+		}, [&]() {
+			uint64_t sum = 0;
+			while (buffer.size() >= 3) {
+				if (buffer[0] == 'a') sum += uint8_t(buffer[1]);
+				buffer.consume(3);
+			}
+			return sum;
+		});
+	}
+	{
+		SlabBuffer buffer;
+		report("slab", [&]() {
+			buffer.push(messages.data(), messages.size());
+		}, [&]() {
+			uint64_t sum = 0;
+			while (buffer.size() >= 3) {
+				if (buffer[0] == 'a') sum += uint8_t(buffer[1]);
+				buffer.consume(3);
+			}
+			return sum;
+		});
+	}
+	return 0;
+}
@@ -1,13 +1,423 @@
 
 #include "Connection.hpp"
+#include "MessageCodec.hpp"
 #include "ChessBoardData.hpp"
-#include "hex_dump.hpp"
+#include "ChessMessages.hpp"
+#include "ChessRoom.hpp"
+#include "TickScheduler.hpp"
+#include "ReplayLog.hpp"
+#include "RoomStore.hpp"
+#include "Matchmaker.hpp"
+#include "Log.hpp"
 
 #include <chrono>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
 #include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+
+//------------ worker shards ------------
+//Connections are accepted on the main thread and handed off to a shard. Each shard
+// runs its own reactor (a Server with no listen socket) on its own thread and owns
+// the rooms its connections play in, so nothing is shared between shards.
+// (the one exception: a player rejoining -- or a spectator watching -- a room on another shard is handed off to it)
+struct Shard {
+	Shard(size_t index, std::vector< std::unique_ptr< Shard > > const &shards, ChessRoom::BotSettings const &bot_settings, ReplayLog *replay_log, double tick_rate, TickScheduler::CatchUp catch_up);
+
+	size_t index; //in 'shards'
+	std::vector< std::unique_ptr< Shard > > const &shards; //(all of them, for routing rejoins and spectators)
+	ChessRoom::BotSettings bot_settings; //for new rooms
+	ReplayLog *replay_log; //for new rooms (may be null)
+	TickScheduler scheduler;
+	Server server;
+	std::unordered_map< uint32_t, ChessRoom > rooms; //by room id
+	std::vector< ChessRoom * > open_rooms; //rooms (probably) still waiting for players
+	std::unordered_map< Connection *, ChessRoom * > room_of;
+	Matchmaker matchmaker; //connected, but not seated yet (matched at the next tick, in order, unless they rejoin or watch first)
+	std::unordered_map< Connection *, ChessRoom * > watching; //spectators
+	ChessRoom::SpectatorLimits spectator_limits; //for new rooms
+	SendLimits send_limits; //for every connection
+	MessageDispatcher dispatcher;
+	std::thread thread;
+
+	//room ids are handed out so that the shard that owns a room is (id - 1) % shards.size():
+	uint32_t next_room_id;
+	static size_t shard_of(uint32_t room, size_t count) { return (room - 1) % count; }
+
+	//saving room state (if store is set):
+	std::unique_ptr< RoomStore > store;
+	double snapshot_interval = 1.0; //seconds between snapshots
+	TickScheduler::Clock::time_point next_snapshot;
+	double rejoin_wait = 30.0; //seconds restored rooms wait for their players
+
+	//what a connection handed over from another shard's thread came for:
+	// (passed to Server::hand_off with the socket, so it arrives as the connection's handoff_data)
+	struct Arrival {
+		uint8_t type = 0; //MessageRejoin or MessageWatch -- what they asked for
+		SeatMessage seat; //(MessageRejoin)
+		uint32_t room = 0; //(MessageWatch)
+	};
+
+	//spectator counts (read by the main thread for stats):
+	std::atomic< uint64_t > spectator_count{0}; //watching right now
+	std::atomic< uint64_t > spectators_skipped{0}; //times a spectator fell behind and had updates skipped
+	std::atomic< uint64_t > spectators_resynced{0}; //times a spectator caught up and was sent the board again
+	std::atomic< uint64_t > spectators_dropped{0}; //spectators closed for falling too far behind
+	//rooms closed (their games over, or abandoned) so far (read by the main thread for stats):
+	std::atomic< uint64_t > rooms_closed{0};
+	//set by the main thread to make run() return (checked every poll and tick):
+	std::atomic< bool > stop{false};
+
+	//worker thread main loop:
+	void run();
+	//a new room, with this shard's settings:
+	ChessRoom &create_room(uint32_t id);
+	//a room that is waiting for players and has 'seats' free seats (creating one if needed):
+	ChessRoom *open_room(size_t seats);
+	//queue a newly-connected player to be matched with others:
+	void join(Connection *c);
+	//seat a match (formed by matchmaker) together, in seats 1, 2, ... in order:
+	void seat_match(std::vector< Connection * > const &players, Matchmaker::Clock::time_point waiting_since);
+	//the room a player is in (nullptr while they are waiting to be matched):
+	ChessRoom *room_for(Connection *c);
+	//seat a reconnecting player in their old seat (or, failing that, a new one):
+	void rejoin(Connection *c, SeatMessage const &seat);
+	//watch a room as a spectator (0, or a room that isn't open: the featured game):
+	void watch(Connection *c, uint32_t room);
+	//take a connection (rejoining or watching a room on this shard) from another shard's thread:
+	void hand_off(Socket socket, Arrival const &arrival);
+	//remove a disconnected player or spectator from their room (closing the room if nobody needs it any more):
+	void leave(Connection *c);
+	//delete a room, moving anyone still watching it to the featured game:
+	void close_room(ChessRoom *room);
+	//rebuild a room saved before a restart:
+	void restore(RoomStore::Record const &record);
+	//save all rooms to the store; close restored rooms nobody came back to:
+	void snapshot();
+};
+
+Shard::Shard(size_t index_, std::vector< std::unique_ptr< Shard > > const &shards_, ChessRoom::BotSettings const &bot_settings_, ReplayLog *replay_log_, double tick_rate, TickScheduler::CatchUp catch_up)
+	: index(index_), shards(shards_), bot_settings(bot_settings_), replay_log(replay_log_), scheduler(tick_rate, catch_up),
+	  matchmaker(PLAYER_NUM, bot_settings_.bot ? bot_settings_.wait : -1.0), next_room_id(uint32_t(index_ + 1)) {
+	//handle messages from clients:
+	//TODO: update for the sorts of messages your clients send
+
+	//'a' x y -- place a piece at board position (x, y) (signed offsets from the center):
+	dispatcher.on(MessageMove, [this](Connection *c, MessageView const &message) {
+		if (watching.count(c)) return; //(spectators don't get to play)
+		ChessRoom *room = room_for(c);
+		if (!room) return; //(not seated yet)
+		if (!room->handle_move(c, message)) {
+			c->close();
+			leave(c);
+		}
+	});
+
+	//'r' seq -- client detected a gap in the move deltas, so send it the whole board:
+	dispatcher.on(MessageResync, [this](Connection *c, MessageView const &message) {
+		auto w = watching.find(c);
+		if (w != watching.end()) c->send_shared(w->second->spectator_board_block());
+		else if (ChessRoom *room = room_for(c)) room->handle_resync(c);
+	});
+
+	//'j' room seat token -- client reconnected and wants its old seat back:
+	dispatcher.on(MessageRejoin, [this](Connection *c, MessageView const &message) {
+		SeatMessage seat;
+		if (message.size != sizeof(seat)) {
+			LOG(Warn, "'j' message of unexpected size " << message.size << " received from client!");
+			c->close();
+			leave(c);
+			return;
+		}
+		message.read(0, &seat);
+		Shard &owner = *shards[shard_of(seat.room, shards.size())];
+		if (&owner == this || seat.room == 0) {
+			rejoin(c, seat);
+		} else {
+			//room is on another shard -- move the connection there:
+			// (detaching stops this dispatch, and the client sends nothing else until it hears back)
+			leave(c);
+			Arrival arrival;
+			arrival.type = MessageRejoin;
+			arrival.seat = seat;
+			owner.hand_off(server.detach(c), arrival);
+		}
+	});
+
+	//'w' room -- watch a room (0: the featured game) instead of playing:
+	dispatcher.on(MessageWatch, [this](Connection *c, MessageView const &message) {
+		WatchMessage watch_message;
+		if (message.size != sizeof(watch_message)) {
+			LOG(Warn, "'w' message of unexpected size " << message.size << " received from client!");
+			c->close();
+			leave(c);
+			return;
+		}
+		message.read(0, &watch_message);
+		Shard &owner = *shards[shard_of(watch_message.room, shards.size())];
+		if (&owner == this || watch_message.room == 0) {
+			watch(c, watch_message.room);
+		} else {
+			//room is on another shard -- move the connection there (as for 'j', above):
+			leave(c);
+			Arrival arrival;
+			arrival.type = MessageWatch;
+			arrival.room = watch_message.room;
+			owner.hand_off(server.detach(c), arrival);
+		}
+	});
+}
+
+ChessRoom &Shard::create_room(uint32_t id) {
+	ChessRoom &room = rooms.try_emplace(id, id, bot_settings, replay_log, store.get()).first->second;
+	room.spectator_limits = spectator_limits;
+	return room;
+}
+
+ChessRoom *Shard::open_room(size_t seats) {
+	for (auto r = open_rooms.begin(); r != open_rooms.end(); /* later */) {
+		//(rooms that stopped accepting players are dropped from the list as they are found)
+		if (!(*r)->accepting_players()) {
+			r = open_rooms.erase(r);
+		} else if ((*r)->free_seats() >= seats) {
+			return *r;
+		} else {
+			++r;
+		}
+	}
+	uint32_t id = next_room_id;
+	next_room_id += uint32_t(shards.size());
+	ChessRoom *room = &create_room(id);
+	open_rooms.emplace_back(room);
+	return room;
+}
+
+void Shard::join(Connection *c) {
+	matchmaker.enqueue(c);
+}
+
+void Shard::seat_match(std::vector< Connection * > const &players, Matchmaker::Clock::time_point waiting_since) {
+	ChessRoom *room = open_room(players.size());
+	for (Connection *c : players) {
+		bool joined = room->join(c);
+		assert(joined);
+		room_of.emplace(c, room);
+	}
+	//(bots fill the rest of a smaller match's seats once its players have waited long enough -- counting time in the queue)
+	room->waiting_since = std::min(room->waiting_since, waiting_since);
+}
+
+ChessRoom *Shard::room_for(Connection *c) {
+	auto f = room_of.find(c);
+	return (f != room_of.end() ? f->second : nullptr);
+}
+
+void Shard::rejoin(Connection *c, SeatMessage const &seat) {
+	//(if they were already seated somewhere, they give that seat up)
+	leave(c);
+
+	auto f = rooms.find(seat.room);
+	if (f != rooms.end() && f->second.rejoin(c, seat.seat, seat.token)) {
+		LOG(Info, "Room " << seat.room << ": player " << seat.seat << " rejoined.");
+		room_of.emplace(c, &f->second);
+	} else {
+		LOG(Info, "Room " << seat.room << ": can't rejoin seat " << seat.seat << "; seating as a new player.");
+		join(c);
+	}
+}
+
+void Shard::watch(Connection *c, uint32_t room_id) {
+	//(if they were playing or watching somewhere, they stop)
+	leave(c);
+
+	ChessRoom *room = nullptr;
+	auto f = rooms.find(room_id);
+	if (room_id != 0 && f != rooms.end()) {
+		room = &f->second;
+	} else {
+		if (room_id != 0) LOG(Info, "Room " << room_id << " isn't open; watching the featured game instead.");
+		//featured game: one being played, preferring the one most people are watching already:
+		auto rank = [](ChessRoom const &r) { return std::make_tuple(r.game_state == 1, r.spectators.size(), r.move_seq); };
+		for (auto &[id, candidate] : rooms) {
+			(void)id;
+			if (!room || rank(candidate) > rank(*room)) room = &candidate;
+		}
+		//(nothing going on? wait for a game to start)
+		if (!room) room = open_room(0);
+	}
+	room->watch(c);
+	watching.emplace(c, room);
+}
+
+void Shard::hand_off(Socket socket, Arrival const &arrival) {
+	if (socket == InvalidSocket) return;
+	server.hand_off(socket, std::make_shared< Arrival >(arrival));
+}
+
+void Shard::leave(Connection *c) {
+	if (matchmaker.remove(c)) return;
+	ChessRoom *room = nullptr;
+	if (auto w = watching.find(c); w != watching.end()) {
+		room = w->second;
+		watching.erase(w);
+		room->unwatch(c);
+	} else if (auto f = room_of.find(c); f != room_of.end()) {
+		room = f->second;
+		room_of.erase(f);
+		room->leave(c);
+	} else {
+		return; //(already left, e.g., when moving to another shard)
+	}
+
+	auto listed = std::find(open_rooms.begin(), open_rooms.end(), room);
+	if (room->closable()) {
+		close_room(room);
+	} else if (room->accepting_players() && listed == open_rooms.end()) {
+		open_rooms.emplace_back(room);
+	}
+}
+
+void Shard::close_room(ChessRoom *room) {
+	auto listed = std::find(open_rooms.begin(), open_rooms.end(), room);
+	if (listed != open_rooms.end()) open_rooms.erase(listed);
+
+	std::vector< Connection * > moving;
+	for (auto const &spectator : room->spectators) {
+		moving.emplace_back(spectator.connection);
+		watching.erase(spectator.connection);
+	}
+	room->spectators.clear();
+	rooms.erase(room->id);
+	rooms_closed += 1;
+
+	for (Connection *c : moving) watch(c, 0);
+}
+
+void Shard::restore(RoomStore::Record const &record) {
+	ChessRoom &room = create_room(record.id);
+	room.restore(record, rejoin_wait);
+	//new rooms get ids after every restored one (keeping to this shard's ids):
+	while (next_room_id <= record.id) next_room_id += uint32_t(shards.size());
+}
+
+void Shard::snapshot() {
+	//restored rooms nobody came back to can go now (and rooms still waiting for players can take new ones):
+	static thread_local std::vector< ChessRoom * > closing;
+	closing.clear();
+	for (auto &[id, room] : rooms) {
+		(void)id;
+		if (room.closable()) {
+			closing.emplace_back(&room);
+		} else if (room.accepting_players() && std::find(open_rooms.begin(), open_rooms.end(), &room) == open_rooms.end()) {
+			open_rooms.emplace_back(&room);
+		}
+	}
+	for (ChessRoom *room : closing) close_room(room);
+
+	if (!store) return;
+	static thread_local std::vector< RoomStore::Record > records;
+	records.resize(rooms.size());
+	size_t i = 0;
+	for (auto const &[id, room] : rooms) {
+		(void)id;
+		room.save(&records[i++]);
+	}
+	store->snapshot(records);
+}
+
+void Shard::run() {
+	//poll at least this often so handed-off connections are picked up promptly:
+	constexpr double HandOffLatency = 0.005;
+	next_snapshot = TickScheduler::Clock::now() + std::chrono::duration_cast< TickScheduler::Clock::duration >(std::chrono::duration< double >(snapshot_interval));
+
+	while (!stop) {
+		//process incoming data from clients until a tick is due:
+		double remain = scheduler.until_tick();
+		if (remain > 0.0) {
+			auto start = TickScheduler::Clock::now();
+			server.poll([&](Connection *c, Connection::Event evt){
+				if (evt == Connection::OnOpen) {
+					c->set_send_limits(send_limits);
+					//client connected -- rejoining or watching from another shard, or new (to be seated at the next tick):
+					Arrival arrival;
+					if (c->handoff_data) {
+						arrival = *std::static_pointer_cast< Arrival >(c->handoff_data);
+						c->handoff_data.reset();
+					}
+					if (arrival.type == MessageRejoin) rejoin(c, arrival.seat);
+					else if (arrival.type == MessageWatch) watch(c, arrival.room);
+					else join(c);
+				} else if (evt == Connection::OnClose) {
+					//client disconnected:
+					leave(c);
+				} else { assert(evt == Connection::OnRecv);
+
+					//got data from client:
+					LOG_BYTES(Debug, "got bytes", c->recv_buffer.linearize(), c->recv_buffer.size());
+
+					//handle messages from client:
+					MessageDispatcher::Status status = dispatcher.dispatch(c);
+					if (status != MessageDispatcher::Ok) {
+						LOG(Warn, "message of unexpected type '" << dispatcher.bad_type << "' (or size) received from client!");
+						//shut down client connection:
+						// (closing here won't generate an OnClose event, so forget the player now)
+						c->close();
+						leave(c);
+					}
+				}
+			}, std::min(remain, HandOffLatency));
+			scheduler.add_time(TickScheduler::Poll, start);
+			continue;
+		}
+
+		scheduler.begin_tick();
+
+		auto start = TickScheduler::Clock::now();
+		//seat new players who didn't ask for an old seat back (or to watch):
+		matchmaker.form(start, [this](std::vector< Connection * > const &players, Matchmaker::Clock::time_point waiting_since) {
+			seat_match(players, waiting_since);
+		});
+
+		for (auto &[id, room] : rooms) {
+			(void)id;
+			room.update();
+		}
+		scheduler.add_time(TickScheduler::Logic, start);
+
+		start = TickScheduler::Clock::now();
+		for (auto &[id, room] : rooms) {
+			(void)id;
+			room.broadcast();
+			//spectators that fell too far behind were closed:
+			for (Connection *c : room.dropped_spectators) watching.erase(c);
+			room.dropped_spectators.clear();
+			spectators_skipped += room.spectators_skipped;
+			spectators_resynced += room.spectators_resynced;
+			spectators_dropped += room.spectators_dropped;
+			room.spectators_skipped = room.spectators_resynced = room.spectators_dropped = 0;
+		}
+		spectator_count = watching.size();
+		scheduler.add_time(TickScheduler::Broadcast, start);
+
+		if (TickScheduler::Clock::now() >= next_snapshot) {
+			next_snapshot += std::chrono::duration_cast< TickScheduler::Clock::duration >(std::chrono::duration< double >(snapshot_interval));
+			start = TickScheduler::Clock::now();
+			snapshot();
+			scheduler.add_time(TickScheduler::Logic, start);
+		}
+
+		scheduler.end_tick();
+	}
+}
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -30,311 +440,284 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./server <port> [worker-threads] [--bot-wait <seconds>] [--bot-time <seconds>] [--bot-threads <count>] [--bot-method maxn|mcts] [--no-bots]\n"
+		             "\t\t[--tick-rate <hz>] [--catch-up skip|burst] [--tick-stats <seconds>] [--record <replay-log>]\n"
+		             "\t\t[--state-dir <directory>] [--snapshot-interval <seconds>] [--rejoin-wait <seconds>] [--spectator-queue <KiB>]\n"
+		             "\t\t[--send-queue <KiB>] [--overflow coalesce|drop-oldest|disconnect] [--io select|epoll|uring] [--net-stats <json-file>]\n"
+		             "\t\t[--log debug|info|warn|error|off] [--trace <trace-file>] [--run-for <seconds>]\n"
+		             "\t(bots fill seats humans leave empty for bot-wait seconds, and take bot-time seconds per move;\n"
+		             "\t tick-stats prints tick timing every so many seconds; record appends every game played to a replay log;\n"
+		             "\t state-dir saves rooms there, to be restored on restart -- restored rooms wait rejoin-wait seconds for their players;\n"
+		             "\t spectators with more than spectator-queue KiB waiting to be sent have updates skipped, and are dropped at 16x that;\n"
+		             "\t connections with more than send-queue KiB waiting to be sent get the overflow policy, and are dropped at 16x that;\n"
+		             "\t io picks how sockets are polled -- epoll by default on linux; uring falls back to epoll where unavailable;\n"
+		             "\t net-stats rewrites network counters to a JSON file every tick-stats seconds (or every second);\n"
+		             "\t log sets which messages are printed (info by default; debug dumps everything received);\n"
+		             "\t trace writes every message frame sent or received to a file -- print it with trace-dump;\n"
+		             "\t run-for exits after that long, printing tick timing and rooms closed per second -- see worker-sweep.py)" << std::endl;
+		return 1;
+	};
+	if (argc < 2) return usage();
+
+	size_t workers = std::max(1U, std::thread::hardware_concurrency());
+	size_t bot_threads = workers;
+	bool bots = true;
+	ChessRoom::BotSettings bot_settings;
+	double tick_rate = 10.0; //TODO: set a server tick that makes sense for your game
+	TickScheduler::CatchUp catch_up = TickScheduler::Skip;
+	double stats_interval = 0.0;
+	double run_for = 0.0; //(0: forever)
+	std::string net_stats_path;
+	std::string record_path;
+	std::string state_dir;
+	double snapshot_interval = 1.0;
+	double rejoin_wait = 30.0;
+	ChessRoom::SpectatorLimits spectator_limits;
+	SendLimits send_limits;
+	send_limits.high = 256 * 1024;
+	send_limits.low = send_limits.high / 4;
+	send_limits.max = send_limits.high * 16;
+	send_limits.overflow = SendLimits::Coalesce;
+	for (int argi = 2; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--tick-rate" && argi + 1 < argc) {
+			tick_rate = std::stod(argv[++argi]);
+			if (!(tick_rate > 0.0)) return usage();
+		} else if (arg == "--catch-up" && argi + 1 < argc) {
+			std::string policy = argv[++argi];
+			if (policy == "skip") catch_up = TickScheduler::Skip;
+			else if (policy == "burst") catch_up = TickScheduler::Burst;
+			else return usage();
+		} else if (arg == "--tick-stats" && argi + 1 < argc) {
+			stats_interval = std::stod(argv[++argi]);
+		} else if (arg == "--run-for" && argi + 1 < argc) {
+			run_for = std::stod(argv[++argi]);
+			if (!(run_for > 0.0)) return usage();
+		} else if (arg == "--net-stats" && argi + 1 < argc) {
+			net_stats_path = argv[++argi];
+		} else if (arg == "--log" && argi + 1 < argc) {
+			Log::Level level;
+			if (!Log::parse_level(argv[++argi], &level)) return usage();
+			Log::set_level(level);
+		} else if (arg == "--trace" && argi + 1 < argc) {
+			std::string path = argv[++argi];
+			Log::trace_to(path);
+			std::cout << "Tracing message frames to '" << path << "'." << std::endl;
+		} else if (arg == "--record" && argi + 1 < argc) {
+			record_path = argv[++argi];
+		} else if (arg == "--state-dir" && argi + 1 < argc) {
+			state_dir = argv[++argi];
+		} else if (arg == "--snapshot-interval" && argi + 1 < argc) {
+			snapshot_interval = std::stod(argv[++argi]);
+			if (!(snapshot_interval > 0.0)) return usage();
+		} else if (arg == "--rejoin-wait" && argi + 1 < argc) {
+			rejoin_wait = std::stod(argv[++argi]);
+		} else if (arg == "--spectator-queue" && argi + 1 < argc) {
+			size_t kib = std::stoul(argv[++argi]);
+			if (kib == 0) return usage();
+			spectator_limits.high = kib * 1024;
+			spectator_limits.low = spectator_limits.high / 4;
+			spectator_limits.drop = spectator_limits.high * 16;
+		} else if (arg == "--send-queue" && argi + 1 < argc) {
+			size_t kib = std::stoul(argv[++argi]);
+			if (kib == 0) return usage();
+			send_limits.high = kib * 1024;
+			send_limits.low = send_limits.high / 4;
+			send_limits.max = send_limits.high * 16;
+		} else if (arg == "--overflow" && argi + 1 < argc) {
+			std::string policy = argv[++argi];
+			if (policy == "coalesce") send_limits.overflow = SendLimits::Coalesce;
+			else if (policy == "drop-oldest") send_limits.overflow = SendLimits::DropOldest;
+			else if (policy == "disconnect") send_limits.overflow = SendLimits::Disconnect;
+			else return usage();
+		} else if (arg == "--io" && argi + 1 < argc) {
+			std::string io = argv[++argi];
+			if (io == "select") Server::default_backend = PollBackend::Select;
+			else if (io == "epoll") Server::default_backend = PollBackend::Epoll;
+			else if (io == "uring") Server::default_backend = PollBackend::IoUring;
+			else return usage();
+		} else if (arg == "--no-bots") {
+			bots = false;
+		} else if (arg == "--bot-wait" && argi + 1 < argc) {
+			bot_settings.wait = std::stod(argv[++argi]);
+		} else if (arg == "--bot-time" && argi + 1 < argc) {
+			bot_settings.budget = std::stod(argv[++argi]);
+		} else if (arg == "--bot-method" && argi + 1 < argc) {
+			std::string method = argv[++argi];
+			if (method == "maxn") bot_settings.method = ChessBot::MaxN;
+			else if (method == "mcts") bot_settings.method = ChessBot::MonteCarlo;
+			else return usage();
+		} else if (arg == "--bot-threads" && argi + 1 < argc) {
+			bot_threads = std::stoul(argv[++argi]);
+		} else if (argi == 2 && arg[0] != '-') {
+			workers = std::stoul(arg);
+		} else {
+			return usage();
+		}
+	}
+	if (workers == 0 || bot_threads == 0) {
+		std::cerr << "Need at least one worker thread." << std::endl;
 		return 1;
 	}
 
 	//------------ initialization ------------
 
 	Server server(argv[1]);
+	std::cout << "Polling sockets with " << Server::backend_name(server.backend) << "." << std::endl;
+
+	//bots think on their own threads (shared by all rooms), so their searches never hold up a tick:
+	std::unique_ptr< ChessBot > bot;
+	if (bots) {
+		bot = std::make_unique< ChessBot >(bot_threads);
+		bot_settings.bot = bot.get();
+		std::cout << "Bots think on " << bot_threads << " thread(s), " << bot_settings.budget << "s per move ("
+		          << (bot_settings.method == ChessBot::MonteCarlo ? "Monte Carlo tree search" : "max-n search") << ")." << std::endl;
+	}
 
+	//games are recorded for replay by all shards into one log:
+	std::unique_ptr< ReplayLog > replay_log;
+	if (!record_path.empty()) {
+		replay_log = std::make_unique< ReplayLog >(record_path);
+		std::cout << "Recording games to '" << record_path << "'." << std::endl;
+	}
 
-	//------------ main loop ------------
-	constexpr float ServerTick = 1.0f / 10.0f; //TODO: set a server tick that makes sense for your game
+	std::vector< std::unique_ptr< Shard > > shards;
+	for (size_t i = 0; i < workers; ++i) {
+		shards.emplace_back(std::make_unique< Shard >(i, shards, bot_settings, replay_log.get(), tick_rate, catch_up));
+		shards.back()->snapshot_interval = snapshot_interval;
+		shards.back()->rejoin_wait = rejoin_wait;
+		shards.back()->spectator_limits = spectator_limits;
+		shards.back()->send_limits = send_limits;
+	}
 
-	//server state:
+	//pick up where a previous server left off (it may have had a different number of shards):
+	if (!state_dir.empty()) {
+		auto before = std::chrono::steady_clock::now();
+		auto prefix = [&](size_t i) { return state_dir + "/shard-" + std::to_string(i); };
 
-	//per-client state:
-	struct PlayerInfo {
-		PlayerInfo() {
-			static uint32_t next_player_id = 1;
-			name = "Player" + std::to_string(next_player_id);
-			next_player_id += 1;
+		std::vector< RoomStore::Record > restored;
+		size_t old_shards = 0;
+		for (std::vector< RoomStore::Record > records; RoomStore::load(prefix(old_shards), &records); ++old_shards) {
+			restored.insert(restored.end(), records.begin(), records.end());
 		}
-		std::string name;
-
-		//uint32_t left_presses = 0;
-		//uint32_t right_presses = 0;
-		//uint32_t up_presses = 0;
-		//uint32_t down_presses = 0;
-
-		//int32_t total = 0;
-		//int8_t last_pos_x = 0;
-		//int8_t last_pos_y = 0;
-		//int8_t chess_color = 0;
-	};
-	std::unordered_map< Connection *, PlayerInfo > players;
-
-	// game state:
-	std::vector<std::vector<int>> chess_board(NUM_PIECES_PER_LINE_HALF * 2 + 1, std::vector<int>(NUM_PIECES_PER_LINE_HALF * 2 + 1, 0));
-	// 0: waiting for player, 1: playing
-	uint8_t game_state = 0;
-	uint8_t curr_player = 0;
-	uint8_t color_to_draw = 0;
-	int8_t last_pos_x = 0;
-	int8_t last_pos_y = 0;
-	size_t remaining_pos = chess_board.size() * chess_board[0].size();
-	std::string game_over_message = "";
-
-
-	// Code inspired by : https://github.com/tdang33/Gomoku-Five-in-a-row-/blob/master/src/Board.cpp
-	auto judge_game = [&](int x, int y, uint8_t value) {
-		bool res = false;
-		uint8_t max_size = NUM_PIECES_PER_LINE_HALF * 2;
-		// Check column
-		{
-			uint8_t sum = 1;
-			uint8_t count = 1;
-			while (y - count >= 0 && chess_board[x][y - count] == value)
-			{
-				sum++;
-				count++;
-			}
-			count = 1;
-			while (y + count <= max_size && chess_board[x][y + count] == value)
-			{
-				sum++;
-				count++;
-			}
-			res = sum >= NUM_PIECE_TO_WIN;
+		for (size_t i = 0; i < shards.size(); ++i) {
+			shards[i]->store = std::make_unique< RoomStore >(prefix(i));
 		}
-
-		if (res) return true;
-
-		// Check row
-		{
-			uint8_t sum = 1;
-			uint8_t count = 1;
-			while (x - count >= 0 && chess_board[x - count][y] == value)
-			{
-				sum++;
-				count++;
-			}
-			count = 1;
-			while (x + count <= max_size && chess_board[x + count][y] == value)
-			{
-				sum++;
-				count++;
-			}
-			res = sum >= NUM_PIECE_TO_WIN;
+		size_t moves = 0;
+		for (auto const &record : restored) {
+			shards[Shard::shard_of(record.id, shards.size())]->restore(record);
+			moves += record.moves;
 		}
+		//save the restored state in the new layout, then clear out what's left of the old one:
+		for (auto &shard : shards) shard->snapshot();
+		for (size_t i = shards.size(); i < old_shards; ++i) RoomStore::remove(prefix(i));
 
-		if (res) return true;
+		double ms = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count() * 1e3;
+		std::cout << "Saving rooms to '" << state_dir << "' every " << snapshot_interval << "s; restored " << restored.size()
+		          << " room(s) (" << moves << " moves) from " << old_shards << " shard(s) in " << ms << "ms." << std::endl;
+	}
 
-		//// Check diag 1
-		{
-			uint8_t sum = 1;
-			uint8_t count = 1;
-			while (x - count >= 0 && y - count >= 0 && chess_board[x - count][y - count] == value)
-			{
-				sum++;
-				count++;
+	for (auto &shard : shards) {
+		shard->thread = std::thread(&Shard::run, shard.get());
+	}
+	std::cout << "Serving rooms on " << workers << " worker thread(s)." << std::endl;
+
+	//------------ main loop ------------
+	//accept connections and hand them to shards, PLAYER_NUM at a time (so that players who
+	// arrive together land on the same shard and can fill a room together):
+	uint64_t accepted = 0;
+	auto started = std::chrono::steady_clock::now();
+	auto next_stats = std::chrono::steady_clock::now() + std::chrono::duration< double >(stats_interval);
+	double net_stats_interval = (stats_interval > 0.0 ? stats_interval : 1.0);
+	auto next_net_stats = std::chrono::steady_clock::now() + std::chrono::duration< double >(net_stats_interval);
+	//network counters: shards' connections (the accepting server only hands its connections off, so is counted separately):
+	auto shard_net_stats = [&]() {
+		NetStats::Snapshot net;
+		for (auto const &shard : shards) net += shard->server.stats.snapshot();
+		return net;
+	};
+	while (true) {
+		server.poll([&](Connection *c, Connection::Event evt){
+			if (evt == Connection::OnOpen) {
+				Shard &shard = *shards[(accepted / PLAYER_NUM) % shards.size()];
+				accepted += 1;
+				shard.server.hand_off(server.detach(c));
 			}
-			count = 1;
-			while (x + count <= max_size && y + count <= max_size && chess_board[x + count][y + count] == value)
-			{
-				sum++;
-				count++;
+		}, (stats_interval > 0.0 ? std::min(stats_interval, 1.0) : 1.0));
+
+		//done? stop the shards, then summarize the run (one "result:" line, for scripts):
+		if (run_for > 0.0 && std::chrono::steady_clock::now() >= started + std::chrono::duration< double >(run_for)) {
+			double elapsed = std::chrono::duration< double >(std::chrono::steady_clock::now() - started).count();
+			for (auto &shard : shards) shard->stop = true;
+			for (auto &shard : shards) shard->thread.join();
+			TickScheduler::Stats stats;
+			uint64_t rooms_closed = 0;
+			for (auto const &shard : shards) {
+				stats += shard->scheduler.stats();
+				rooms_closed += shard->rooms_closed;
 			}
-			res = sum >= NUM_PIECE_TO_WIN;
+			std::cout << "--- after " << elapsed << "s (" << shards.size() << " shard(s) at " << tick_rate << "Hz, " << accepted << " connections) ---\n";
+			stats.print(std::cout);
+			std::cout << "result: workers " << shards.size() << ", rooms/s " << double(rooms_closed) / elapsed
+			          << ", lateness p99 <=" << stats.lateness.percentile(0.99) * 1e3 << "ms" << std::endl;
+			break;
 		}
 
-		if (res) return true;
-
-		//// Check diag 2
-		{
-			uint8_t sum = 1;
-			uint8_t count = 1;
-			while (x - count >= 0 && y + count <= max_size && chess_board[x - count][y + count] == value)
+		//network counters, for other programs to read:
+		if (!net_stats_path.empty() && std::chrono::steady_clock::now() >= next_net_stats) {
+			next_net_stats += std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(net_stats_interval));
+			//(written aside and renamed into place, so readers never see a partial file)
+			std::string temp = net_stats_path + ".tmp";
 			{
-				sum++;
-				count++;
+				std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+				out << "{\"shards\":";
+				shard_net_stats().print_json(out);
+				out << ",\"acceptor\":";
+				server.stats.snapshot().print_json(out);
+				out << "}\n";
 			}
-			count = 1;
-			while (x + count <= max_size && y - count >= 0 && chess_board[x + count][y - count] == value)
-			{
-				sum++;
-				count++;
+			if (std::rename(temp.c_str(), net_stats_path.c_str()) != 0) {
+				std::cerr << "Failed to write network stats to '" << net_stats_path << "': " << strerror(errno) << std::endl;
 			}
-			res = sum >= NUM_PIECE_TO_WIN;
-		}
-
-		return res;
-	};
-
-
-	while (true) {
-		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
-		//process incoming data from clients until a tick has elapsed:
-		while (true) {
-			auto now = std::chrono::steady_clock::now();
-			double remain = std::chrono::duration< double >(next_tick - now).count();
-			if (remain < 0.0) {
-				next_tick += std::chrono::duration< double >(ServerTick);
-				break;
-			}
-			server.poll([&](Connection *c, Connection::Event evt){
-				if (evt == Connection::OnOpen) {
-					//client connected:
-
-					//if (players.size() < PLAYER_NUM) {
-						//create some player info for them:
-						players.emplace(c, PlayerInfo());
-					//}
-
-					// Start the game when all players are ready
-					if (players.size() >= PLAYER_NUM && game_state == 0) {
-						//curr_player = 1;
-						game_state = 1;
-					}
-
-				} else if (evt == Connection::OnClose) {
-					//client disconnected:
-
-					//remove them from the players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					players.erase(f);
-
-
-				} else { assert(evt == Connection::OnRecv);
-					
-					//look up in players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					PlayerInfo &player = f->second;
-
-					//got data from client:
-					std::cout << "got bytes:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-
-					//handle messages from client:
-					//TODO: update for the sorts of messages your clients send
-					while (c->recv_buffer.size() >= 3) {
-						//expecting five-byte messages 'b' (left count) (right count) (down count) (up count)
-						char type = c->recv_buffer[0];
-						if (type != 'a') {
-							std::cout << " message of non-'b' type received from client!" << std::endl;
-							//shut down client connection:
-							c->close();
-							return;
-						}
-						//uint8_t left_count = c->recv_buffer[1];
-						//uint8_t right_count = c->recv_buffer[2];
-						//uint8_t down_count = c->recv_buffer[3];
-						//uint8_t up_count = c->recv_buffer[4];
-						// 
-						//player.left_presses += left_count;
-						//player.right_presses += right_count;
-						//player.down_presses += down_count;
-						//player.up_presses += up_count;
-
-						if ((player.name[6] - '0') == curr_player) {
-							int8_t pos_x = c->recv_buffer[1];
-							int8_t pos_y = c->recv_buffer[2];
-
-
-							// Check valid
-							if (chess_board[pos_x + NUM_PIECES_PER_LINE_HALF][pos_y + NUM_PIECES_PER_LINE_HALF] == 0) {
-								chess_board[pos_x + NUM_PIECES_PER_LINE_HALF][pos_y + NUM_PIECES_PER_LINE_HALF] = curr_player;
-								last_pos_x = pos_x;
-								last_pos_y = pos_y;
-								color_to_draw = curr_player;
-								curr_player = (curr_player + 1 - 1) % PLAYER_NUM + 1;
-								remaining_pos = remaining_pos == 0 ? 0 : remaining_pos - 1;
-							}
-							else
-							{
-								std::cout << "This place already has a piece" << std::endl;
-							}
-						}
-
-						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 3);
-					}
-				}
-			}, remain);
 		}
 
-//		std::cout << last_pos_x + NUM_PIECES_PER_LINE_HALF << "  " << last_pos_y + NUM_PIECES_PER_LINE_HALF << "  " << color_to_draw << std::endl;
-
-		// Game state logic update
-		if (game_state == 1 && color_to_draw != 0) {
-			if (remaining_pos == 0) {
-				game_state = 2;
-				game_over_message = "Game is a tie.";
+		//tick timing, all shards together:
+		if (stats_interval > 0.0 && std::chrono::steady_clock::now() >= next_stats) {
+			next_stats += std::chrono::duration_cast< std::chrono::steady_clock::duration >(std::chrono::duration< double >(stats_interval));
+			TickScheduler::Stats stats;
+			for (auto const &shard : shards) stats += shard->scheduler.stats();
+			std::cout << "--- tick stats (" << shards.size() << " shard(s) at " << tick_rate << "Hz) ---\n";
+			stats.print(std::cout);
+			uint64_t spectators = 0, skipped = 0, resynced = 0, dropped = 0;
+			for (auto const &shard : shards) {
+				spectators += shard->spectator_count;
+				skipped += shard->spectators_skipped;
+				resynced += shard->spectators_resynced;
+				dropped += shard->spectators_dropped;
 			}
-			else if (judge_game(last_pos_x + NUM_PIECES_PER_LINE_HALF, last_pos_y + NUM_PIECES_PER_LINE_HALF, color_to_draw))
-			{
-				game_state = 2;
-				game_over_message = "Player" + std::to_string(color_to_draw) + " wins!";
+			std::cout << "spectators: " << spectators << " watching; " << skipped << " fell behind, " << resynced << " caught up, " << dropped << " dropped\n";
+			uint64_t joined = 0, left = 0, matched = 0, full = 0, partial = 0;
+			TickScheduler::Histogram time_to_match;
+			for (auto const &shard : shards) {
+				Matchmaker const &m = shard->matchmaker;
+				joined += m.joined;
+				left += m.left;
+				matched += m.matched;
+				full += m.full;
+				partial += m.partial;
+				time_to_match += m.time_to_match.load();
 			}
+			std::cout << "matchmaking: " << (joined - left - matched) << " waiting; " << full << " full + " << partial << " smaller matches;"
+			          << " time to match p50 <=" << time_to_match.percentile(0.5) * 1e3 << "ms, p99 <=" << time_to_match.percentile(0.99) * 1e3
+			          << "ms, max " << time_to_match.max * 1e3 << "ms\n";
+			std::cout << "send queues: " << send_limit_stats.high_water << " past high water; " << send_limit_stats.coalesced << " coalesced, "
+			          << send_limit_stats.dropped << " dropped (" << send_limit_stats.dropped_bytes << " bytes); " << send_limit_stats.disconnects << " disconnected\n";
+			std::cout << "network (" << server.stats.opened.load() << " accepted, " << Server::backend_name(server.backend) << "):\n";
+			shard_net_stats().print(std::cout);
+			if (uint64_t dropped = Log::dropped()) std::cout << "log: " << dropped << " records dropped (writer fell behind)\n";
+			std::cout.flush();
 		}
-
-		//update current game state
-		//TODO: replace with *your* game state update
-		std::string message_to_sent = "";
-		std::string status_message = "";
-		std::string other_message = "";
-		//int32_t overall_sum = 0;
-		//for (auto &[c, player] : players) {
-		//	(void)c; //work around "unused variable" warning on whatever version of g++ github actions is running
-		//	for (; player.left_presses > 0; --player.left_presses) {
-		//		player.total -= 1;
-		//	}
-		//	for (; player.right_presses > 0; --player.right_presses) {
-		//		player.total += 1;
-		//	}
-		//	for (; player.down_presses > 0; --player.down_presses) {
-		//		player.total -= 10;
-		//	}
-		//	for (; player.up_presses > 0; --player.up_presses) {
-		//		player.total += 10;
-		//	}
-		//	if (status_message != "") status_message += " + ";
-		//	status_message += std::to_string(player.total) + " (" + player.name + ")";
-
-		//	overall_sum += player.total;
-		//}
-		//status_message += " = " + std::to_string(overall_sum);
-		//std::cout << status_message << std::endl; //DEBUG
-
-		//if (curr_player != 0)
-		status_message = std::to_string(color_to_draw) + "," + std::to_string(last_pos_x) + "," + std::to_string(last_pos_y);
-
-		//send updated game state to all clients
-		//TODO: update for your game state
-		for (auto &[c, player] : players) {
-			//(void)player; //work around "unused variable" warning on whatever g++ github actions uses
-			//send an update starting with 'm', a 24-bit size, and a blob of text:
-			other_message = "";
-			other_message = other_message + "," + player.name;
-			if (curr_player == 0 && game_state == 0)
-				other_message = other_message + "," + "Waiting for other players to join . . .";
-			else if ((player.name[6] - '0') == curr_player)
-				other_message = other_message + "," + "It's your turn.";
-			else if (game_state == 1)
-				other_message = other_message + "," + "Player" + std::to_string(curr_player) + " is deciding . . .";
-			else if (game_state == 2)
-				other_message = other_message + "," + game_over_message;
-
-			message_to_sent = status_message + other_message;
-			
-			c->send('m');
-			c->send(uint8_t(message_to_sent.size() >> 16));
-			c->send(uint8_t((message_to_sent.size() >> 8) % 256));
-			c->send(uint8_t(message_to_sent.size() % 256));
-			c->send_buffer.insert(c->send_buffer.end(), message_to_sent.begin(), message_to_sent.end());
-		}
-
-
-
-
-		if (game_state == 0)
-			curr_player = 0;
-		else if (game_state == 1 && curr_player == 0)
-			curr_player = 1;
-		else if (game_state == 2)
-			curr_player = 0;
 	}
 
 	return 0;
@@ -0,0 +1,71 @@
+//Trace printer: prints the message frames in a trace file (see Log::trace_to in Log.hpp)
+// as hex dumps, one per frame, in the order they were recorded.
+//
+// Usage: ./trace-dump <trace-file> [--stream S] [--in | --out]
+// (--stream keeps only one connection's frames; --in / --out only frames received / sent)
+
+#include "Log.hpp"
+#include "hex_dump.hpp"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./trace-dump <trace-file> [--stream S] [--in | --out]" << std::endl;
+		return 1;
+	};
+	if (argc < 2) return usage();
+	bool any_stream = true;
+	uint32_t stream = 0;
+	int direction = -1; //(any)
+	for (int argi = 2; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--stream" && argi + 1 < argc) {
+			any_stream = false;
+			stream = uint32_t(std::stoul(argv[++argi]));
+		}
+		else if (arg == "--in") direction = Log::In;
+		else if (arg == "--out") direction = Log::Out;
+		else return usage();
+	}
+
+	std::ifstream from(argv[1], std::ios::binary);
+	if (!from) {
+		std::cerr << "Failed to open '" << argv[1] << "'." << std::endl;
+		return 1;
+	}
+
+	uint64_t frames = 0, bytes = 0;
+	bool complete;
+	try {
+		complete = Log::read_trace(from, [&](Log::FrameHeader const &header, std::vector< char > const &data) {
+			if (!any_stream && header.stream != stream) return;
+			if (direction >= 0 && header.direction != direction) return;
+			frames += 1;
+			bytes += data.size();
+
+			std::time_t seconds = std::time_t(header.time / 1000000);
+			std::tm local;
+			#ifdef _WIN32
+			localtime_s(&local, &seconds);
+			#else
+			localtime_r(&seconds, &local);
+			#endif
+			std::cout << std::put_time(&local, "%H:%M:%S") << '.' << std::setw(6) << std::setfill('0') << header.time % 1000000 << std::setfill(' ')
+			          << " [" << header.stream << "] " << (header.direction == Log::In ? "in" : "out") << ", " << data.size() << " bytes";
+			if (!data.empty()) std::cout << " (type '" << data[0] << "')";
+			std::cout << ":\n" << hex_dump(data.data(), data.size());
+		});
+	} catch (std::exception const &e) {
+		std::cerr << "Failed to read '" << argv[1] << "': " << e.what() << std::endl;
+		return 1;
+	}
+	std::cout << frames << " frames, " << bytes << " bytes." << std::endl;
+	if (!complete) std::cerr << "Note: trace ends partway through a frame." << std::endl;
+	return 0;
+}
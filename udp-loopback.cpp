@@ -0,0 +1,173 @@
+//Loopback test for UdpChannel: a UdpClient and UdpServer in one process, on a simulated bad network.
+// Usage: ./udp-loopback [--port P] [--seconds S] [--tick-rate hz] [--rate messages-per-second] [--reliable fraction]
+//                       [--size bytes] [--loss p] [--latency ms] [--jitter ms] [--reorder p]
+// Each tick, the client sends that tick's share of messages (some reliable) and the server echoes
+// every one back the same way, so both directions carry traffic (and acks ride along with it).
+// Loss/latency/jitter/reorder are applied to packets in both directions. Reports how many messages
+// arrived, whether reliable ones arrived exactly once and in order, and one-way latency percentiles.
+
+#include "UdpChannel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t./udp-loopback [--port P] [--seconds S] [--tick-rate hz] [--rate messages-per-second] [--reliable fraction]\n"
+		             "\t                [--size bytes] [--loss p] [--latency ms] [--jitter ms] [--reorder p]" << std::endl;
+		return 1;
+	};
+	std::string port = "15467";
+	double seconds = 10.0;
+	double tick_rate = 60.0;
+	double rate = 600.0;
+	double reliable_fraction = 0.1;
+	size_t size = 32;
+	UdpImpairment impairment;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--port" && argi + 1 < argc) port = argv[++argi];
+		else if (arg == "--seconds" && argi + 1 < argc) seconds = std::stod(argv[++argi]);
+		else if (arg == "--tick-rate" && argi + 1 < argc) tick_rate = std::stod(argv[++argi]);
+		else if (arg == "--rate" && argi + 1 < argc) rate = std::stod(argv[++argi]);
+		else if (arg == "--reliable" && argi + 1 < argc) reliable_fraction = std::stod(argv[++argi]);
+		else if (arg == "--size" && argi + 1 < argc) size = size_t(std::stoul(argv[++argi]));
+		else if (arg == "--loss" && argi + 1 < argc) impairment.loss = std::stod(argv[++argi]);
+		else if (arg == "--latency" && argi + 1 < argc) impairment.latency = std::stod(argv[++argi]) * 1e-3;
+		else if (arg == "--jitter" && argi + 1 < argc) impairment.jitter = std::stod(argv[++argi]) * 1e-3;
+		else if (arg == "--reorder" && argi + 1 < argc) impairment.reorder = std::stod(argv[++argi]);
+		else return usage();
+	}
+	if (!(seconds > 0.0 && tick_rate > 0.0 && rate > 0.0)) return usage();
+
+	//every message starts with when it was sent, its index (per kind), and whether it is an echo:
+	struct Stamp {
+		int64_t sent_ns = 0;
+		uint32_t index = 0;
+		uint8_t echo = 0;
+	};
+	size = std::max(size, sizeof(Stamp));
+
+	UdpServer server(port);
+	UdpClient client("127.0.0.1", port);
+	server.impairment = impairment;
+	client.impairment = impairment;
+	if (size > client.channel.max_message_size()) {
+		std::cerr << "Messages of " << size << " bytes don't fit in a packet (max " << client.channel.max_message_size() << ")." << std::endl;
+		return 1;
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	auto stamp_now = [&]() {
+		return int64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now() - start).count());
+	};
+
+	//per kind (0: unreliable, 1: reliable):
+	struct Tally {
+		uint32_t sent = 0;
+		uint32_t arrived = 0; //(at the server)
+		uint32_t echoed = 0; //(back at the client)
+		uint32_t out_of_order = 0; //(reliable only: should stay 0)
+		uint32_t next_index = 0; //(reliable only: next index expected at the server)
+		std::vector< double > latency; //one-way, seconds
+	} tally[2];
+
+	std::vector< char > message(size, '\0');
+	auto handle = [&](UdpChannel *channel, UdpChannel::Event evt, bool at_server) {
+		if (evt != UdpChannel::OnRecv) return;
+		while (!channel->received.empty()) {
+			UdpChannel::Message &got = channel->received.front();
+			Stamp stamp;
+			if (got.data.size() >= sizeof(stamp)) {
+				std::memcpy(&stamp, got.data.data(), sizeof(stamp));
+				Tally &t = tally[got.reliable ? 1 : 0];
+				t.latency.emplace_back((stamp_now() - stamp.sent_ns) * 1e-9);
+				if (at_server) {
+					t.arrived += 1;
+					if (got.reliable) {
+						if (stamp.index != t.next_index) t.out_of_order += 1;
+						t.next_index = stamp.index + 1;
+					}
+					//echo (with a fresh timestamp, so latency is one-way both times):
+					stamp.sent_ns = stamp_now();
+					stamp.echo = 1;
+					std::memcpy(got.data.data(), &stamp, sizeof(stamp));
+					channel->send(got.data.data(), got.data.size(), got.reliable);
+				} else {
+					t.echoed += 1;
+				}
+			}
+			channel->received.pop_front();
+		}
+	};
+
+	double tick = 1.0 / tick_rate;
+	double due = 0.0; //messages owed (fractional)
+	size_t ticks = size_t(seconds * tick_rate);
+	double reliable_due = 0.0;
+	for (size_t i = 0; i < ticks; ++i) {
+		Clock::time_point tick_at = start + std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(tick * double(i)));
+		while (Clock::now() < tick_at) {
+			server.poll([&](UdpChannel *c, UdpChannel::Event evt){ handle(c, evt, true); }, 0.001);
+			client.poll([&](UdpChannel *c, UdpChannel::Event evt){ handle(c, evt, false); }, 0.0);
+		}
+		due += rate * tick;
+		while (due >= 1.0) {
+			due -= 1.0;
+			reliable_due += reliable_fraction;
+			bool reliable = (reliable_due >= 1.0);
+			if (reliable) reliable_due -= 1.0;
+			Tally &t = tally[reliable ? 1 : 0];
+			Stamp stamp;
+			stamp.sent_ns = stamp_now();
+			stamp.index = t.sent++;
+			std::memcpy(message.data(), &stamp, sizeof(stamp));
+			client.channel.send(message.data(), message.size(), reliable);
+		}
+		client.poll([&](UdpChannel *c, UdpChannel::Event evt){ handle(c, evt, false); }, 0.0);
+	}
+
+	//let reliable messages (and their echoes) finish:
+	Clock::time_point drain_until = Clock::now() + std::chrono::seconds(3);
+	while (Clock::now() < drain_until && tally[1].echoed < tally[1].sent) {
+		server.poll([&](UdpChannel *c, UdpChannel::Event evt){ handle(c, evt, true); }, 0.001);
+		client.poll([&](UdpChannel *c, UdpChannel::Event evt){ handle(c, evt, false); }, 0.0);
+	}
+
+	auto percentile = [](std::vector< double > &v, double f) {
+		if (v.empty()) return 0.0;
+		size_t i = std::min(v.size() - 1, size_t(f * double(v.size())));
+		std::nth_element(v.begin(), v.begin() + i, v.end());
+		return v[i];
+	};
+
+	std::cout << "Sent " << rate << " messages/s of " << size << " bytes at " << tick_rate << "Hz for " << seconds << "s, "
+	          << reliable_fraction * 100.0 << "% reliable; loss " << impairment.loss * 100.0 << "%, latency " << impairment.latency * 1e3
+	          << "ms + up to " << impairment.jitter * 1e3 << "ms jitter, " << impairment.reorder * 100.0 << "% reordered (each way):\n";
+	char const *names[2] = {"unreliable", "reliable"};
+	for (uint32_t k = 0; k < 2; ++k) {
+		Tally &t = tally[k];
+		std::cout << "  " << names[k] << ": sent " << t.sent << ", arrived " << t.arrived << " (" << (t.sent ? 100.0 * t.arrived / t.sent : 0.0) << "%), echoed back " << t.echoed;
+		if (k == 1) std::cout << ", out of order " << t.out_of_order;
+		std::cout << "\n    one-way latency: p50 " << percentile(t.latency, 0.5) * 1e3 << "ms, p90 " << percentile(t.latency, 0.9) * 1e3
+		          << "ms, p99 " << percentile(t.latency, 0.99) * 1e3 << "ms, max " << percentile(t.latency, 1.0) * 1e3 << "ms\n";
+	}
+	UdpChannel::Stats const &cs = client.channel.stats;
+	std::cout << "  client: " << cs.packets_sent << " packets for " << cs.messages_sent << " messages (" << (cs.packets_sent ? double(cs.messages_sent) / cs.packets_sent : 0.0)
+	          << " per packet), " << cs.packets_acked << " acked, " << cs.packets_lost << " judged lost, " << cs.resends << " resends, rtt " << client.channel.rtt * 1e3 << "ms\n";
+	for (auto const &channel : server.channels) {
+		UdpChannel::Stats const &ss = channel.stats;
+		std::cout << "  server: " << ss.packets_sent << " packets, " << ss.packets_received << " received (" << ss.duplicates << " duplicate, " << ss.stale << " stale), "
+		          << ss.packets_lost << " judged lost, " << ss.resends << " resends\n";
+	}
+	std::cout.flush();
+
+	bool ok = (tally[1].arrived == tally[1].sent && tally[1].echoed == tally[1].sent && tally[1].out_of_order == 0);
+	if (!ok) std::cout << "FAILED: reliable messages went missing or arrived out of order." << std::endl;
+	return ok ? 0 : 1;
+}
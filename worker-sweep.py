@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+
+#sweep the server's worker thread count under the same loadgen load, printing rooms/s and tick lateness p99 for each.
+#usage: ./worker-sweep.py [--workers 1,2,4,8] [--seconds S] [--players N] [--port P] [--pin] [-- extra server arguments...]
+# (run from the directory holding dist/server and dist/loadgen -- build them with jam first)
+#each run starts './dist/server <port> <workers> --run-for <seconds> --no-bots', drives it with
+# './dist/loadgen 127.0.0.1 <port> --players N --seconds S --think 0 0', and reads the server's
+# closing "result:" line (rooms closed per second, and TickScheduler lateness p99 over every shard).
+#--pin runs the server on its first <workers> cores (with taskset) so worker count == core count.
+
+import os
+import re
+import subprocess
+import sys
+import time
+
+workers = [1, 2, 4, 8]
+seconds = 10.0
+players = 600
+port = 15500
+pin = False
+server_args = []
+
+args = sys.argv[1:]
+while args:
+	arg = args.pop(0)
+	if arg == '--workers' and args:
+		workers = [int(w) for w in args.pop(0).split(',')]
+	elif arg == '--seconds' and args:
+		seconds = float(args.pop(0))
+	elif arg == '--players' and args:
+		players = int(args.pop(0))
+	elif arg == '--port' and args:
+		port = int(args.pop(0))
+	elif arg == '--pin':
+		pin = True
+	elif arg == '--':
+		server_args = args
+		args = []
+	else:
+		print("Usage:\n\t./worker-sweep.py [--workers 1,2,4,8] [--seconds S] [--players N] [--port P] [--pin] [-- extra server arguments...]", file=sys.stderr)
+		sys.exit(1)
+
+exe = '.exe' if os.name == 'nt' else ''
+server_exe = os.path.join('dist', 'server' + exe)
+loadgen_exe = os.path.join('dist', 'loadgen' + exe)
+for path in [server_exe, loadgen_exe]:
+	if not os.path.exists(path):
+		print("Missing '" + path + "' (build it with jam).", file=sys.stderr)
+		sys.exit(1)
+
+cores = os.cpu_count() or 1
+results = []
+for count in workers:
+	run_port = str(port)
+	port += 1 #(a fresh port per run, so nothing lingers in TIME_WAIT)
+
+	command = [server_exe, run_port, str(count), '--run-for', str(seconds + 1.0), '--no-bots', '--log', 'warn'] + server_args
+	if pin:
+		command = ['taskset', '-c', '0-' + str(min(count, cores) - 1)] + command
+	server = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, universal_newlines=True)
+	#wait for the server to start listening:
+	for line in server.stdout:
+		if line.startswith('Serving rooms'): break
+	time.sleep(0.2)
+
+	loadgen = subprocess.run([loadgen_exe, '127.0.0.1', run_port, '--players', str(players), '--seconds', str(seconds), '--think', '0', '0'],
+		stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+	output = server.communicate()[0]
+
+	m = re.search(r'^result: workers (\d+), rooms/s ([0-9.e+-]+), lateness p99 <=([0-9.e+-]+)ms$', output, re.MULTILINE)
+	moves = re.search(r'^moves \d+ \(([0-9.]+)/s\)', loadgen.stderr, re.MULTILINE)
+	if m == None:
+		print("workers " + str(count) + ": no result from the server", file=sys.stderr)
+		sys.exit(1)
+	results.append((count, float(m.group(2)), float(m.group(3)), float(moves.group(1)) if moves else 0.0))
+	print("workers %d: %.1f rooms/s, lateness p99 <=%.3fms (%.0f moves/s)" % results[-1], flush=True)
+
+print()
+print("workers  rooms/s  lateness-p99-ms  moves/s")
+for count, rooms, lateness, moves in results:
+	print("%7d  %7.1f  %15.3f  %7.0f" % (count, rooms, lateness, moves))